@@ -35,6 +35,8 @@ import subprocess
 import sys
 import tempfile
 
+import valgrind.cmplog
+import valgrind.coverage
 import valgrind.error_parser
 import valgrind.runner
 
@@ -51,7 +53,7 @@ class Flayer:
     self.__taint = ''
     self.set_taint('nfs') # TODO: e
     self.__taint_filter = {}
-    #self.set_taint_network_filter('')
+    self.set_taint_network_filter('')
     self.set_taint_file_filter('')
     self.__errors = {}
     self.__shelf = None
@@ -83,6 +85,8 @@ class Flayer:
     self.__cleanup_tmpdir()
     self.__tmpdir = tempfile.mkdtemp()
     self.__runner['log-file'] = self.__tmpdir + '/flayer'
+    if self.__runner.has_key('output-file'):
+      self.__runner['output-file'] = self.__tmpdir + '/flayer.out'
 
   # TODO: change these to properties
   def get_taint(self):
@@ -109,13 +113,52 @@ class Flayer:
         raise RuntimeError, "Request value not yet implemented: " + ch
 
   def set_taint_network_filter(self, value):
-    """specified the host or port traffic to mark"""
-    raise RuntimeError, "NOT YET IMPLEMENTED"
+    """specified the host or port traffic to mark
+
+       value is a "host:port" string, a comma separated list of them,
+       or a list of them. Either half may be empty or '*'.
+    """
+    self.__runner['network-filter'] = value
 
   def set_taint_file_filter(self, value):
     """specified the path prefix for file activity to mark"""
     self.__runner['file-filter'] = value
 
+  def set_input_shm(self, name, fd):
+    """serves read()s on fd from the shared memory object name,
+       eg. one filled by input.fuzz.FuzzShm"""
+    self.__runner['input-shm'] = '%s:%d' % (name, fd)
+
+  def set_cmp_log(self, path):
+    """logs compares of tainted input against constants to path,
+       for reading with valgrind.cmplog"""
+    if path:
+      self.__runner['emit-cmp-log'] = path
+    elif self.__runner.has_key('emit-cmp-log'):
+      del self.__runner['emit-cmp-log']
+
+  def set_output_format(self, fmt):
+    """has errors streamed as 'jsonl' or 'binary' records, which are
+       quicker to read than the XML log; '' goes back to the XML"""
+    if fmt:
+      self.__runner['output-format'] = fmt
+      self.__runner['output-file'] = self.__tmpdir + '/flayer.out'
+    elif self.__runner.has_key('output-format'):
+      del self.__runner['output-format']
+      del self.__runner['output-file']
+
+  def set_coverage_shm(self, name):
+    """has edge and tainted branch bitmaps kept in the shared memory
+       object name, created with valgrind.coverage.CoverageMap"""
+    if name:
+      self.__runner['coverage-shm'] = name
+    elif self.__runner.has_key('coverage-shm'):
+      del self.__runner['coverage-shm']
+
+  def CmpLog(self, path):
+    """returns the entries of a cmp log written by a run"""
+    return valgrind.cmplog.read(path)
+
   def get_taint_file_filter(self):
     if self.__runner.has_key('file-filter'):
       return copy.copy(self.__runner['file-filter'])
@@ -140,6 +183,10 @@ class Flayer:
 
   def _ReadErrors(self, f):
     """opens the valgrind error output and parses it"""
+    if self.__runner.has_key('output-format'):
+      p = valgrind.error_parser.StreamParser()
+      self.__errors = p.parse(open(self.__runner['output-file'], 'rb'))
+      return
     p = valgrind.error_parser.Parser()
     self.__errors = p.parse(open(f))
 
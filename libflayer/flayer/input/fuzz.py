@@ -32,8 +32,10 @@
 __author__ = "Will Drewry"
 
 import binascii
+import mmap
 import os
 import random
+import struct
 import tempfile
 
 #### Support classes - where should this go?
@@ -132,3 +134,56 @@ class FuzzFile(FuzzWritable):
 
   def get_target(self):
     return self.get_file()
+
+class ShmBuffer:
+  """writable view of a flayer --input-shm buffer.  write() appends
+     to the pending input; Publish() hands it to flayer."""
+  HEADER = 'II' # seq, len
+  def __init__(self, name, size):
+    self.name = name
+    self.path = os.path.join('/dev/shm', name.lstrip('/'))
+    self._header_size = struct.calcsize(ShmBuffer.HEADER)
+    self._size = size
+    fd = os.open(self.path, os.O_RDWR | os.O_CREAT, 0600)
+    os.ftruncate(fd, self._header_size + size)
+    self._map = mmap.mmap(fd, self._header_size + size)
+    os.close(fd)
+    self._seq = 0
+    self._len = 0
+    self._map[:self._header_size] = struct.pack(ShmBuffer.HEADER, 0, 0)
+
+  def write(self, data):
+    data = data[:self._size - self._len]
+    start = self._header_size + self._len
+    self._map[start:start + len(data)] = data
+    self._len += len(data)
+
+  def Publish(self):
+    """makes the data written so far the next input"""
+    self._seq += 1
+    self._map[:self._header_size] = struct.pack(ShmBuffer.HEADER,
+                                                self._seq, self._len)
+    self._len = 0
+
+  def Close(self):
+    if self._map is not None:
+      self._map.close()
+      self._map = None
+    if os.path.exists(self.path):
+      os.remove(self.path)
+
+class FuzzShm(FuzzWritable):
+  """fuzzes straight into the shared buffer of a run with
+     --input-shm=<name>:<fd> (see Flayer.set_input_shm), avoiding
+     a temporary file per input"""
+  def __init__(self, name, seed=0, block_size=4096):
+    FuzzWritable.__init__(self, seed, block_size)
+    self._target = ShmBuffer(name, self._max_bytes)
+
+  def _Run(self):
+    FuzzWritable._Run(self)
+    self._target.Publish()
+
+  def CleanUp(self):
+    if self._target is not None:
+      self._target.Close()
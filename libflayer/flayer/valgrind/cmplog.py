@@ -0,0 +1,120 @@
+#!/usr/bin/python
+#
+# Copyright 2007 Google Inc.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the
+# Free Software Foundation, Inc.,
+# 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+#
+
+
+"""reads flayer's --emit-cmp-log output and turns it into input patches
+
+   entries = valgrind.cmplog.read('/tmp/cmp.log')
+   tokens = valgrind.cmplog.dictionary(entries)
+   for candidate in valgrind.cmplog.patches(data, entries):
+     ...
+"""
+
+__author__ = "Will Drewry"
+
+import struct
+
+# Must match FL_CMPLOG_MAGIC and FL_CmpLogKind in flayer
+MAGIC = 'FLCMPLG1'
+KIND_INSN = 0
+KIND_STR = 1
+KIND_MEM = 2
+
+class CmpLogError(RuntimeError): pass
+
+class Entry(object):
+  """one compare of a tainted operand against an untainted one"""
+  def __init__(self, kind, pc, tainted, untainted, mask):
+    self.kind = kind
+    self.pc = pc
+    self.tainted = tainted
+    self.untainted = untainted
+    self.mask = mask
+
+  def __repr__(self):
+    return 'Entry(%d, 0x%x, %r, %r)' % (self.kind, self.pc,
+                                        self.tainted, self.untainted)
+
+def read(path):
+  """returns the list of Entry in the log at path"""
+  data = open(path, 'rb').read()
+  if data[:len(MAGIC)] != MAGIC:
+    raise CmpLogError, 'not a cmp log: ' + path
+  entries = []
+  offset = len(MAGIC)
+  while offset + 10 <= len(data):
+    kind, length, pc = struct.unpack('<BBQ', data[offset:offset+10])
+    offset += 10
+    if offset + 3 * length > len(data):
+      break # truncated by a crash
+    tainted = data[offset:offset+length]
+    untainted = data[offset+length:offset+2*length]
+    mask = data[offset+2*length:offset+3*length]
+    offset += 3 * length
+    entries.append(Entry(kind, pc, tainted, untainted, mask))
+  return entries
+
+def dictionary(entries):
+  """returns the untainted operands as a list of fuzzing tokens"""
+  tokens = []
+  for e in entries:
+    token = e.untainted
+    if e.kind == KIND_STR:
+      token = token.rstrip('\0')
+    if token and token not in tokens:
+      tokens.append(token)
+  return tokens
+
+def _replacements(e):
+  """(find, replace) byte string pairs worth trying for an entry"""
+  # Only the tainted bytes came from the input.
+  first = 0
+  while first < len(e.mask) and e.mask[first] == '\0':
+    first += 1
+  last = len(e.mask)
+  while last > first and e.mask[last-1] == '\0':
+    last -= 1
+  if first == last:
+    return []
+  find = e.tainted[first:last]
+  replace = e.untainted[first:last]
+  if e.kind == KIND_STR:
+    # The terminator need not be in the input.
+    find = find.rstrip('\0') or find
+    replace = replace[:len(find)]
+  pairs = [(find, replace)]
+  if e.kind == KIND_INSN and len(find) > 1:
+    # The input may hold it big-endian.
+    pairs.append((find[::-1], replace[::-1]))
+  return pairs
+
+def patches(data, entries):
+  """yields copies of data with each occurrence of a tainted operand
+     replaced by the value it was compared against"""
+  seen = {}
+  for e in entries:
+    for find, replace in _replacements(e):
+      start = data.find(find)
+      while start != -1:
+        patched = data[:start] + replace + data[start+len(find):]
+        if patched != data and not seen.has_key(patched):
+          seen[patched] = True
+          yield patched
+        start = data.find(find, start + 1)
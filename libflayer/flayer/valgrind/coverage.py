@@ -0,0 +1,84 @@
+#!/usr/bin/python
+#
+# Copyright 2007 Google Inc.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the
+# Free Software Foundation, Inc.,
+# 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+#
+
+
+
+"""the edge and tainted branch bitmaps of a run with --coverage-shm
+
+   cov = valgrind.coverage.CoverageMap('flayer-cov')
+   flayer.set_coverage_shm(cov.name)
+   cov.Clear()
+   ... run ...
+   if cov.edges() - seen_edges:
+     ...
+"""
+
+__author__ = "Will Drewry"
+
+import mmap
+import os
+
+# Must match FL_COVERAGE_MAP_SIZE in flayer
+MAP_SIZE = 1 << 16
+
+class CoverageMap:
+  """creates /dev/shm/<name> for flayer to count edges and tainted
+     branch outcomes in"""
+  def __init__(self, name):
+    self.name = name
+    self.path = os.path.join('/dev/shm', name.lstrip('/'))
+    fd = os.open(self.path, os.O_RDWR | os.O_CREAT, 0600)
+    os.ftruncate(fd, 2 * MAP_SIZE)
+    self._map = mmap.mmap(fd, 2 * MAP_SIZE)
+    os.close(fd)
+
+  def Clear(self):
+    """must be called before each run; a fork server child does not
+       clear the maps itself"""
+    self._map[:] = '\0' * (2 * MAP_SIZE)
+
+  def hits(self):
+    """returns {edge slot: hit count (mod 256)}"""
+    counts = {}
+    data = self._map[:MAP_SIZE]
+    for slot in xrange(MAP_SIZE):
+      if data[slot] != '\0':
+        counts[slot] = ord(data[slot])
+    return counts
+
+  def edges(self):
+    """returns the set of edge slots hit"""
+    return set(self.hits().keys())
+
+  def branches(self):
+    """returns the set of (branch slot, taken) seen with a tainted guard"""
+    seen = set()
+    data = self._map[MAP_SIZE:]
+    for i in xrange(MAP_SIZE):
+      if data[i] != '\0':
+        seen.add((i >> 1, bool(i & 1)))
+    return seen
+
+  def Close(self):
+    if self._map is not None:
+      self._map.close()
+      self._map = None
+    if os.path.exists(self.path):
+      os.remove(self.path)
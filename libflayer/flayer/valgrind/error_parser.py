@@ -20,7 +20,13 @@
 #
 #
 
-"""valgrind XML output parser for extracting error data"""
+"""valgrind XML output parser for extracting error data
+
+   Also reads the records flayer streams with --output-format=jsonl or
+   --output-format=binary:
+
+   errors = valgrind.error_parser.StreamParser().parse(open(path, 'rb'))
+"""
 
 __author__ = 'Will Drewry'
 
@@ -28,6 +34,13 @@ from xml.sax._exceptions import SAXParseException
 from xml.sax import make_parser
 from xml.sax.handler import ContentHandler
 import copy
+import os
+import struct
+import subprocess
+try:
+  import json
+except ImportError:
+  import simplejson as json
 
 class ErrorFrame:
   """Contains frame information"""
@@ -200,3 +213,222 @@ class Parser:
         errors[key].count = errorcount[key]
     return errors
 
+
+
+# Must match FL_OUTPUT_MAGIC and the record types in flayer's fl_output.c
+BINARY_MAGIC = 'FLERRS01'
+RECORD_ERROR = 0
+RECORD_COUNT = 1
+RECORD_SYMBOL = 2
+RECORD_OBJECT = 3
+
+class Object:
+  """where a loaded object was, from an 'object' record"""
+  def __init__(self, start, size, bias, file):
+    self.start = start
+    self.size = size
+    self.bias = bias
+    self.file = file
+
+  def __repr__(self):
+    return 'Object(0x%x, %d, 0x%x, %r)' % (self.start, self.size,
+                                            self.bias, self.file)
+
+class StreamParser:
+  """reads flayer's --output-format=jsonl|binary records in one pass
+
+     Records can be fed as they are read, eg. while tailing the file
+     during a run, with feed(); errors() returns what has been seen.
+     With --symbolise=exit|offline frames hold only the ip until the
+     names turn up in 'symbol' records, or are looked up by
+     symbolise_offline().
+  """
+  def __init__(self):
+    self.__errors = {}
+    self.__symbols = {}
+    self.__objects = []
+    self.__pending = ''
+    self.__binary = None
+
+  def errors(self):
+    """provides a copy of the errors seen so far, keyed by unique"""
+    errors = copy.deepcopy(self.__errors)
+    for error in errors.values():
+      for frame in error.frames:
+        names = self.__symbols.get(int(frame.instruction_pointer, 16))
+        if names and not frame.obj and not frame.function_name:
+          (frame.obj, frame.function_name, frame.dir,
+           frame.file, frame.line) = names
+    return errors
+
+  def objects(self):
+    """provides the objects the frames' ips were found in"""
+    return copy.copy(self.__objects)
+
+  def symbolise_offline(self, addr2line='addr2line'):
+    """names the frames still lacking symbols with addr2line, using the
+       object records; the objects must still be where they were"""
+    wanted = {}
+    for error in self.__errors.values():
+      for frame in error.frames:
+        ip = int(frame.instruction_pointer, 16)
+        if not frame.function_name and not self.__symbols.has_key(ip):
+          for o in self.__objects:
+            if o.start <= ip < o.start + o.size:
+              wanted.setdefault(o, []).append(ip)
+              break
+    for o, ips in wanted.items():
+      addrs = ['0x%x' % (ip - o.bias) for ip in ips]
+      # o.file comes from the stream, so keep it away from a shell.
+      p = subprocess.Popen([addr2line, '-f', '-e', o.file] + addrs,
+                           stdout=subprocess.PIPE)
+      lines = p.communicate()[0].split('\n')
+      for i in range(len(ips)):
+        if 2 * i + 1 >= len(lines):
+          break
+        fn = lines[2 * i]
+        where = lines[2 * i + 1]
+        path, line = where, ''
+        if ':' in where:
+          path, line = where.rsplit(':', 1)
+        if fn == '??':
+          fn = ''
+        if path == '??':
+          path = ''
+        if line in ('0', '?'):
+          line = ''
+        self.__symbols[ips[i]] = (o.file, fn, os.path.dirname(path),
+                                  os.path.basename(path), line)
+
+  def parse(self, f):
+    """reads all of file object f and returns the errors"""
+    self.feed(f.read())
+    return self.errors()
+
+  def feed(self, data):
+    """consumes data; a trailing partial record is kept for later"""
+    self.__pending += data
+    if self.__binary is None:
+      if len(self.__pending) < len(BINARY_MAGIC):
+        return
+      self.__binary = self.__pending.startswith(BINARY_MAGIC)
+      if self.__binary:
+        self.__pending = self.__pending[len(BINARY_MAGIC):]
+    if self.__binary:
+      self.__feed_binary()
+    else:
+      self.__feed_jsonl()
+
+  def __feed_jsonl(self):
+    lines = self.__pending.split('\n')
+    self.__pending = lines.pop()
+    for line in lines:
+      if not line:
+        continue
+      record = json.loads(line)
+      if record['type'] == 'error':
+        error = Error()
+        error.unique = '0x%x' % record['unique']
+        error.tid = str(record['tid'])
+        error.kind = record['kind']
+        error.what = record['what']
+        error.count = record['count']
+        for f in record['frames']:
+          frame = ErrorFrame()
+          frame.instruction_pointer = f['ip']
+          frame.obj = f.get('obj', '')
+          frame.function_name = f.get('fn', '')
+          frame.dir = f.get('dir', '')
+          frame.file = f.get('file', '')
+          if f.get('line'):
+            frame.line = str(f['line'])
+          error.frames.append(frame)
+        self.__errors[record['unique']] = error
+      elif record['type'] == 'count':
+        if self.__errors.has_key(record['unique']):
+          self.__errors[record['unique']].count = record['count']
+      elif record['type'] == 'symbol':
+        line = ''
+        if record['line']:
+          line = str(record['line'])
+        self.__symbols[int(record['ip'], 16)] = (
+          record['obj'], record['fn'], record['dir'], record['file'], line)
+      elif record['type'] == 'object':
+        self.__objects.append(Object(int(record['start'], 16),
+                                     record['size'],
+                                     int(record['bias'], 16),
+                                     record['file']))
+
+  def __feed_binary(self):
+    data = self.__pending
+    offset = 0
+    while True:
+      try:
+        record, offset = self.__read_binary(data, offset)
+      except struct.error:
+        break # incomplete; wait for more
+      if record is None:
+        break
+    self.__pending = data[offset:]
+
+  def __read_string(self, data, offset):
+    (length,) = struct.unpack('<H', data[offset:offset+2])
+    offset += 2
+    if offset + length > len(data):
+      raise struct.error, 'short string'
+    return data[offset:offset+length], offset + length
+
+  def __read_names(self, data, at):
+    """returns ((obj, fn, dir, file, line), offset after them)"""
+    obj, at = self.__read_string(data, at)
+    fn, at = self.__read_string(data, at)
+    dir, at = self.__read_string(data, at)
+    file, at = self.__read_string(data, at)
+    (line,) = struct.unpack('<I', data[at:at+4])
+    if line:
+      line = str(line)
+    else:
+      line = ''
+    return (obj, fn, dir, file, line), at + 4
+
+  def __read_binary(self, data, offset):
+    """returns (record kind, offset after it), or (None, offset)"""
+    if offset >= len(data):
+      return None, offset
+    kind = ord(data[offset])
+    if kind == RECORD_COUNT:
+      unique, count = struct.unpack('<II', data[offset+1:offset+9])
+      if self.__errors.has_key(unique):
+        self.__errors[unique].count = count
+      return kind, offset + 9
+    if kind == RECORD_SYMBOL:
+      (ip,) = struct.unpack('<Q', data[offset+1:offset+9])
+      names, at = self.__read_names(data, offset + 9)
+      self.__symbols[ip] = names
+      return kind, at
+    if kind == RECORD_OBJECT:
+      start, size, bias = struct.unpack('<QQQ', data[offset+1:offset+25])
+      file, at = self.__read_string(data, offset + 25)
+      self.__objects.append(Object(start, size, bias, file))
+      return kind, at
+    if kind != RECORD_ERROR:
+      raise RuntimeError, 'bad record kind %d' % kind
+    unique, tid, count = struct.unpack('<III', data[offset+1:offset+13])
+    at = offset + 13
+    error = Error()
+    error.unique = '0x%x' % unique
+    error.tid = str(tid)
+    error.count = count
+    error.kind, at = self.__read_string(data, at)
+    error.what, at = self.__read_string(data, at)
+    (n_frames,) = struct.unpack('<H', data[at:at+2])
+    at += 2
+    for i in range(n_frames):
+      frame = ErrorFrame()
+      (ip,) = struct.unpack('<Q', data[at:at+8])
+      frame.instruction_pointer = '0x%X' % ip
+      (frame.obj, frame.function_name, frame.dir, frame.file,
+       frame.line), at = self.__read_names(data, at + 8)
+      error.frames.append(frame)
+    self.__errors[unique] = error
+    return kind, at
@@ -0,0 +1,89 @@
+#!/usr/bin/python
+#
+# Copyright 2007 Google Inc.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the 
+# Free Software Foundation, Inc.,
+# 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+#
+
+
+"""driver side of flayer's --fork-server protocol"""
+
+__author__ = "Will Drewry"
+
+import os
+import struct
+import subprocess
+
+# Must match FL_FORKSRV_CTL_FD and FL_FORKSRV_ST_FD in fl_include.h
+CTL_FD = 198
+ST_FD = 199
+
+class ForkServerError(RuntimeError): pass
+
+class ForkServer(object):
+  """starts valgrind once under a Runner and then runs test cases
+     as forked children of the snapshot"""
+  def __init__(self, runner, fork_at='first-read'):
+    self.runner = runner
+    self.runner['fork-server'] = True
+    self.runner['fork-at'] = fork_at
+    self.process = None
+    self.__ctl = None
+    self.__st = None
+
+  def start(self, additional_arguments=[], verbose=False, *io):
+    """runs valgrind up to the fork point and waits for its hello"""
+    ctl_r, ctl_w = os.pipe()
+    st_r, st_w = os.pipe()
+    def setup_fds():
+      os.dup2(ctl_r, CTL_FD)
+      os.dup2(st_w, ST_FD)
+      for fd in [ctl_r, ctl_w, st_r, st_w]:
+        os.close(fd)
+    self.process = self.runner.run(additional_arguments, verbose, *io,
+                                   **{'preexec_fn':setup_fds,
+                                      'close_fds':False})
+    os.close(ctl_r)
+    os.close(st_w)
+    self.__ctl = ctl_w
+    self.__st = st_r
+    self.__read_int()
+
+  def __read_int(self):
+    data = ''
+    while len(data) < 4:
+      chunk = os.read(self.__st, 4 - len(data))
+      if not chunk:
+        raise ForkServerError, 'fork server went away'
+      data += chunk
+    return struct.unpack('i', data)[0]
+
+  def run(self):
+    """runs one test case and returns (pid, wait status)"""
+    os.write(self.__ctl, struct.pack('I', 0))
+    pid = self.__read_int()
+    status = self.__read_int()
+    return (pid, status)
+
+  def stop(self):
+    """closes the control pipe, which makes the server exit"""
+    if self.__ctl is not None:
+      os.close(self.__ctl)
+      os.close(self.__st)
+      self.__ctl = self.__st = None
+    if self.process is not None:
+      self.process.wait()
+      self.process = None
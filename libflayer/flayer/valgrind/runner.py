@@ -40,6 +40,7 @@ class Runner(dict):
     'taint-file':True,
     'taint-network':True,
     'file-filter':'',
+    'network-filter':'',
     'log-file':'',
   }
   def __init__(self):
@@ -96,7 +97,7 @@ class Runner(dict):
   arguments = property(__GetArguments, __SetArguments,
                        doc="""Get or set the current arguments""")
 
-  def run(self, additional_arguments=[],verbose=False,*io):
+  def run(self, additional_arguments=[],verbose=False,*io,**popen_args):
     """executes valgrind with the options and returns the popen object"""
     # Test for correctness
     if type(self.executable) != str:
@@ -119,11 +120,12 @@ class Runner(dict):
     if len(io) > 2:
       stderr = io[2]
 
+    popen_args.setdefault('close_fds', True)
     process = subprocess.Popen(arguments,
                                self.bufsize,
                                env=self.environment,
                                stdin=stdin,
                                stdout=stdout,
                                stderr=stderr,
-                               close_fds=True)
+                               **popen_args)
     return process
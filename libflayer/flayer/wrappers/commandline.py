@@ -234,7 +234,7 @@ class Shell:
     if file != None:
       self.__flayer.set_taint_file_filter(file)
     if network != None:
-      self.__flayer.set_taint_network_filter(file)
+      self.__flayer.set_taint_network_filter(network)
 
   def _E_Command(self, command=None, args=[], env={}):
     """gets/sets the target command
@@ -49,6 +49,7 @@
 #include "libvex_trc_values.h"
 
 #include "main/vex_util.h"
+#include "main/vex_globals.h"
 #include "host-generic/h_generic_regs.h"
 #include "host-x86/hdefs.h"
 
@@ -2168,7 +2169,14 @@ Int emit_X86Instr ( UChar* buf, Int nbuf, X86Instr* i,
       *p++ = toUChar(0xD0 + irno);
       goto done;
 
-   case Xin_Goto:
+   case Xin_Goto: {
+      /* Can the dispatcher patch this exit into a direct jump to the
+         next translation?  See VexTranslateArgs.dispatch_chain_me. */
+      Bool chainable
+         = vex_dispatch_chain_me != NULL
+           && i->Xin.Goto.dst->tag == Xri_Imm
+           && (i->Xin.Goto.jk == Ijk_Boring || i->Xin.Goto.jk == Ijk_Call);
+
       /* Use ptmp for backpatching conditional jumps. */
       ptmp = NULL;
 
@@ -2245,11 +2253,18 @@ Int emit_X86Instr ( UChar* buf, Int nbuf, X86Instr* i,
       vassert(dispatch != NULL);
       /* movl $imm32, %edx */
       *p++ = 0xBA;
-      p = emit32(p, (UInt)Ptr_to_ULong(dispatch));
+      p = emit32(p, (UInt)Ptr_to_ULong(chainable ? vex_dispatch_chain_me
+                                                 : dispatch));
 
-      /* jmp *%edx */
-      *p++ = 0xFF;
-      *p++ = 0xE2;
+      if (chainable) {
+         /* call *%edx */
+         *p++ = 0xFF;
+         *p++ = 0xD2;
+      } else {
+         /* jmp *%edx */
+         *p++ = 0xFF;
+         *p++ = 0xE2;
+      }
 
       /* Fix up the conditional jump, if there was one. */
       if (i->Xin.Goto.cond != Xcc_ALWAYS) {
@@ -2258,6 +2273,7 @@ Int emit_X86Instr ( UChar* buf, Int nbuf, X86Instr* i,
          *ptmp = toUChar(delta-1);
       }
       goto done;
+   }
 
    case Xin_CMov32:
       vassert(i->Xin.CMov32.cond != Xcc_ALWAYS);
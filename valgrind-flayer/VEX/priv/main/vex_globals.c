@@ -72,6 +72,9 @@ Int vex_traceflags = 0;
 /* Are we supporting valgrind checking? */
 Bool vex_valgrind_support = False;
 
+/* Where chainable exits of the current translation go, or NULL */
+void* vex_dispatch_chain_me = NULL;
+
 /* Max # guest insns per bb */
 VexControl vex_control = { 0,0,False,0,0,0 };
 
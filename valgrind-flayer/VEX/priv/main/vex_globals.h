@@ -73,6 +73,10 @@ extern Int vex_traceflags;
 /* Are we supporting valgrind checking? */
 extern Bool vex_valgrind_support;
 
+/* Where chainable exits of the current translation go, or NULL
+   (see VexTranslateArgs.dispatch_chain_me) */
+extern void* vex_dispatch_chain_me;
+
 /* Optimiser/front-end control */
 extern VexControl vex_control;
 
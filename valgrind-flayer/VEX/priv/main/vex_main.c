@@ -235,6 +235,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
    mode64                 = False;
 
    vex_traceflags = vta->traceflags;
+   vex_dispatch_chain_me = vta->dispatch_chain_me;
 
    vassert(vex_initdone);
    vexSetAllocModeTEMP_and_clear();
@@ -281,6 +282,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          host_word_type    = Ity_I64;
          vassert(are_valid_hwcaps(VexArchAMD64, vta->archinfo_host.hwcaps));
          vassert(vta->dispatch != NULL); /* jump-to-dispatcher scheme */
+         vassert(vta->dispatch_chain_me == NULL); /* x86 only */
          break;
 
       case VexArchPPC32:
@@ -300,6 +302,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          host_word_type    = Ity_I32;
          vassert(are_valid_hwcaps(VexArchPPC32, vta->archinfo_host.hwcaps));
          vassert(vta->dispatch == NULL); /* return-to-dispatcher scheme */
+         vassert(vta->dispatch_chain_me == NULL); /* x86 only */
          break;
 
       case VexArchPPC64:
@@ -319,6 +322,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          host_word_type    = Ity_I64;
          vassert(are_valid_hwcaps(VexArchPPC64, vta->archinfo_host.hwcaps));
          vassert(vta->dispatch == NULL); /* return-to-dispatcher scheme */
+         vassert(vta->dispatch_chain_me == NULL); /* x86 only */
          break;
 
       default:
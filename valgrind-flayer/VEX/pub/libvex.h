@@ -497,6 +497,21 @@ typedef
          addresses.
       */
       void* dispatch;
+
+      /* IN: x86 hosts only; must be NULL elsewhere.  If non-NULL,
+         an exit of kind Ijk_Boring or Ijk_Call to a constant guest
+         address is made by
+
+            movl $guest_addr, %eax
+            movl $dispatch_chain_me, %edx
+            call *%edx
+
+         rather than by jumping to 'dispatch'.  The return address
+         tells the dispatcher which exit was taken, so that it can
+         overwrite the last two instructions (7 bytes) with a direct
+         jump to the next translation, once it has one.  Other exits
+         are unaffected. */
+      void* dispatch_chain_me;
    }
    VexTranslateArgs;
 
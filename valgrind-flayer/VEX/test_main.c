@@ -186,6 +186,7 @@ int main ( int argc, char** argv )
 #else /* ppc32, ppc64 hosts */
       vta.dispatch        = NULL;
 #endif
+      vta.dispatch_chain_me = NULL;
 
       for (i = 0; i < TEST_N_ITERS; i++)
          tres = LibVEX_Translate ( &vta );
@@ -2336,11 +2336,12 @@ SysRes VG_(am_sbrk_anon_float_valgrind)( SizeT cszB )
 
 
 /* Map a file at an unconstrained address for V, and update the
-   segment array accordingly.  This is used by V for transiently
-   mapping in object files to read their debug info.  */
+   segment array accordingly.  'flags' is VKI_MAP_PRIVATE or
+   VKI_MAP_SHARED. */
 
-SysRes VG_(am_mmap_file_float_valgrind) ( SizeT length, UInt prot, 
-                                          Int fd, Off64T offset )
+static SysRes am_mmap_file_float_valgrind_wrk ( SizeT length, UInt prot,
+                                                UInt flags,
+                                                Int fd, Off64T offset )
 {
    SysRes     sres;
    NSegment   seg;
@@ -2368,7 +2369,7 @@ SysRes VG_(am_mmap_file_float_valgrind) ( SizeT length, UInt prot,
       any resulting failure immediately. */
    sres = VG_(am_do_mmap_NO_NOTIFY)( 
              advised, length, prot, 
-             VKI_MAP_FIXED|VKI_MAP_PRIVATE, 
+             VKI_MAP_FIXED|flags, 
              fd, offset 
           );
    if (sres.isError)
@@ -2405,6 +2406,26 @@ SysRes VG_(am_mmap_file_float_valgrind) ( SizeT length, UInt prot,
    return sres;
 }
 
+/* This is used by V for transiently mapping in object files to read
+   their debug info.  */
+
+SysRes VG_(am_mmap_file_float_valgrind) ( SizeT length, UInt prot, 
+                                          Int fd, Off64T offset )
+{
+   return am_mmap_file_float_valgrind_wrk( length, prot, VKI_MAP_PRIVATE,
+                                           fd, offset );
+}
+
+/* As VG_(am_mmap_file_float_valgrind), but the mapping is shared, so
+   that V sees writes other processes make to the file. */
+
+SysRes VG_(am_shared_mmap_file_float_valgrind) ( SizeT length, UInt prot,
+                                                 Int fd, Off64T offset )
+{
+   return am_mmap_file_float_valgrind_wrk( length, prot, VKI_MAP_SHARED,
+                                           fd, offset );
+}
+
 
 /* --- --- munmap helper --- --- */
 
@@ -39,6 +39,7 @@
 #include "pub_core_threadstate.h"
 #include "pub_core_debuginfo.h"   /* self */
 #include "pub_core_demangle.h"
+#include "pub_core_errormgr.h"    // VG_(discard_supp_caches)
 #include "pub_core_libcbase.h"
 #include "pub_core_libcassert.h"
 #include "pub_core_libcprint.h"
@@ -53,6 +54,7 @@
 #include "priv_readstabs.h"
 #if defined(VGO_linux)
 # include "priv_readelf.h"
+# include "priv_diskcache.h"
 #elif defined(VGO_aix5)
 # include "pub_core_debuglog.h"
 # include "pub_core_libcproc.h"
@@ -104,6 +106,140 @@
 static SegInfo* segInfo_list = NULL;
 
 
+/*------------------------------------------------------------*/
+/*--- Finding the SegInfo for an address                   ---*/
+/*------------------------------------------------------------*/
+
+/* Looking an address up by walking segInfo_list costs more the more
+   objects are loaded, and the unwinder and error printer do it for
+   every frame.  So keep
+
+   - segInfo_index: the SegInfos sorted by text_start_avma, for a
+     binary search.  Like segInfo_list, this assumes the text ranges
+     are disjoint.  It is rebuilt on the next lookup after the list
+     changes.
+
+   - pc_cache: a direct-mapped cache of the symtab and loctab entries
+     found for recent addresses, including finding none.  Emptied
+     whenever the list changes.
+*/
+static SegInfo** segInfo_index      = NULL;
+static Int       segInfo_index_used = 0;
+static Int       segInfo_index_size = 0;
+static Bool      segInfo_index_ok   = False;
+
+#define N_PC_CACHE 1021    /* prime */
+
+#define PC_HAVE_SYM      1   /* sym_si/symno are valid */
+#define PC_HAVE_SYM_ANY  2   /* symany_si/symany_no are valid */
+#define PC_HAVE_LOC      4   /* loc_si/locno are valid */
+
+typedef
+   struct {
+      Addr     pc;
+      UInt     have;   /* PC_HAVE_ bits; 0 means an empty slot */
+      SegInfo* sym_si;
+      Int      symno;
+      SegInfo* symany_si;
+      Int      symany_no;
+      SegInfo* loc_si;
+      Int      locno;
+   }
+   PcCacheEnt;
+
+static PcCacheEnt pc_cache[N_PC_CACHE];
+
+/* Stats */
+static UInt n_pc_lookups    = 0;
+static UInt n_pc_cache_hits = 0;
+
+/* Call whenever a SegInfo is added to or removed from the list. */
+static void segInfo_list_changed ( void )
+{
+   Int i;
+   segInfo_index_ok = False;
+   for (i = 0; i < N_PC_CACHE; i++)
+      pc_cache[i].have = 0;
+}
+
+static Int compare_SegInfo_start ( void* va, void* vb )
+{
+   SegInfo* a = *(SegInfo**)va;
+   SegInfo* b = *(SegInfo**)vb;
+   if (a->text_start_avma < b->text_start_avma) return -1;
+   if (a->text_start_avma > b->text_start_avma) return  1;
+   return 0;
+}
+
+static void rebuild_segInfo_index ( void )
+{
+   SegInfo* si;
+   Int      n = 0;
+
+   for (si = segInfo_list; si != NULL; si = si->next)
+      n++;
+   if (n > segInfo_index_size) {
+      if (segInfo_index)
+         VG_(arena_free)(VG_AR_SYMTAB, segInfo_index);
+      segInfo_index_size = 2 * n;
+      segInfo_index = VG_(arena_malloc)(VG_AR_SYMTAB,
+                         segInfo_index_size * sizeof(SegInfo*));
+   }
+   n = 0;
+   for (si = segInfo_list; si != NULL; si = si->next)
+      segInfo_index[n++] = si;
+   segInfo_index_used = n;
+   VG_(ssort)(segInfo_index, n, sizeof(SegInfo*), compare_SegInfo_start);
+   segInfo_index_ok = True;
+}
+
+/* The SegInfo whose text contains a, or NULL. */
+static SegInfo* find_SegInfo_for_text ( Addr a )
+{
+   Int lo, hi, mid;
+
+   if (!segInfo_index_ok)
+      rebuild_segInfo_index();
+
+   /* Find the last SegInfo starting at or below a. */
+   lo = 0;
+   hi = segInfo_index_used - 1;
+   while (lo <= hi) {
+      mid = (lo + hi) / 2;
+      if (segInfo_index[mid]->text_start_avma <= a)
+         lo = mid + 1;
+      else
+         hi = mid - 1;
+   }
+   if (hi < 0)
+      return NULL;
+   if (a < segInfo_index[hi]->text_start_avma
+                                     + segInfo_index[hi]->text_size)
+      return segInfo_index[hi];
+   return NULL;
+}
+
+void VG_(print_debuginfo_stats) ( void )
+{
+   VG_(message)(Vg_DebugMsg,
+      "debuginfo: %,u address lookups, %,u cached",
+      n_pc_lookups, n_pc_cache_hits );
+}
+
+static PcCacheEnt* get_pc_cache_ent ( Addr a )
+{
+   PcCacheEnt* ent = &pc_cache[(UWord)a % N_PC_CACHE];
+   n_pc_lookups++;
+   if (ent->have != 0 && ent->pc == a) {
+      n_pc_cache_hits++;
+   } else {
+      ent->pc   = a;
+      ent->have = 0;
+   }
+   return ent;
+}
+
+
 /*------------------------------------------------------------*/
 /*--- Notification (acquire/discard) helpers               ---*/
 /*------------------------------------------------------------*/
@@ -152,9 +288,16 @@ static void free_SegInfo ( SegInfo* si )
    struct strchunk *chunk, *next;
    vg_assert(si != NULL);
    if (si->filename)   VG_(arena_free)(VG_AR_SYMTAB, si->filename);
-   if (si->symtab)     VG_(arena_free)(VG_AR_SYMTAB, si->symtab);
-   if (si->loctab)     VG_(arena_free)(VG_AR_SYMTAB, si->loctab);
-   if (si->cfsi)       VG_(arena_free)(VG_AR_SYMTAB, si->cfsi);
+#  if defined(VGO_linux)
+   if (si->cache_image) {
+      ML_(free_cached_debuginfo)(si);
+   } else
+#  endif
+   {
+      if (si->symtab)  VG_(arena_free)(VG_AR_SYMTAB, si->symtab);
+      if (si->loctab)  VG_(arena_free)(VG_AR_SYMTAB, si->loctab);
+      if (si->cfsi)    VG_(arena_free)(VG_AR_SYMTAB, si->cfsi);
+   }
    if (si->cfsi_exprs) VG_(deleteXA)(si->cfsi_exprs);
 
    for (chunk = si->strchunks; chunk != NULL; chunk = next) {
@@ -195,6 +338,8 @@ static void discard_SegInfo ( SegInfo* si )
          vg_assert(*prev_next_ptr == curr);
          *prev_next_ptr = curr->next;
          VG_(redir_notify_delete_SegInfo)( curr );
+         segInfo_list_changed();
+         VG_(discard_supp_caches)();
          free_SegInfo(curr);
          return;
       }
@@ -256,7 +401,8 @@ SegInfo* acquire_syms_for_range(
    SegInfo* si = alloc_SegInfo(seg_addr, seg_len, seg_offset, 
                                seg_filename, seg_memname);
 #  if defined(VGO_linux)
-   ok = ML_(read_elf_debug_info) ( si );
+   Bool     cached = ML_(load_cached_debuginfo) ( si );
+   ok = cached || ML_(read_elf_debug_info) ( si );
 #  elif defined(VGO_aix5)
    ok = ML_(read_xcoff_debug_info) ( si, data_addr, data_len, is_mainexe );
 #  else
@@ -272,8 +418,17 @@ SegInfo* acquire_syms_for_range(
       // Prepend si to segInfo_list
       si->next = segInfo_list;
       segInfo_list = si;
+      segInfo_list_changed();
 
+#     if defined(VGO_linux)
+      if (!cached) {
+         ML_(canonicaliseTables) ( si );
+         if (VG_(clo_debuginfo_cache) && !si->lines_and_cfi_pending)
+            ML_(save_cached_debuginfo) ( si );
+      }
+#     else
       ML_(canonicaliseTables) ( si );
+#     endif
 
       /* notify m_redir about it */
       VG_(redir_notify_new_SegInfo)( si );
@@ -489,21 +644,49 @@ static void search_all_symtabs ( Addr ptr, /*OUT*/SegInfo** psi,
                                            /*OUT*/Int* symno,
                                  Bool match_anywhere_in_fun )
 {
-   Int      sno;
-   SegInfo* si;
+   Int         sno = -1;
+   SegInfo*    si;
+   PcCacheEnt* ent = get_pc_cache_ent(ptr);
+   UInt        bit = match_anywhere_in_fun ? PC_HAVE_SYM_ANY : PC_HAVE_SYM;
+
+   if (ent->have & bit) {
+      *psi   = match_anywhere_in_fun ? ent->symany_si : ent->sym_si;
+      *symno = match_anywhere_in_fun ? ent->symany_no : ent->symno;
+      return;
+   }
 
-   for (si = segInfo_list; si != NULL; si = si->next) {
-      if (si->text_start_avma <= ptr 
-          && ptr < si->text_start_avma + si->text_size) {
-         sno = ML_(search_one_symtab) ( si, ptr, match_anywhere_in_fun );
-         if (sno == -1) goto not_found;
-         *symno = sno;
-         *psi = si;
-         return;
-      }
+   si = find_SegInfo_for_text(ptr);
+   if (si != NULL) {
+      sno = ML_(search_one_symtab) ( si, ptr, match_anywhere_in_fun );
+      if (sno == -1)
+         si = NULL;
    }
-  not_found:
-   *psi = NULL;
+   if (match_anywhere_in_fun) {
+      ent->symany_si = si;
+      ent->symany_no = sno;
+   } else {
+      ent->sym_si = si;
+      ent->symno  = sno;
+   }
+   ent->have |= bit;
+
+   *psi   = si;
+   *symno = sno;
+}
+
+
+/* With --lazy-debuginfo=yes, read si's line numbers and CFI if that
+   hasn't been done yet. */
+static void ensure_lines_and_cfi ( SegInfo* si )
+{
+   if (!si->lines_and_cfi_pending)
+      return;
+#  if defined(VGO_linux)
+   ML_(read_elf_lines_and_cfi) ( si );
+   ML_(canonicaliseLoctabAndCFI) ( si );
+#  else
+   vg_assert(0);
+#  endif
 }
 
 
@@ -514,21 +697,29 @@ static void search_all_symtabs ( Addr ptr, /*OUT*/SegInfo** psi,
 static void search_all_loctabs ( Addr ptr, /*OUT*/SegInfo** psi,
                                            /*OUT*/Int* locno )
 {
-   Int      lno;
-   SegInfo* si;
+   Int         lno = -1;
+   SegInfo*    si;
+   PcCacheEnt* ent = get_pc_cache_ent(ptr);
 
-   for (si = segInfo_list; si != NULL; si = si->next) {
-      if (si->text_start_avma <= ptr 
-          && ptr < si->text_start_avma + si->text_size) {
-         lno = ML_(search_one_loctab) ( si, ptr );
-         if (lno == -1) goto not_found;
-         *locno = lno;
-         *psi = si;
-         return;
-      }
+   if (ent->have & PC_HAVE_LOC) {
+      *psi   = ent->loc_si;
+      *locno = ent->locno;
+      return;
    }
-  not_found:
-   *psi = NULL;
+
+   si = find_SegInfo_for_text(ptr);
+   if (si != NULL) {
+      ensure_lines_and_cfi ( si );
+      lno = ML_(search_one_loctab) ( si, ptr );
+      if (lno == -1)
+         si = NULL;
+   }
+   ent->loc_si = si;
+   ent->locno  = lno;
+   ent->have  |= PC_HAVE_LOC;
+
+   *psi   = si;
+   *locno = lno;
 }
 
 
@@ -661,41 +852,30 @@ Bool VG_(get_objname) ( Addr a, Char* buf, Int nbuf )
    SegInfo* si;
 
    vg_assert(nbuf > 0);
-   for (si = segInfo_list; si != NULL; si = si->next) {
-      if (si->text_start_avma <= a 
-          && a < si->text_start_avma + si->text_size) {
-         VG_(strncpy_safely)(buf, si->filename, nbuf);
-         if (si->memname) {
-            used = VG_(strlen)(buf);
-            if (used < nbuf) 
-               VG_(strncpy_safely)(&buf[used], "(", nbuf-used);
-            used = VG_(strlen)(buf);
-            if (used < nbuf) 
-               VG_(strncpy_safely)(&buf[used], si->memname, nbuf-used);
-            used = VG_(strlen)(buf);
-            if (used < nbuf) 
-               VG_(strncpy_safely)(&buf[used], ")", nbuf-used);
-         }
-         buf[nbuf-1] = 0;
-         return True;
-      }
+   si = find_SegInfo_for_text(a);
+   if (si == NULL)
+      return False;
+   VG_(strncpy_safely)(buf, si->filename, nbuf);
+   if (si->memname) {
+      used = VG_(strlen)(buf);
+      if (used < nbuf) 
+         VG_(strncpy_safely)(&buf[used], "(", nbuf-used);
+      used = VG_(strlen)(buf);
+      if (used < nbuf) 
+         VG_(strncpy_safely)(&buf[used], si->memname, nbuf-used);
+      used = VG_(strlen)(buf);
+      if (used < nbuf) 
+         VG_(strncpy_safely)(&buf[used], ")", nbuf-used);
    }
-   return False;
+   buf[nbuf-1] = 0;
+   return True;
 }
 
 /* Map a code address to its SegInfo.  Returns NULL if not found.  Doesn't
    require debug info. */
 SegInfo* VG_(find_seginfo) ( Addr a )
 {
-   SegInfo* si;
-
-   for (si = segInfo_list; si != NULL; si = si->next) {
-      if (si->text_start_avma <= a 
-          && a < si->text_start_avma + si->text_size) {
-         return si;
-      }
-   }
-   return NULL;
+   return find_SegInfo_for_text(a);
 }
 
 /* Map a code address to a filename.  Returns True if successful.  */
@@ -1048,12 +1228,38 @@ UWord evalCfiExpr ( XArray* exprs, Int ix,
 }
 
 
+/* The CFI record in si covering ip, or NULL. */
+static DiCfSI* search_SegInfo_cfi ( SegInfo* si, Addr ip )
+{
+   Int i;
+
+   /* Until its CFI has been read, all we know is which object the
+      address is in. */
+   if (si->lines_and_cfi_pending) {
+      if (ip < si->text_start_avma
+          || ip >= si->text_start_avma + si->text_size)
+         return NULL;
+      ensure_lines_and_cfi ( si );
+   }
+
+   /* Use the per-SegInfo summary address ranges to skip
+      inapplicable SegInfos quickly. */
+   if (si->cfsi_used == 0)
+      return NULL;
+   if (ip < si->cfsi_minaddr || ip > si->cfsi_maxaddr)
+      return NULL;
+
+   i = ML_(search_one_cfitab)( si, ip );
+   if (i == -1)
+      return NULL;
+   vg_assert(i >= 0 && i < si->cfsi_used);
+   return &si->cfsi[i];
+}
+
 /* The main function for DWARF2/3 CFI-based stack unwinding.
    Given an IP/SP/FP triple, produce the IP/SP/FP values for the
    previous frame, if possible. */
 /* Returns True if OK.  If not OK, *{ip,sp,fp}P are not changed. */
-/* NOTE: this function may rearrange the order of entries in the
-   SegInfo list. */
 Bool VG_(use_CF_info) ( /*MOD*/Addr* ipP,
                         /*MOD*/Addr* spP,
                         /*MOD*/Addr* fpP,
@@ -1061,7 +1267,6 @@ Bool VG_(use_CF_info) ( /*MOD*/Addr* ipP,
                         Addr max_accessible )
 {
    Bool     ok;
-   Int      i;
    SegInfo* si;
    DiCfSI*  cfsi = NULL;
    Addr     cfa, ipHere, spHere, fpHere, ipPrev, spPrev, fpPrev;
@@ -1074,21 +1279,18 @@ Bool VG_(use_CF_info) ( /*MOD*/Addr* ipP,
 
    if (0) VG_(printf)("search for %p\n", *ipP);
 
-   for (si = segInfo_list; si != NULL; si = si->next) {
+   /* Normally the CFI is in the object whose text contains the
+      address.  Otherwise try them all, as this used to. */
+   si = find_SegInfo_for_text(*ipP);
+   if (si != NULL) {
       n_steps++;
-
-      /* Use the per-SegInfo summary address ranges to skip
-	 inapplicable SegInfos quickly. */
-      if (si->cfsi_used == 0)
-         continue;
-      if (*ipP < si->cfsi_minaddr || *ipP > si->cfsi_maxaddr)
-         continue;
-
-      i = ML_(search_one_cfitab)( si, *ipP );
-      if (i != -1) {
-         vg_assert(i >= 0 && i < si->cfsi_used);
-         cfsi = &si->cfsi[i];
-         break;
+      cfsi = search_SegInfo_cfi(si, *ipP);
+   } else {
+      for (si = segInfo_list; si != NULL; si = si->next) {
+         n_steps++;
+         cfsi = search_SegInfo_cfi(si, *ipP);
+         if (cfsi != NULL)
+            break;
       }
    }
 
@@ -1098,37 +1300,6 @@ Bool VG_(use_CF_info) ( /*MOD*/Addr* ipP,
    if (0 && ((n_search & 0xFFFFF) == 0))
       VG_(printf)("%u %u\n", n_search, n_steps);
 
-   /* Start of performance-enhancing hack: once every 16 (chosen
-      hackily after profiling) successful searches, move the found
-      SegInfo one step closer to the start of the list.  This makes
-      future searches cheaper.  For starting konqueror on amd64, this
-      in fact reduces the total amount of searching done by the above
-      find-the-right-SegInfo loop by more than a factor of 20. */
-   if ((n_search & 0xF) == 0) {
-      /* Move si one step closer to the start of the list. */
-      SegInfo* si0 = segInfo_list;
-      SegInfo* si1 = NULL;
-      SegInfo* si2 = NULL;
-      SegInfo* tmp;
-      while (True) {
-         if (si0 == NULL) break;
-         if (si0 == si) break;
-         si2 = si1;
-         si1 = si0;
-         si0 = si0->next;
-      }
-      if (si0 == si && si0 != NULL && si1 != NULL && si2 != NULL) {
-         /* si0 points to si, si1 to its predecessor, and si2 to si1's
-            predecessor.  Swap si0 and si1, that is, move si0 one step
-            closer to the start of the list. */
-         tmp = si0->next;
-         si2->next = si0;
-         si0->next = si1;
-         si1->next = tmp;
-      }
-   }
-   /* End of performance-enhancing hack. */
-
    if (0) {
       VG_(printf)("found cfisi: "); 
       ML_(ppDiCfSI)(si->cfsi_exprs, cfsi);
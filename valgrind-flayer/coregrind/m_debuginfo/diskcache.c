@@ -0,0 +1,578 @@
+
+/*--------------------------------------------------------------------*/
+/*--- On-disk cache of canonicalised SegInfo tables.               ---*/
+/*---                                                  diskcache.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   Copyright (C) 2000-2007 Julian Seward
+      jseward@acm.org
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+/* A fuzzer that starts the client thousands of times has the same
+   system libraries read, sorted and merged every time.  With
+   --debuginfo-cache=<dir>, once an object's tables have been
+   canonicalised they are written to <dir> as one image, and later
+   runs map that image instead of reading the object.
+
+   The image is a header, then the symtab, loctab, cfsi and CfiExpr
+   arrays exactly as they are in memory, then the strings they point
+   to.  In the image, each string pointer holds 1 + its offset into the
+   strings, or 0 for NULL; loading turns these back into pointers, and
+   moves every address by however far the object has moved since the
+   image was written.  The image stays mapped (privately, so the
+   fixups are not written back) for as long as the SegInfo lives.
+
+   The file is named after a hash of the object's path, and is used
+   only if the object's size, mtime and inode are what they were when
+   it was written, and every string offset and expression index in it
+   is in range; otherwise the object is read instead, and the next
+   save replaces the file.  It is written
+   under a temporary name and renamed into place, so that concurrent
+   runs never see half of one.
+*/
+
+#include "pub_core_basics.h"
+#include "pub_core_vki.h"
+#include "pub_core_libcbase.h"
+#include "pub_core_libcassert.h"
+#include "pub_core_libcfile.h"
+#include "pub_core_libcprint.h"
+#include "pub_core_libcproc.h"     /* VG_(getpid) */
+#include "pub_core_aspacemgr.h"    /* for mmaping cache files */
+#include "pub_core_mallocfree.h"
+#include "pub_core_options.h"
+#include "pub_core_tooliface.h"    /* VG_(needs) */
+#include "pub_core_xarray.h"
+#include "priv_storage.h"
+#include "priv_diskcache.h"        /* self */
+
+#define DICACHE_MAGIC "VGDICA01"
+
+typedef
+   struct {
+      UChar  magic[8];
+      /* What the image was made from. */
+      ULong  obj_size;
+      ULong  obj_mtime;
+      ULong  obj_ino;
+      UInt   data_syms;      /* VG_(needs).data_syms */
+      UInt   sizeof_sym;     /* catch a change of layout */
+      UInt   sizeof_loc;
+      UInt   sizeof_cfsi;
+      UInt   sizeof_expr;
+      UInt   path_off;       /* strings offset of the object's path */
+      UInt   soname_off;     /* likewise, soname */
+      /* The SegInfo, as it was when written. */
+      Addr   text_start_avma;
+      UInt   text_size;
+      OffT   text_bias;
+      Addr   plt_start_avma;
+      UInt   plt_size;
+      Addr   got_start_avma;
+      UInt   got_size;
+      Addr   opd_start_avma;
+      UInt   opd_size;
+      Addr   data_start_avma;
+      UInt   data_size;
+      Addr   bss_start_avma;
+      UInt   bss_size;
+      Addr   cfsi_minaddr;
+      Addr   cfsi_maxaddr;
+      /* Where the tables are in the image. */
+      UInt   n_syms,  syms_off;
+      UInt   n_locs,  locs_off;
+      UInt   n_cfsi,  cfsi_off;
+      UInt   n_exprs, exprs_off;
+      UInt   strs_szB, strs_off;
+   }
+   DiCacheHdr;
+
+
+static void* symtab_alloc ( SizeT szB ) {
+   return VG_(arena_malloc)( VG_AR_SYMTAB, szB );
+}
+static void symtab_free ( void* v ) {
+   VG_(arena_free)( VG_AR_SYMTAB, v );
+}
+
+/* The cache file for si, with 'suffix' appended; in VG_AR_SYMTAB. */
+static HChar* cache_file_name ( struct _SegInfo* si, HChar* suffix )
+{
+   ULong  h = 0xcbf29ce484222325ULL;   /* FNV-1a */
+   UChar* p;
+   HChar* name;
+
+   for (p = si->filename; *p; p++) {
+      h ^= *p;
+      h *= 0x100000001b3ULL;
+   }
+   name = VG_(arena_malloc)( VG_AR_SYMTAB,
+                             VG_(strlen)(VG_(clo_debuginfo_cache))
+                             + VG_(strlen)(suffix) + 32 );
+   VG_(sprintf)(name, "%s/%016llx.di%s", VG_(clo_debuginfo_cache),
+                h, suffix);
+   return name;
+}
+
+static Bool stat_object ( struct _SegInfo* si, /*OUT*/struct vki_stat* st )
+{
+   SysRes res = VG_(stat)( si->filename, st );
+   return !res.isError;
+}
+
+/* Tracing and dumping want to watch the object being read. */
+static Bool cacheable ( struct _SegInfo* si )
+{
+   return VG_(clo_debuginfo_cache) != NULL
+          && !si->trace_symtab && !si->trace_cfi
+          && !si->ddump_syms && !si->ddump_line && !si->ddump_frames;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Loading                                              ---*/
+/*------------------------------------------------------------*/
+
+/* Is [off, off+n*szB) inside an image of n_img bytes? */
+static Bool in_image ( UInt off, UInt n, UInt szB, SizeT n_img )
+{
+   return off <= n_img && (ULong)n * szB <= n_img - off;
+}
+
+static Bool header_ok ( DiCacheHdr* h, SizeT n_img,
+                        struct _SegInfo* si, struct vki_stat* st )
+{
+   UChar* strs;
+   UInt   path_len;
+
+   if (VG_(memcmp)(h->magic, DICACHE_MAGIC, 8) != 0
+       || h->obj_size  != (ULong)st->st_size
+       || h->obj_mtime != (ULong)st->st_mtime
+       || h->obj_ino   != (ULong)st->st_ino
+       || h->data_syms != (UInt)VG_(needs).data_syms
+       || h->sizeof_sym  != sizeof(DiSym)
+       || h->sizeof_loc  != sizeof(DiLoc)
+       || h->sizeof_cfsi != sizeof(DiCfSI)
+       || h->sizeof_expr != sizeof(CfiExpr))
+      return False;
+
+   if (!in_image(h->syms_off,  h->n_syms,   sizeof(DiSym),   n_img)
+       || !in_image(h->locs_off,  h->n_locs,   sizeof(DiLoc),   n_img)
+       || !in_image(h->cfsi_off,  h->n_cfsi,   sizeof(DiCfSI),  n_img)
+       || !in_image(h->exprs_off, h->n_exprs,  sizeof(CfiExpr), n_img)
+       || !in_image(h->strs_off,  h->strs_szB, 1,               n_img)
+       || h->strs_szB == 0
+       || ((UChar*)h)[h->strs_off + h->strs_szB - 1] != '\0')
+      return False;
+
+   /* Guard against a hash collision. */
+   strs = (UChar*)h + h->strs_off;
+   path_len = VG_(strlen)(si->filename);
+   return h->path_off + path_len < h->strs_szB
+          && 0 == VG_(memcmp)(strs + h->path_off, si->filename, path_len + 1)
+          && h->soname_off < h->strs_szB;
+}
+
+/* Is an offset stored in place of a string pointer inside the
+   strings?  As they end in a NUL, so does every string in them. */
+static Bool str_off_ok ( DiCacheHdr* h, UChar* off )
+{
+   UWord o = (UWord)off;
+   return o == 0 || o - 1 < h->strs_szB;
+}
+
+static Bool expr_ix_ok ( Int ix, UInt n )
+{
+   return ix >= 0 && ix < (Int)n;
+}
+
+/* A stale or damaged image must not take Valgrind down when its
+   tables are used, so check everything which indexes something
+   else: string offsets, and CFI expression indices.  Expressions are
+   built operands first, so an operand's index is always below its
+   user's, which also rules out cycles. */
+static Bool tables_ok ( DiCacheHdr* h )
+{
+   Addr     img   = (Addr)h;
+   DiSym*   syms  = (DiSym*)(img + h->syms_off);
+   DiLoc*   locs  = (DiLoc*)(img + h->locs_off);
+   DiCfSI*  cfsi  = (DiCfSI*)(img + h->cfsi_off);
+   CfiExpr* exprs = (CfiExpr*)(img + h->exprs_off);
+   UInt     i;
+
+   for (i = 0; i < h->n_syms; i++)
+      if (!str_off_ok(h, syms[i].name))
+         return False;
+   for (i = 0; i < h->n_locs; i++)
+      if (!str_off_ok(h, locs[i].filename)
+          || !str_off_ok(h, locs[i].dirname))
+         return False;
+
+   for (i = 0; i < h->n_cfsi; i++) {
+      if ((cfsi[i].cfa_how == CFIC_EXPR
+           && !expr_ix_ok(cfsi[i].cfa_off, h->n_exprs))
+          || (cfsi[i].ra_how == CFIR_EXPR
+              && !expr_ix_ok(cfsi[i].ra_off, h->n_exprs))
+          || (cfsi[i].sp_how == CFIR_EXPR
+              && !expr_ix_ok(cfsi[i].sp_off, h->n_exprs))
+          || (cfsi[i].fp_how == CFIR_EXPR
+              && !expr_ix_ok(cfsi[i].fp_off, h->n_exprs)))
+         return False;
+   }
+
+   for (i = 0; i < h->n_exprs; i++) {
+      switch (exprs[i].tag) {
+         case Cex_Undef:
+         case Cex_Const:
+         case Cex_DwReg:
+            break;
+         case Cex_Deref:
+            if (!expr_ix_ok(exprs[i].Cex.Deref.ixAddr, i))
+               return False;
+            break;
+         case Cex_Binop:
+            if (exprs[i].Cex.Binop.op < Cop_Add
+                || exprs[i].Cex.Binop.op > Cop_Mul
+                || !expr_ix_ok(exprs[i].Cex.Binop.ixL, i)
+                || !expr_ix_ok(exprs[i].Cex.Binop.ixR, i))
+               return False;
+            break;
+         case Cex_CfiReg:
+            if (exprs[i].Cex.CfiReg.reg < Creg_SP
+                || exprs[i].Cex.CfiReg.reg > Creg_IP)
+               return False;
+            break;
+         default:
+            return False;
+      }
+   }
+   return True;
+}
+
+/* Turn an offset stored in place of a string pointer back into the
+   pointer.  tables_ok() has checked it. */
+static UChar* str_ptr ( DiCacheHdr* h, UChar* off )
+{
+   UWord o = (UWord)off;
+   if (o == 0)
+      return NULL;
+   return (UChar*)h + h->strs_off + o - 1;
+}
+
+Bool ML_(load_cached_debuginfo) ( struct _SegInfo* si )
+{
+   struct vki_stat st;
+   DiCacheHdr* h;
+   HChar*      name;
+   SysRes      fd, sres;
+   Int         n_img;
+   Addr        img;
+   OffT        delta;
+   UInt        i;
+
+   if (!cacheable(si) || !stat_object(si, &st))
+      return False;
+
+   name = cache_file_name(si, "");
+   fd = VG_(open)(name, VKI_O_RDONLY, 0);
+   VG_(arena_free)(VG_AR_SYMTAB, name);
+   if (fd.isError)
+      return False;
+
+   n_img = VG_(fsize)(fd.res);
+   if (n_img < (Int)sizeof(DiCacheHdr)) {
+      VG_(close)(fd.res);
+      return False;
+   }
+   sres = VG_(am_mmap_file_float_valgrind)
+             ( n_img, VKI_PROT_READ|VKI_PROT_WRITE, fd.res, 0 );
+   VG_(close)(fd.res);
+   if (sres.isError)
+      return False;
+   img = sres.res;
+   h = (DiCacheHdr*)img;
+
+   if (!header_ok(h, n_img, si, &st) || !tables_ok(h)) {
+      SysRes m_res = VG_(am_munmap_valgrind) ( img, n_img );
+      vg_assert(!m_res.isError);
+      return False;
+   }
+
+   if (VG_(clo_verbosity) > 1 || VG_(clo_trace_redir))
+      VG_(message)(Vg_DebugMsg, "Reading syms from %s (%p) (cached)",
+                                si->filename, si->text_start_avma );
+
+   /* Everything moves with the text. */
+   delta = si->text_start_avma - h->text_start_avma;
+
+   si->symtab      = (DiSym*)(img + h->syms_off);
+   si->symtab_used = si->symtab_size = h->n_syms;
+   for (i = 0; i < h->n_syms; i++) {
+      si->symtab[i].addr += delta;
+      if (si->symtab[i].tocptr != 0)
+         si->symtab[i].tocptr += delta;
+      si->symtab[i].name = str_ptr(h, si->symtab[i].name);
+   }
+
+   si->loctab      = (DiLoc*)(img + h->locs_off);
+   si->loctab_used = si->loctab_size = h->n_locs;
+   for (i = 0; i < h->n_locs; i++) {
+      si->loctab[i].addr    += delta;
+      si->loctab[i].filename = str_ptr(h, si->loctab[i].filename);
+      si->loctab[i].dirname  = str_ptr(h, si->loctab[i].dirname);
+   }
+
+   si->cfsi      = (DiCfSI*)(img + h->cfsi_off);
+   si->cfsi_used = si->cfsi_size = h->n_cfsi;
+   for (i = 0; i < h->n_cfsi; i++)
+      si->cfsi[i].base += delta;
+   si->cfsi_minaddr = h->cfsi_minaddr + delta;
+   si->cfsi_maxaddr = h->cfsi_maxaddr + delta;
+
+   if (h->n_exprs > 0) {
+      CfiExpr* exprs = (CfiExpr*)(img + h->exprs_off);
+      si->cfsi_exprs = VG_(newXA)( symtab_alloc, symtab_free,
+                                   sizeof(CfiExpr) );
+      for (i = 0; i < h->n_exprs; i++)
+         VG_(addToXA)( si->cfsi_exprs, &exprs[i] );
+   }
+
+   si->soname          = (UChar*)img + h->strs_off + h->soname_off;
+   si->text_size       = h->text_size;
+   si->text_bias       = h->text_bias + delta;
+#  define MOVE(sec) \
+      si->sec##_start_avma = h->sec##_start_avma == 0 \
+                                ? 0 : h->sec##_start_avma + delta; \
+      si->sec##_size       = h->sec##_size;
+   MOVE(plt)
+   MOVE(got)
+   MOVE(opd)
+   MOVE(data)
+   MOVE(bss)
+#  undef MOVE
+
+   si->lines_and_cfi_pending = False;
+   si->cache_image     = img;
+   si->cache_image_szB = n_img;
+   return True;
+}
+
+void ML_(free_cached_debuginfo) ( struct _SegInfo* si )
+{
+   SysRes m_res;
+   vg_assert(si->cache_image != 0);
+   m_res = VG_(am_munmap_valgrind) ( si->cache_image, si->cache_image_szB );
+   vg_assert(!m_res.isError);
+   si->cache_image = 0;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Saving                                               ---*/
+/*------------------------------------------------------------*/
+
+/* The strings written to the image are si's string chunks, one after
+   another, then the soname and the path. */
+typedef
+   struct {
+      struct strchunk* chunk;
+      UInt             off;
+   }
+   ChunkOff;
+
+/* 1 + the image offset of string p, or 0 for NULL.  False if p is not
+   in any chunk. */
+static Bool str_off ( ChunkOff* chunks, Int n_chunks, UChar* p,
+                      /*OUT*/UChar** off )
+{
+   Int i;
+   if (p == NULL) {
+      *off = NULL;
+      return True;
+   }
+   for (i = 0; i < n_chunks; i++) {
+      UChar* base = chunks[i].chunk->strtab;
+      if (p >= base && p < base + chunks[i].chunk->strtab_used) {
+         *off = (UChar*)(UWord)(1 + chunks[i].off + (p - base));
+         return True;
+      }
+   }
+   return False;
+}
+
+static Bool write_all ( Int fd, UChar* buf, SizeT szB )
+{
+   while (szB > 0) {
+      Int n = VG_(write)(fd, buf, szB > 1048576 ? 1048576 : szB);
+      if (n <= 0)
+         return False;
+      buf += n;
+      szB -= n;
+   }
+   return True;
+}
+
+void ML_(save_cached_debuginfo) ( struct _SegInfo* si )
+{
+   struct vki_stat  st;
+   struct strchunk* chunk;
+   ChunkOff*   chunks = NULL;
+   DiCacheHdr* h;
+   UChar*      img = NULL;
+   UChar*      strs;
+   HChar*      name = NULL;
+   HChar*      tmp  = NULL;
+   HChar       suffix[32];
+   SysRes      fd;
+   Int         n_chunks = 0;
+   UInt        i, n_exprs, strs_szB, soname_len, path_len, img_szB;
+   UInt        syms_off, locs_off, cfsi_off, exprs_off, strs_off;
+   Bool        ok;
+
+   vg_assert(!si->lines_and_cfi_pending);
+   if (!cacheable(si) || si->cache_image != 0 || !stat_object(si, &st))
+      return;
+
+   for (chunk = si->strchunks; chunk != NULL; chunk = chunk->next)
+      n_chunks++;
+   if (n_chunks > 0)
+      chunks = VG_(arena_malloc)(VG_AR_SYMTAB, n_chunks * sizeof(ChunkOff));
+   strs_szB = 0;
+   for (i = 0, chunk = si->strchunks; chunk != NULL; chunk = chunk->next) {
+      chunks[i].chunk = chunk;
+      chunks[i].off   = strs_szB;
+      strs_szB += chunk->strtab_used;
+      i++;
+   }
+   soname_len = VG_(strlen)(si->soname) + 1;
+   path_len   = VG_(strlen)(si->filename) + 1;
+   n_exprs    = si->cfsi_exprs ? VG_(sizeXA)(si->cfsi_exprs) : 0;
+
+   /* Lay out the image, keeping each table 8-aligned. */
+   img_szB = VG_ROUNDUP(sizeof(DiCacheHdr), 8);
+#  define PLACE(off, n, szB) \
+      off = img_szB; img_szB = VG_ROUNDUP(img_szB + (n) * (szB), 8);
+   PLACE(syms_off,  si->symtab_used, sizeof(DiSym))
+   PLACE(locs_off,  si->loctab_used, sizeof(DiLoc))
+   PLACE(cfsi_off,  si->cfsi_used,   sizeof(DiCfSI))
+   PLACE(exprs_off, n_exprs,         sizeof(CfiExpr))
+   PLACE(strs_off,  strs_szB + soname_len + path_len, 1)
+#  undef PLACE
+
+   img = VG_(arena_malloc)(VG_AR_SYMTAB, img_szB);
+   VG_(memset)(img, 0, img_szB);
+   h = (DiCacheHdr*)img;
+   VG_(memcpy)(h->magic, DICACHE_MAGIC, 8);
+   h->syms_off        = syms_off;
+   h->locs_off        = locs_off;
+   h->cfsi_off        = cfsi_off;
+   h->exprs_off       = exprs_off;
+   h->strs_off        = strs_off;
+   h->obj_size        = st.st_size;
+   h->obj_mtime       = st.st_mtime;
+   h->obj_ino         = st.st_ino;
+   h->data_syms       = VG_(needs).data_syms;
+   h->sizeof_sym      = sizeof(DiSym);
+   h->sizeof_loc      = sizeof(DiLoc);
+   h->sizeof_cfsi     = sizeof(DiCfSI);
+   h->sizeof_expr     = sizeof(CfiExpr);
+   h->text_start_avma = si->text_start_avma;
+   h->text_size       = si->text_size;
+   h->text_bias       = si->text_bias;
+   h->plt_start_avma  = si->plt_start_avma;
+   h->plt_size        = si->plt_size;
+   h->got_start_avma  = si->got_start_avma;
+   h->got_size        = si->got_size;
+   h->opd_start_avma  = si->opd_start_avma;
+   h->opd_size        = si->opd_size;
+   h->data_start_avma = si->data_start_avma;
+   h->data_size       = si->data_size;
+   h->bss_start_avma  = si->bss_start_avma;
+   h->bss_size        = si->bss_size;
+   h->cfsi_minaddr    = si->cfsi_minaddr;
+   h->cfsi_maxaddr    = si->cfsi_maxaddr;
+   h->n_syms          = si->symtab_used;
+   h->n_locs          = si->loctab_used;
+   h->n_cfsi          = si->cfsi_used;
+   h->n_exprs         = n_exprs;
+   h->strs_szB        = strs_szB + soname_len + path_len;
+
+   ok = True;
+   for (i = 0; ok && i < si->symtab_used; i++) {
+      DiSym* sym = &((DiSym*)(img + h->syms_off))[i];
+      *sym = si->symtab[i];
+      ok = str_off(chunks, n_chunks, si->symtab[i].name, &sym->name);
+   }
+   for (i = 0; ok && i < si->loctab_used; i++) {
+      DiLoc* loc = &((DiLoc*)(img + h->locs_off))[i];
+      *loc = si->loctab[i];
+      ok = str_off(chunks, n_chunks, si->loctab[i].filename, &loc->filename)
+           && str_off(chunks, n_chunks, si->loctab[i].dirname, &loc->dirname);
+   }
+   if (!ok) {
+      /* A string that didn't come from ML_(addStr); don't guess. */
+      if (VG_(clo_verbosity) > 1)
+         VG_(message)(Vg_DebugMsg, "Not caching syms from %s", si->filename);
+      goto out;
+   }
+   if (si->cfsi_used > 0)
+      VG_(memcpy)(img + h->cfsi_off, si->cfsi, si->cfsi_used * sizeof(DiCfSI));
+   for (i = 0; i < n_exprs; i++)
+      ((CfiExpr*)(img + h->exprs_off))[i]
+         = *(CfiExpr*)VG_(indexXA)(si->cfsi_exprs, i);
+
+   strs = img + h->strs_off;
+   for (i = 0; i < (UInt)n_chunks; i++)
+      VG_(memcpy)(strs + chunks[i].off, chunks[i].chunk->strtab,
+                  chunks[i].chunk->strtab_used);
+   h->soname_off = strs_szB;
+   VG_(memcpy)(strs + h->soname_off, si->soname, soname_len);
+   h->path_off = strs_szB + soname_len;
+   VG_(memcpy)(strs + h->path_off, si->filename, path_len);
+
+   VG_(sprintf)(suffix, ".%d.tmp", VG_(getpid)());
+   name = cache_file_name(si, "");
+   tmp  = cache_file_name(si, suffix);
+   fd = VG_(open)(tmp, VKI_O_CREAT|VKI_O_WRONLY|VKI_O_TRUNC,
+                       VKI_S_IRUSR|VKI_S_IWUSR);
+   if (fd.isError) {
+      if (VG_(clo_verbosity) > 1)
+         VG_(message)(Vg_DebugMsg, "Can't create %s", tmp);
+      goto out;
+   }
+   ok = write_all(fd.res, img, img_szB);
+   VG_(close)(fd.res);
+   if (!ok || VG_(rename)(tmp, name) != 0)
+      VG_(unlink)(tmp);
+
+  out:
+   if (chunks) VG_(arena_free)(VG_AR_SYMTAB, chunks);
+   if (name)   VG_(arena_free)(VG_AR_SYMTAB, name);
+   if (tmp)    VG_(arena_free)(VG_AR_SYMTAB, tmp);
+   VG_(arena_free)(VG_AR_SYMTAB, img);
+}
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
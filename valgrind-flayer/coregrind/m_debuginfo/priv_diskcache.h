@@ -0,0 +1,52 @@
+
+/*--------------------------------------------------------------------*/
+/*--- On-disk cache of canonicalised SegInfo tables.               ---*/
+/*---                                             priv_diskcache.h ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   Copyright (C) 2000-2007 Julian Seward
+      jseward@acm.org
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#ifndef __PRIV_DISKCACHE_H
+#define __PRIV_DISKCACHE_H
+
+/* With --debuginfo-cache=<dir>, fill in si's tables from the image
+   cached for its file, if there is an up-to-date one.  Returns False
+   if there isn't, in which case si is unchanged. */
+extern Bool ML_(load_cached_debuginfo) ( struct _SegInfo* si );
+
+/* Write si's tables, which must be fully read and canonicalised, to
+   the cache, for the next run to load. */
+extern void ML_(save_cached_debuginfo) ( struct _SegInfo* si );
+
+/* Unmap the image that ML_(load_cached_debuginfo) filled si in
+   from. */
+extern void ML_(free_cached_debuginfo) ( struct _SegInfo* si );
+
+#endif /* ndef __PRIV_DISKCACHE_H */
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
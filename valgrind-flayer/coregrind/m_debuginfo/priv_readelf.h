@@ -50,6 +50,11 @@ extern Bool ML_(is_elf_object_file)( const void* buf );
 */
 extern Bool ML_(read_elf_debug_info) ( struct _SegInfo* si );
 
+/* With --lazy-debuginfo=yes, ML_(read_elf_debug_info) reads only the
+   symbols and leaves si->lines_and_cfi_pending set.  This reads the
+   rest, the first time it is needed. */
+extern void ML_(read_elf_lines_and_cfi) ( struct _SegInfo* si );
+
 
 #endif /* ndef __PRIV_READELF_H */
 
@@ -245,6 +245,16 @@ struct _SegInfo {
    Addr    cfsi_minaddr;
    Addr    cfsi_maxaddr;
    XArray* cfsi_exprs; /* XArray of CfSiExpr */
+   /* With --lazy-debuginfo=yes only the symbols are read when the
+      object is mapped; loctab and cfsi stay empty, and this stays
+      True, until a lookup first needs them. */
+   Bool    lines_and_cfi_pending;
+
+   /* If non-zero, symtab, loctab, cfsi and the strings they point to
+      are in this mapping of a --debuginfo-cache image, not in
+      VG_AR_SYMTAB. */
+   Addr    cache_image;
+   SizeT   cache_image_szB;
 
    /* Expandable arrays of characters -- the string table.  Pointers
       into this are stable (the arrays are not reallocated). */
@@ -311,6 +321,10 @@ extern UChar* ML_(addStr) ( struct _SegInfo* si, UChar* str, Int len );
    this after finishing adding entries to these tables. */
 extern void ML_(canonicaliseTables) ( struct _SegInfo* si );
 
+/* Likewise, for just the loctab and CFI tables, after they have been
+   read on demand. */
+extern void ML_(canonicaliseLoctabAndCFI) ( struct _SegInfo* si );
+
 /* ------ Searching ------ */
 
 /* Find a symbol-table index containing the specified pointer, or -1
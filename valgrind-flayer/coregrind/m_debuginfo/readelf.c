@@ -805,11 +805,15 @@ Addr find_debug_file( Char* objpath, Char* debugname, UInt crc, UInt* size )
 
 /* The central function for reading ELF debug info.  For the
    object/exe specified by the SegInfo, find ELF sections, then read
-   the symbols, line number info, file name info, CFA (stack-unwind
-   info) and anything else we want, into the tables within the
-   supplied SegInfo.
+   the symbols (if want_syms), line number info, file name info, CFA
+   (stack-unwind info) (if want_lines_and_cfi) and anything else we
+   want, into the tables within the supplied SegInfo.  The symbols
+   must be read first, since that is when the SegInfo's bounds and
+   text_bias are worked out.
 */
-Bool ML_(read_elf_debug_info) ( struct _SegInfo* si )
+static
+Bool read_elf_debug_info ( struct _SegInfo* si,
+                           Bool want_syms, Bool want_lines_and_cfi )
 {
    Bool          res;
    ElfXX_Ehdr*   ehdr;       /* The ELF header                   */
@@ -827,7 +831,8 @@ Bool ML_(read_elf_debug_info) ( struct _SegInfo* si )
 
    oimage = (Addr)NULL;
    if (VG_(clo_verbosity) > 1 || VG_(clo_trace_redir))
-      VG_(message)(Vg_DebugMsg, "Reading syms from %s (%p)", 
+      VG_(message)(Vg_DebugMsg, "Reading %s from %s (%p)", 
+                                want_syms ? "syms" : "line info and CFI",
                                 si->filename, si->text_start_avma );
 
    /* mmap the object image aboard, so that we can read symbols and
@@ -888,7 +893,10 @@ Bool ML_(read_elf_debug_info) ( struct _SegInfo* si )
       ML_(symerr)("ELF program header is beyond image end?!");
       goto out;
    }
-   {
+   if (!want_syms) {
+      /* Done the first time round. */
+      offset_oimage = si->text_bias;
+   } else {
       Bool offset_set = False;
       ElfXX_Addr prev_addr = 0;
       Addr baseaddr = 0;
@@ -1122,7 +1130,8 @@ Bool ML_(read_elf_debug_info) ( struct _SegInfo* si )
       }
          
       /* Did we find a debuglink section? */
-      if (debuglink_img != NULL) {
+      if (debuglink_img != NULL
+          && (want_lines_and_cfi || symtab_img == NULL)) {
          UInt crc_offset = VG_ROUNDUP(VG_(strlen)(debuglink_img)+1, 4);
          UInt crc;
 
@@ -1141,7 +1150,7 @@ Bool ML_(read_elf_debug_info) ( struct _SegInfo* si )
                 && ehdr->e_phoff + ehdr->e_phnum*sizeof(ElfXX_Phdr) <= n_dimage
                 && ehdr->e_shoff + ehdr->e_shnum*sizeof(ElfXX_Shdr) <= n_dimage)
             {
-               Bool need_symtab = (NULL == symtab_img);
+               Bool need_symtab = want_syms && (NULL == symtab_img);
 
                for (i = 0; i < ehdr->e_phnum; i++) {
                   ElfXX_Phdr *o_phdr = &((ElfXX_Phdr *)(dimage + ehdr->e_phoff))[i];
@@ -1206,7 +1215,7 @@ Bool ML_(read_elf_debug_info) ( struct _SegInfo* si )
       vg_assert((symtab_sz % sizeof(ElfXX_Sym)) == 0);
 
       /* Read symbols */
-      {
+      if (want_syms) {
          void (*read_elf_symtab)(struct _SegInfo*,UChar*,ElfXX_Sym*,
                                  UInt,OffT,UChar*,UInt,UChar*,OffT);
 #        if defined(VGP_ppc64_linux)
@@ -1225,37 +1234,39 @@ Bool ML_(read_elf_debug_info) ( struct _SegInfo* si )
                          opd_filea_img, opd_offset);
       }
 
-      /* Read .eh_frame (call-frame-info) if any */
-      if (ehframe_img) {
-         ML_(read_callframe_info_dwarf3)
-            ( si, ehframe_img, ehframe_sz, ehframe_avma );
-      }
+      if (want_lines_and_cfi) {
+         /* Read .eh_frame (call-frame-info) if any */
+         if (ehframe_img) {
+            ML_(read_callframe_info_dwarf3)
+               ( si, ehframe_img, ehframe_sz, ehframe_avma );
+         }
 
-      /* Read the stabs and/or dwarf2 debug information, if any.  It
-         appears reading stabs stuff on amd64-linux doesn't work, so
-         we ignore it. */
+         /* Read the stabs and/or dwarf2 debug information, if any.  It
+            appears reading stabs stuff on amd64-linux doesn't work, so
+            we ignore it. */
 #     if !defined(VGP_amd64_linux)
-      if (stab_img && stabstr_img) {
-         ML_(read_debuginfo_stabs) ( si, debug_offset, stab_img, stab_sz, 
-                                         stabstr_img, stabstr_sz );
-      }
+         if (stab_img && stabstr_img) {
+            ML_(read_debuginfo_stabs) ( si, debug_offset, stab_img, stab_sz, 
+                                            stabstr_img, stabstr_sz );
+         }
 #     endif
-      /* jrs 2006-01-01: icc-8.1 has been observed to generate
-         binaries without debug_str sections.  Don't preclude
-         debuginfo reading for that reason, but, in
-         read_unitinfo_dwarf2, do check that debugstr is non-NULL
-         before using it. */
-      if (debug_info_img && debug_abbv_img && debug_line_img
-                                           /* && debug_str_img */) {
-         ML_(read_debuginfo_dwarf2) ( si, debug_offset, 
-                                      debug_info_img,   debug_info_sz,
-                                      debug_abbv_img,
-                                      debug_line_img,   debug_line_sz,
-                                      debug_str_img );
-      }
-      if (dwarf1d_img && dwarf1l_img) {
-         ML_(read_debuginfo_dwarf1) ( si, dwarf1d_img, dwarf1d_sz, 
-                                          dwarf1l_img, dwarf1l_sz );
+         /* jrs 2006-01-01: icc-8.1 has been observed to generate
+            binaries without debug_str sections.  Don't preclude
+            debuginfo reading for that reason, but, in
+            read_unitinfo_dwarf2, do check that debugstr is non-NULL
+            before using it. */
+         if (debug_info_img && debug_abbv_img && debug_line_img
+                                              /* && debug_str_img */) {
+            ML_(read_debuginfo_dwarf2) ( si, debug_offset, 
+                                         debug_info_img,   debug_info_sz,
+                                         debug_abbv_img,
+                                         debug_line_img,   debug_line_sz,
+                                         debug_str_img );
+         }
+         if (dwarf1d_img && dwarf1l_img) {
+            ML_(read_debuginfo_dwarf1) ( si, dwarf1d_img, dwarf1d_sz, 
+                                             dwarf1l_img, dwarf1l_sz );
+         }
       }
    }
    res = True;
@@ -1273,6 +1284,24 @@ Bool ML_(read_elf_debug_info) ( struct _SegInfo* si )
   } 
 }
 
+Bool ML_(read_elf_debug_info) ( struct _SegInfo* si )
+{
+   /* What goes in the --debuginfo-cache has to be complete. */
+   Bool lazy = VG_(clo_lazy_debuginfo) && VG_(clo_debuginfo_cache) == NULL
+               && !si->trace_symtab && !si->trace_cfi
+               && !si->ddump_line && !si->ddump_frames;
+
+   si->lines_and_cfi_pending = lazy;
+   return read_elf_debug_info ( si, True, !lazy );
+}
+
+void ML_(read_elf_lines_and_cfi) ( struct _SegInfo* si )
+{
+   vg_assert(si->lines_and_cfi_pending);
+   si->lines_and_cfi_pending = False;
+   (void)read_elf_debug_info ( si, False, True );
+}
+
 
 /*--------------------------------------------------------------------*/
 /*--- end                                                          ---*/
@@ -884,6 +884,14 @@ void ML_(canonicaliseTables) ( struct _SegInfo* si )
    canonicaliseCFI ( si );
 }
 
+/* Likewise, for just the loctab and CFI tables, after they have been
+   read on demand. */
+void ML_(canonicaliseLoctabAndCFI) ( struct _SegInfo* si )
+{
+   canonicaliseLoctab ( si );
+   canonicaliseCFI ( si );
+}
+
 
 /*------------------------------------------------------------*/
 /*--- Searching the tables                                 ---*/
@@ -67,9 +67,19 @@
    Initially empty, and grows as errors are detected. */
 static Error* errors = NULL;
 
+/* The same errors, hashed on their kind and the top two entries of
+   their stack -- the most that eq_Error() may look at, at either
+   resolution -- so that VG_(maybe_record_error) need only compare
+   against errors which could match.  Chained through 'hash_next'. */
+static Error** error_hash = NULL;
+static UInt    error_hash_size = 0;
+static UInt    error_hash_used = 0;
+
+#define ERROR_HASH_INITIAL_SIZE 1021
+
 /* The list of suppression directives, as read from the specified
-   suppressions file.  Note that the list gets rearranged as a result
-   of the searches done by is_suppressible_error(). */
+   suppressions file.  is_suppressible_error() searches them through
+   supp_trie_root instead, which holds the same records. */
 static Supp* suppressions = NULL;
 
 /* Running count of unsuppressed errors detected. */
@@ -80,6 +90,7 @@ static UInt n_errs_suppressed = 0;
 
 /* forwards ... */
 static Supp* is_suppressible_error ( Error* err );
+static void  add_to_supp_trie ( Supp* su );
 
 static ThreadId last_tid_printed = 1;
 
@@ -90,6 +101,9 @@ static UWord em_errlist_searches = 0;
    searching. */
 static UWord em_errlist_cmps = 0;
 
+/* Stats: number of error list searches which found a match. */
+static UWord em_errlist_hits = 0;
+
 /* Stats: number of searches of the suppression list initiated. */
 static UWord em_supplist_searches = 0;
 
@@ -112,6 +126,7 @@ static UWord em_supplist_cmps = 0;
 */
 struct _Error {
    struct _Error* next;
+   struct _Error* hash_next;  // chain in error_hash
    // Unique tag.  This gives the error a unique identity (handle) by
    // which it can be referred to afterwords.  Currently only used for
    // XML printing.
@@ -127,6 +142,7 @@ struct _Error {
    Addr addr;              // Used frequently
    Char* string;           // Used frequently
    void* extra;            // For any tool-specific extras
+   Bool  extra_copied;     // Whether 'extra' is ours to free
 };
 
 ExeContext* VG_(get_error_where) ( Error* err )
@@ -154,6 +170,21 @@ void* VG_(get_error_extra)  ( Error* err )
    return err->extra;
 }
 
+UInt VG_(get_error_unique) ( Error* err )
+{
+   return err->unique;
+}
+
+Int VG_(get_error_count) ( Error* err )
+{
+   return err->count;
+}
+
+ThreadId VG_(get_error_tid) ( Error* err )
+{
+   return err->tid;
+}
+
 UInt VG_(get_n_errs_found)( void )
 {
    return n_errs_found;
@@ -200,6 +231,7 @@ typedef
    (0..)) for 'skind'. */
 struct _Supp {
    struct _Supp* next;
+   struct _Supp* trie_next;   // Next suppression ending at the same node.
    Int count;     // The number of times this error has been suppressed.
    Char* sname;   // The name by which the suppression is referred to.
 
@@ -365,6 +397,50 @@ Bool VG_(is_action_requested) ( Char* action, Bool* clo )
 }
 
 
+static UInt hash_Error ( Error* err )
+{
+   StackTrace ips   = VG_(extract_StackTrace)(err->where);
+   UInt       n_ips = VG_(get_ExeContext_n_ips)(err->where);
+   UWord      h     = (UWord)err->ekind;
+   UInt       i;
+
+   for (i = 0; i < 2 && i < n_ips; i++)
+      h = (h ^ ips[i]) * 2654435761U;
+   return (UInt)(h ^ (h >> 15)) % error_hash_size;
+}
+
+static void add_to_error_hash ( Error* err )
+{
+   UInt h;
+
+   if (error_hash_used >= 2 * error_hash_size) {
+      /* Rehash into a table twice the size.  There are seldom enough
+         distinct errors for this to matter. */
+      Error** old      = error_hash;
+      UInt    old_size = error_hash_size;
+      UInt    i;
+      Error  *p, *next;
+
+      error_hash_size = 2 * old_size + 1;
+      error_hash = VG_(arena_calloc)(VG_AR_ERRORS, error_hash_size,
+                                     sizeof(Error*));
+      for (i = 0; i < old_size; i++) {
+         for (p = old[i]; p != NULL; p = next) {
+            next = p->hash_next;
+            h = hash_Error(p);
+            p->hash_next  = error_hash[h];
+            error_hash[h] = p;
+         }
+      }
+      VG_(arena_free)(VG_AR_ERRORS, old);
+   }
+
+   h = hash_Error(err);
+   err->hash_next = error_hash[h];
+   error_hash[h]  = err;
+   error_hash_used++;
+}
+
 /* Construct an error */
 static __inline__
 void construct_error ( Error* err, ThreadId tid, ErrorKind ekind, Addr a,
@@ -378,6 +454,7 @@ void construct_error ( Error* err, ThreadId tid, ErrorKind ekind, Addr a,
    /* Core-only parts */
    err->unique   = unique_counter++;
    err->next     = NULL;
+   err->hash_next = NULL;
    err->supp     = NULL;
    err->count    = 1;
    err->tid      = tid;
@@ -391,6 +468,7 @@ void construct_error ( Error* err, ThreadId tid, ErrorKind ekind, Addr a,
    err->addr   = a;
    err->extra  = extra;
    err->string = s;
+   err->extra_copied = False;
 
    /* sanity... */
    vg_assert( tid < VG_N_THREADS );
@@ -485,7 +563,6 @@ void VG_(maybe_record_error) ( ThreadId tid,
 {
           Error  err;
           Error* p;
-          Error* p_prev;
           UInt   extra_size;
           VgRes  exe_res          = Vg_MedRes;
    static Bool   stopping_message = False;
@@ -550,14 +627,20 @@ void VG_(maybe_record_error) ( ThreadId tid,
    /* Build ourselves the error */
    construct_error ( &err, tid, ekind, a, s, extra, NULL );
 
-   /* First, see if we've got an error record matching this one. */
+   if (error_hash == NULL) {
+      error_hash_size = ERROR_HASH_INITIAL_SIZE;
+      error_hash = VG_(arena_calloc)(VG_AR_ERRORS, error_hash_size,
+                                     sizeof(Error*));
+   }
+
+   /* First, see if we've got an error record matching this one.  Only
+      those in the same hash chain can. */
    em_errlist_searches++;
-   p       = errors;
-   p_prev  = NULL;
-   while (p != NULL) {
+   for (p = error_hash[hash_Error(&err)]; p != NULL; p = p->hash_next) {
       em_errlist_cmps++;
       if (eq_Error(exe_res, p, &err)) {
          /* Found it. */
+         em_errlist_hits++;
          p->count++;
 	 if (p->supp != NULL) {
             /* Deal correctly with suppressed errors. */
@@ -565,21 +648,11 @@ void VG_(maybe_record_error) ( ThreadId tid,
             n_errs_suppressed++;	 
          } else {
             n_errs_found++;
+            if (VG_(needs).error_stream)
+               VG_TDICT_CALL(tool_error_recorded, p, /*is_new*/False);
          }
-
-         /* Move p to the front of the list so that future searches
-            for it are faster. */
-         if (p_prev != NULL) {
-            vg_assert(p_prev->next == p);
-            p_prev->next = p->next;
-            p->next      = errors;
-            errors       = p;
-	 }
-
          return;
       }
-      p_prev = p;
-      p      = p->next;
    }
 
    /* Didn't see it.  Copy and add. */
@@ -621,18 +694,24 @@ void VG_(maybe_record_error) ( ThreadId tid,
       void* new_extra = VG_(malloc)(extra_size);
       VG_(memcpy)(new_extra, p->extra, extra_size);
       p->extra = new_extra;
+      p->extra_copied = True;
    }
 
    p->next = errors;
    p->supp = is_suppressible_error(&err);
    errors  = p;
+   add_to_error_hash(p);
    if (p->supp == NULL) {
       n_errs_found++;
-      if (!is_first_shown_context)
-         VG_(message)(Vg_UserMsg, "");
-      pp_Error(p);
-      is_first_shown_context = False;
+      if (!VG_(needs).error_stream_only) {
+         if (!is_first_shown_context)
+            VG_(message)(Vg_UserMsg, "");
+         pp_Error(p);
+         is_first_shown_context = False;
+      }
       n_errs_shown++;
+      if (VG_(needs).error_stream)
+         VG_TDICT_CALL(tool_error_recorded, p, /*is_new*/True);
       do_actions_on_error(p, /*allow_db_attach*/True);
    } else {
       n_errs_suppressed++;
@@ -672,11 +751,15 @@ Bool VG_(unique_error) ( ThreadId tid, ErrorKind ekind, Addr a, Char* s,
          n_errs_found++;
 
       if (print_error) {
-         if (!is_first_shown_context)
-            VG_(message)(Vg_UserMsg, "");
-         pp_Error(&err);
-         is_first_shown_context = False;
+         if (!VG_(needs).error_stream_only) {
+            if (!is_first_shown_context)
+               VG_(message)(Vg_UserMsg, "");
+            pp_Error(&err);
+            is_first_shown_context = False;
+         }
          n_errs_shown++;
+         if (VG_(needs).error_stream)
+            VG_TDICT_CALL(tool_error_recorded, &err, /*is_new*/True);
          do_actions_on_error(&err, allow_db_attach);
       }
       return False;
@@ -727,6 +810,53 @@ static Bool show_used_suppressions ( void )
 }
 
 
+/* Forget all the errors recorded so far, as if none had occurred, so
+   that in-process harnesses running many inputs (eg. Flayer's
+   persistent mode) see each input's errors afresh.  Suppression use
+   counts are left alone, as they describe the whole run. */
+void VG_(clear_errors) ( void )
+{
+   Error *p, *next;
+
+   for (p = errors; p != NULL; p = next) {
+      next = p->next;
+      if (p->extra_copied)
+         VG_(free)(p->extra);
+      VG_(arena_free)(VG_AR_ERRORS, p);
+   }
+   errors                 = NULL;
+   if (error_hash != NULL)
+      VG_(memset)(error_hash, 0, error_hash_size * sizeof(Error*));
+   error_hash_used        = 0;
+   n_errs_found           = 0;
+   n_errs_suppressed      = 0;
+   n_errs_shown           = 0;
+   is_first_shown_context = True;
+}
+
+/* Add in the occurrences the tool counted itself, before the counts
+   are shown (see VG_(needs_final_error_counts)). */
+void VG_(add_final_error_counts) ( void )
+{
+   Error* p;
+   UInt   n;
+
+   if (!VG_(needs).final_error_counts)
+      return;
+
+   for (p = errors; p != NULL; p = p->next) {
+      if (p->supp != NULL)
+         continue;
+      n = VG_TDICT_CALL(tool_more_occurrences, p);
+      if (n == 0)
+         continue;
+      p->count     += n;
+      n_errs_found += n;
+      if (VG_(needs).error_stream)
+         VG_TDICT_CALL(tool_error_recorded, p, /*is_new*/False);
+   }
+}
+
 /* Show all the errors that occurred, and possibly also the
    suppressions used. */
 void VG_(show_all_errors) ( void )
@@ -1092,6 +1222,7 @@ static void load_one_suppressions_file ( Char* filename )
 
       supp->next = suppressions;
       suppressions = supp;
+      add_to_supp_trie(supp);
    }
    VG_(close)(fd);
    return;
@@ -1144,44 +1275,237 @@ Bool supp_matches_error(Supp* su, Error* err)
    }
 }
 
-static
-Bool supp_matches_callers(Error* err, Supp* su)
+/*------------------------------------------------------------*/
+/*--- Matching errors against suppressions                 ---*/
+/*------------------------------------------------------------*/
+
+/* Matching used to walk the whole suppression list for every new
+   error, looking up the function or object name of each frame afresh
+   for each suppression.  Instead:
+
+   - at load time the suppressions are merged into a trie over their
+     caller lines, so that a frame pattern shared by many suppressions
+     (eg. "obj:/lib/libc-2.5.so" or "fun:malloc") is matched once;
+
+   - the names of a PC are looked up once, and kept in pc_names[];
+
+   - the suppressions whose callers match an ExeContext are kept in
+     caller_matches[], so that later errors in the same context only
+     have to run the (cheap) kind check of those few.  The kind check
+     itself can't be memoised, as the tool may look at the error's
+     string or extra part.
+
+   The names of a PC go stale if its object is unmapped, so both
+   caches are emptied whenever debug info is discarded. */
+
+/* Sentinel for a name that couldn't be found.  It can be anything
+   that couldn't be a valid function or objname.  --gen-suppressions
+   prints 'obj:*' for such an entry, which will match any string we
+   use. */
+static Char unknown_name[] = "???";
+
+typedef
+   struct _SuppNode {
+      struct _SuppNode* children;
+      struct _SuppNode* sibling;
+      SuppLoc           loc;     // the caller line (unused at the root)
+      Supp*             supps;   // ending here, chained by trie_next
+   }
+   SuppNode;
+
+static SuppNode supp_trie_root;
+
+typedef
+   struct _PcNames {
+      struct _PcNames* next;
+      Addr             pc;
+      Char*            fnname;   // NULL if not yet looked up
+      Char*            objname;  // ditto
+   }
+   PcNames;
+
+#define N_PC_NAMES_LISTS   1021
+
+static PcNames* pc_names[N_PC_NAMES_LISTS];
+
+typedef
+   struct _CallerMatches {
+      struct _CallerMatches* next;
+      ExeContext*            where;
+      Int                    n_supps;
+      Supp**                 supps;
+   }
+   CallerMatches;
+
+#define N_CALLER_MATCHES_LISTS   1021
+
+static CallerMatches* caller_matches[N_CALLER_MATCHES_LISTS];
+
+/* Stats: number of searches answered from caller_matches[]. */
+static UWord em_supplist_cache_hits = 0;
+
+/* Stats: number of symbol name lookups done for matching. */
+static UWord em_supplist_name_lookups = 0;
+
+static void add_to_supp_trie ( Supp* su )
 {
-   Int i;
-   Char caller_name[ERRTXT_LEN];
-   StackTrace ips = VG_(extract_StackTrace)(err->where);
+   SuppNode* node = &supp_trie_root;
+   SuppNode* child;
+   Int       i;
 
    for (i = 0; i < su->n_callers; i++) {
-      Addr a = ips[i];
-      vg_assert(su->callers[i].name != NULL);
-      // The string to be used in the unknown case ("???") can be anything
-      // that couldn't be a valid function or objname.  --gen-suppressions
-      // prints 'obj:*' for such an entry, which will match any string we
-      // use.
-      switch (su->callers[i].ty) {
-         case ObjName: 
-            if (!VG_(get_objname)(a, caller_name, ERRTXT_LEN))
-               VG_(strcpy)(caller_name, "???");
-            break; 
-
-         case FunName: 
-            // Nb: mangled names used in suppressions.  Do, though,
-            // Z-demangle them, since otherwise it's possible to wind
-            // up comparing "malloc" in the suppression against
-            // "_vgrZU_libcZdsoZa_malloc" in the backtrace, and the
-            // two of them need to be made to match.
-            if (!VG_(get_fnname_Z_demangle_only)(a, caller_name, ERRTXT_LEN))
-               VG_(strcpy)(caller_name, "???");
+      for (child = node->children; child != NULL; child = child->sibling) {
+         if (child->loc.ty == su->callers[i].ty
+             && VG_STREQ(child->loc.name, su->callers[i].name))
             break;
-         default: VG_(tool_panic)("supp_matches_callers");
       }
-      if (0) VG_(printf)("cmp %s %s\n", su->callers[i].name, caller_name);
-      if (!VG_(string_match)(su->callers[i].name, caller_name))
-         return False;
+      if (child == NULL) {
+         child = VG_(arena_malloc)(VG_AR_CORE, sizeof(SuppNode));
+         child->children = NULL;
+         child->supps    = NULL;
+         child->loc      = su->callers[i];
+         child->sibling  = node->children;
+         node->children  = child;
+      }
+      node = child;
+   }
+   su->trie_next = node->supps;
+   node->supps   = su;
+}
+
+static Char* get_pc_name ( Addr pc, SuppLocTy ty )
+{
+   Char     buf[ERRTXT_LEN];
+   UWord    h = pc % N_PC_NAMES_LISTS;
+   PcNames* pn;
+   Char**   name;
+
+   for (pn = pc_names[h]; pn != NULL; pn = pn->next)
+      if (pn->pc == pc)
+         break;
+   if (pn == NULL) {
+      pn = VG_(arena_malloc)(VG_AR_CORE, sizeof(PcNames));
+      pn->pc      = pc;
+      pn->fnname  = NULL;
+      pn->objname = NULL;
+      pn->next    = pc_names[h];
+      pc_names[h] = pn;
+   }
+
+   name = ty == FunName ? &pn->fnname : &pn->objname;
+   if (*name != NULL)
+      return *name;
+
+   em_supplist_name_lookups++;
+   switch (ty) {
+      case ObjName:
+         if (!VG_(get_objname)(pc, buf, ERRTXT_LEN))
+            *name = unknown_name;
+         break;
+      case FunName:
+         // Nb: mangled names used in suppressions.  Do, though,
+         // Z-demangle them, since otherwise it's possible to wind
+         // up comparing "malloc" in the suppression against
+         // "_vgrZU_libcZdsoZa_malloc" in the backtrace, and the
+         // two of them need to be made to match.
+         if (!VG_(get_fnname_Z_demangle_only)(pc, buf, ERRTXT_LEN))
+            *name = unknown_name;
+         break;
+      default: VG_(tool_panic)("get_pc_name");
+   }
+   if (*name == NULL)
+      *name = VG_(arena_strdup)(VG_AR_CORE, buf);
+   return *name;
+}
+
+static void add_caller_match ( CallerMatches* cm, Supp* su, Int* size )
+{
+   if (cm->n_supps == *size) {
+      Supp** supps;
+      Int    i;
+      *size = *size == 0 ? 4 : 2 * *size;
+      supps = VG_(arena_malloc)(VG_AR_CORE, *size * sizeof(Supp*));
+      for (i = 0; i < cm->n_supps; i++)
+         supps[i] = cm->supps[i];
+      if (cm->supps)
+         VG_(arena_free)(VG_AR_CORE, cm->supps);
+      cm->supps = supps;
+   }
+   cm->supps[cm->n_supps++] = su;
+}
+
+/* Add to cm every suppression below 'node' whose remaining callers
+   match ips[depth ..]. */
+static void match_supp_trie ( SuppNode* node, StackTrace ips, UInt n_ips,
+                              UInt depth, CallerMatches* cm, Int* size )
+{
+   SuppNode* child;
+   Supp*     su;
+
+   for (su = node->supps; su != NULL; su = su->trie_next)
+      add_caller_match(cm, su, size);
+
+   for (child = node->children; child != NULL; child = child->sibling) {
+      Char* caller_name = depth < n_ips
+                          ? get_pc_name(ips[depth], child->loc.ty)
+                          : unknown_name;
+      em_supplist_cmps++;
+      if (0) VG_(printf)("cmp %s %s\n", child->loc.name, caller_name);
+      if (VG_(string_match)(child->loc.name, caller_name))
+         match_supp_trie(child, ips, n_ips, depth + 1, cm, size);
+   }
+}
+
+static CallerMatches* get_caller_matches ( ExeContext* where )
+{
+   UWord          h = ((UWord)where >> 3) % N_CALLER_MATCHES_LISTS;
+   CallerMatches* cm;
+   Int            size = 0;
+
+   for (cm = caller_matches[h]; cm != NULL; cm = cm->next) {
+      if (cm->where == where) {
+         em_supplist_cache_hits++;
+         return cm;
+      }
    }
 
-   /* If we reach here, it's a match */
-   return True;
+   cm = VG_(arena_malloc)(VG_AR_CORE, sizeof(CallerMatches));
+   cm->where   = where;
+   cm->n_supps = 0;
+   cm->supps   = NULL;
+   match_supp_trie(&supp_trie_root, VG_(extract_StackTrace)(where),
+                   VG_(get_ExeContext_n_ips)(where), 0, cm, &size);
+   cm->next = caller_matches[h];
+   caller_matches[h] = cm;
+   return cm;
+}
+
+void VG_(discard_supp_caches) ( void )
+{
+   Int i;
+
+   for (i = 0; i < N_PC_NAMES_LISTS; i++) {
+      PcNames *pn, *next;
+      for (pn = pc_names[i]; pn != NULL; pn = next) {
+         next = pn->next;
+         if (pn->fnname != NULL && pn->fnname != unknown_name)
+            VG_(arena_free)(VG_AR_CORE, pn->fnname);
+         if (pn->objname != NULL && pn->objname != unknown_name)
+            VG_(arena_free)(VG_AR_CORE, pn->objname);
+         VG_(arena_free)(VG_AR_CORE, pn);
+      }
+      pc_names[i] = NULL;
+   }
+   for (i = 0; i < N_CALLER_MATCHES_LISTS; i++) {
+      CallerMatches *cm, *next;
+      for (cm = caller_matches[i]; cm != NULL; cm = next) {
+         next = cm->next;
+         if (cm->supps)
+            VG_(arena_free)(VG_AR_CORE, cm->supps);
+         VG_(arena_free)(VG_AR_CORE, cm);
+      }
+      caller_matches[i] = NULL;
+   }
 }
 
 /* Does an error context match a suppression?  ie is this a suppressible
@@ -1190,28 +1514,20 @@ Bool supp_matches_callers(Error* err, Supp* su)
 */
 static Supp* is_suppressible_error ( Error* err )
 {
-   Supp* su;
-   Supp* su_prev;
+   CallerMatches* cm;
+   Int            i;
 
    /* stats gathering */
    em_supplist_searches++;
 
+   if (suppressions == NULL)
+      return NULL;
+
    /* See if the error context matches any suppression. */
-   su_prev = NULL;
-   for (su = suppressions; su != NULL; su = su->next) {
-      em_supplist_cmps++;
-      if (supp_matches_error(su, err) && supp_matches_callers(err, su)) {
-         /* got a match.  Move this entry to the head of the list
-            in the hope of making future searches cheaper. */
-         if (su_prev) {
-            vg_assert(su_prev->next == su);
-            su_prev->next = su->next;
-            su->next = suppressions;
-            suppressions = su;
-         }
-         return su;
-      }
-      su_prev = su;
+   cm = get_caller_matches(err->where);
+   for (i = 0; i < cm->n_supps; i++) {
+      if (supp_matches_error(cm->supps[i], err))
+         return cm->supps[i];
    }
    return NULL;      /* no matches */
 }
@@ -1224,10 +1540,18 @@ void VG_(print_errormgr_stats) ( void )
       " errormgr: %,lu supplist searches, %,lu comparisons during search",
       em_supplist_searches, em_supplist_cmps
    );
+   VG_(message)(Vg_DebugMsg, 
+      " errormgr: %,lu supplist searches cached, %,lu name lookups",
+      em_supplist_cache_hits, em_supplist_name_lookups
+   );
    VG_(message)(Vg_DebugMsg, 
       " errormgr: %,lu errlist searches, %,lu comparisons during search",
       em_errlist_searches, em_errlist_cmps
    );
+   VG_(message)(Vg_DebugMsg, 
+      " errormgr: %,lu errlist hits, %,u errors in %,u hash chains",
+      em_errlist_hits, error_hash_used, error_hash_size
+   );
 }
 
 /*--------------------------------------------------------------------*/
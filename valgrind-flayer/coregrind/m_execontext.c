@@ -35,6 +35,7 @@
 #include "pub_core_mallocfree.h"
 #include "pub_core_options.h"
 #include "pub_core_stacktrace.h"
+#include "pub_core_tooliface.h"
 
 /*------------------------------------------------------------*/
 /*--- Low-level ExeContext storage.                        ---*/
@@ -130,6 +131,17 @@ void VG_(pp_ExeContext) ( ExeContext* ec )
    VG_(pp_StackTrace)( ec->ips, ec->n_ips );
 }
 
+/* Apply a function to each of the first n_ips ips of the ExeContext,
+   as VG_(apply_StackTrace) does. */
+void VG_(apply_ExeContext)( void(*action)(UInt n, Addr ip),
+                            ExeContext* ec, UInt n_ips )
+{
+   if (n_ips > ec->n_ips)
+      n_ips = ec->n_ips;
+   if (n_ips > 0)
+      VG_(apply_StackTrace)( action, ec->ips, n_ips );
+}
+
 
 /* Compare two ExeContexts, comparing all callers. */
 Bool VG_(eq_ExeContext) ( VgRes res, ExeContext* e1, ExeContext* e2 )
@@ -212,7 +224,12 @@ ExeContext* VG_(record_ExeContext) ( ThreadId tid )
    vg_assert(VG_(clo_backtrace_size) >= 1 &&
              VG_(clo_backtrace_size) <= VG_DEEPEST_BACKTRACE);
 
-   n_ips = VG_(get_StackTrace)( tid, ips, VG_(clo_backtrace_size) );
+   n_ips = 0;
+   if (VG_(needs).stack_traces)
+      n_ips = VG_TDICT_CALL( tool_get_StackTrace,
+                             tid, ips, VG_(clo_backtrace_size) );
+   if (n_ips == 0)
+      n_ips = VG_(get_StackTrace)( tid, ips, VG_(clo_backtrace_size) );
    tl_assert(n_ips >= 1);
 
    /* Now figure out if we've seen this one before.  First hash it so
@@ -287,6 +304,16 @@ StackTrace VG_(extract_StackTrace) ( ExeContext* e )
    return e->ips;
 }  
 
+Addr* VG_(get_ExeContext_StackTrace) ( ExeContext* e )
+{
+   return e->ips;
+}
+
+UInt VG_(get_ExeContext_n_ips) ( ExeContext* e )
+{
+   return e->n_ips;
+}
+
 /*--------------------------------------------------------------------*/
 /*--- end                                           m_execontext.c ---*/
 /*--------------------------------------------------------------------*/
@@ -567,6 +567,32 @@ void VG_(do_atfork_child)(ThreadId tid)
       (*atfork_child)(tid);
 }
 
+/* Fork the whole Valgrind process from tool code, eg. for a fork
+   server.  This mirrors what the fork() syscall wrapper does: signals
+   are blocked around the fork and the child runs the atfork action so
+   that only 'tid' survives in it.  Returns the child's pid in the
+   parent, 0 in the child and -1 on failure. */
+Int VG_(fork_process) ( ThreadId tid )
+{
+#  if defined(VGO_linux)
+   vki_sigset_t mask, saved_mask;
+   SysRes       res;
+
+   VG_(sigfillset)(&mask);
+   VG_(sigprocmask)(VKI_SIG_SETMASK, &mask, &saved_mask);
+
+   res = VG_(do_syscall0)(__NR_fork);
+
+   if (!res.isError && res.res == 0)
+      VG_(do_atfork_child)(tid);
+
+   VG_(sigprocmask)(VKI_SIG_SETMASK, &saved_mask, NULL);
+   return res.isError ? -1 : res.res;
+#  else
+   return -1;
+#  endif
+}
+
 /*--------------------------------------------------------------------*/
 /*--- end                                                          ---*/
 /*--------------------------------------------------------------------*/
@@ -82,6 +82,7 @@ static void print_all_stats ( void )
    VG_(print_scheduler_stats)();
    VG_(print_ExeContext_stats)();
    VG_(print_errormgr_stats)();
+   VG_(print_debuginfo_stats)();
 
    // Memory stats
    if (VG_(clo_verbosity) > 2) {
@@ -132,6 +133,21 @@ static void usage_NORETURN ( Bool debug_help )
 "                              only for code found in stacks, or all [stack]\n"
 "    --kernel-variant=variant1,variant2,...  known variants: bproc [none]\n"
 "                              handle non-standard kernel variants\n"
+"    --lazy-debuginfo=no|yes   read line numbers and unwind info for an\n"
+"                              object only when first needed? [yes]\n"
+"    --debuginfo-cache=<dir>   keep parsed debug info in <dir> for the\n"
+"                              next run to reuse [none]\n"
+"    --chain-translations=no|yes  jump straight from one translation to\n"
+"                              the next where possible? (x86 only) [yes]\n"
+"    --translation-cache=<dir> keep translations in <dir> for the next\n"
+"                              run to reuse (some tools only) [none]\n"
+"    --num-transtab-sectors=<number>  sectors of translated code to\n"
+"                              start with [8]\n"
+"    --max-transtab-sectors=<number>  most sectors to grow to if code\n"
+"                              keeps being thrown out and retranslated\n"
+"                              [16; on 32-bit hosts, 2 more than to start]\n"
+"    --avg-transtab-entry-size=<number>  expected size of a translation\n"
+"                              in bytes, setting the sector size [0=tool's]\n"
 "\n"
 "  user options for Valgrind tools that report errors:\n"
 "    --xml=yes                 all output is in XML (some tools only)\n"
@@ -275,6 +291,71 @@ static void get_helprequest_and_toolname ( Int* need_help, HChar** tool )
    }
 }
 
+/* Set if --log-file was used, in which case a forked tool child
+   (see VG_(reopen_log_file_for_child)) can get a file of its own. */
+static Bool        logging_to_pid_file = False;
+static const char* logging_toolname    = NULL;
+
+/* Create base_name.pid (or base_name.qualifier), adding a .seq suffix
+   until we find a name which isn't already taken.  Returns the fd. */
+static Int create_log_file ( void )
+{
+   HChar  logfilename[1000];
+   Int    seq  = 0;
+   Int    pid  = VG_(getpid)();
+   HChar* qual = NULL;
+   SysRes sres;
+
+   vg_assert(VG_(clo_log_name) != NULL);
+   vg_assert(VG_(strlen)(VG_(clo_log_name)) <= 900); /* paranoia */
+
+   if (VG_(clo_log_file_qualifier)) {
+      qual = VG_(getenv)(VG_(clo_log_file_qualifier));
+   }
+
+   for (;;) {
+      HChar pidtxt[20], seqtxt[20];
+
+      VG_(sprintf)(pidtxt, "%d", pid);
+
+      if (seq == 0)
+         seqtxt[0] = 0;
+      else
+         VG_(sprintf)(seqtxt, ".%d", seq);
+
+      seq++;
+
+      /* Result:
+            if (qual)      base_name ++ "." ++ qual ++ seqtxt
+            if (not qual)  base_name ++ "." ++ pid  ++ seqtxt
+      */
+      VG_(sprintf)( logfilename, 
+                    "%s.%s%s",
+                    VG_(clo_log_name), 
+                    qual ? qual : pidtxt,
+                    seqtxt );
+
+      // EXCL: it will fail with EEXIST if the file already exists.
+      sres = VG_(open)(logfilename, 
+                       VKI_O_CREAT|VKI_O_WRONLY|VKI_O_EXCL|VKI_O_TRUNC, 
+                       VKI_S_IRUSR|VKI_S_IWUSR);
+      if (!sres.isError) {
+         return sres.res;
+      } else {
+         // If the file already existed, we try the next name.  If it
+         // was some other file error, we give up.
+         if (sres.err != VKI_EEXIST) {
+            VG_(message)(Vg_UserMsg, 
+                         "Can't create log file '%s' (%s); giving up!", 
+                         logfilename, VG_(strerror)(sres.err));
+            VG_(err_bad_option)(
+               "--log-file=<file> (didn't work out for some reason.)");
+            /*NOTREACHED*/
+         }
+      }
+   }
+}
+
 static Bool process_cmd_line_options( UInt* client_auxv, const char* toolname )
 {
    // VG_(clo_log_fd) is used by all the messaging.  It starts as 2 (stderr)
@@ -367,6 +448,18 @@ static Bool process_cmd_line_options( UInt* client_auxv, const char* toolname )
       else VG_BOOL_CLO(arg, "--show-emwarns",     VG_(clo_show_emwarns))
       else VG_NUM_CLO (arg, "--max-stackframe",   VG_(clo_max_stackframe))
       else VG_BOOL_CLO(arg, "--run-libc-freeres", VG_(clo_run_libc_freeres))
+      else VG_BOOL_CLO(arg, "--lazy-debuginfo",   VG_(clo_lazy_debuginfo))
+      else VG_STR_CLO (arg, "--debuginfo-cache",  VG_(clo_debuginfo_cache))
+      else VG_BOOL_CLO(arg, "--chain-translations", VG_(clo_chain_translations))
+      else VG_STR_CLO (arg, "--translation-cache", VG_(clo_translation_cache))
+      else VG_BNUM_CLO(arg, "--num-transtab-sectors",
+                       VG_(clo_num_transtab_sectors), 1,
+                       VG_MAX_TRANSTAB_SECTORS)
+      else VG_BNUM_CLO(arg, "--max-transtab-sectors",
+                       VG_(clo_max_transtab_sectors), 1,
+                       VG_MAX_TRANSTAB_SECTORS)
+      else VG_BNUM_CLO(arg, "--avg-transtab-entry-size",
+                       VG_(clo_avg_transtab_entry_size), 0, 4000)
       else VG_BOOL_CLO(arg, "--show-below-main",  VG_(clo_show_below_main))
       else VG_BOOL_CLO(arg, "--time-stamp",       VG_(clo_time_stamp))
       else VG_BOOL_CLO(arg, "--track-fds",        VG_(clo_track_fds))
@@ -523,6 +616,24 @@ static Bool process_cmd_line_options( UInt* client_auxv, const char* toolname )
    if (VG_(clo_vex_control).guest_chase_thresh < 0)
       VG_(clo_vex_control).guest_chase_thresh = 0;
 
+   /* Chained translations bypass the profiling dispatcher. */
+#  if !defined(VGA_x86)
+   VG_(clo_chain_translations) = False;
+#  endif
+   if (VG_(clo_profile_flags) > 0)
+      VG_(clo_chain_translations) = False;
+
+   /* Each sector added takes tens of MB of address space, which
+      32-bit hosts are short of, so by default they grow only a little. */
+   if (VG_(clo_max_transtab_sectors) == 0) {
+      VG_(clo_max_transtab_sectors)
+         = VG_WORDSIZE == 8 ? 16 : VG_(clo_num_transtab_sectors) + 2;
+      if (VG_(clo_max_transtab_sectors) > VG_MAX_TRANSTAB_SECTORS)
+         VG_(clo_max_transtab_sectors) = VG_MAX_TRANSTAB_SECTORS;
+   }
+   if (VG_(clo_max_transtab_sectors) < VG_(clo_num_transtab_sectors))
+      VG_(clo_max_transtab_sectors) = VG_(clo_num_transtab_sectors);
+
    /* Check various option values */
 
    if (VG_(clo_verbosity) < 0)
@@ -546,6 +657,15 @@ static Bool process_cmd_line_options( UInt* client_auxv, const char* toolname )
       VG_(err_bad_option)("--gen-suppressions=");
    }
 
+   if (VG_(clo_translation_cache) != NULL
+       && !VG_(needs).persistent_translations) {
+      VG_(message)(Vg_UserMsg,
+                   "Can't use --translation-cache= with this tool,");
+      VG_(message)(Vg_UserMsg,
+                   "as its translations can't be reused by another run.");
+      VG_(err_bad_option)("--translation-cache=");
+   }
+
    /* If we've been asked to emit XML, mash around various other
       options so as to constrain the output somewhat, and to remove
       any need for user input during the run. */
@@ -593,60 +713,8 @@ static Bool process_cmd_line_options( UInt* client_auxv, const char* toolname )
          break;
 
       case VgLogTo_File: {
-         HChar  logfilename[1000];
-	 Int    seq  = 0;
-	 Int    pid  = VG_(getpid)();
-         HChar* qual = NULL;
-
-         vg_assert(VG_(clo_log_name) != NULL);
-         vg_assert(VG_(strlen)(VG_(clo_log_name)) <= 900); /* paranoia */
-
-	 if (VG_(clo_log_file_qualifier)) {
-            qual = VG_(getenv)(VG_(clo_log_file_qualifier));
-	 }
-
-	 for (;;) {
-            HChar pidtxt[20], seqtxt[20];
-
-            VG_(sprintf)(pidtxt, "%d", pid);
-
-            if (seq == 0)
-               seqtxt[0] = 0;
-            else
-               VG_(sprintf)(seqtxt, ".%d", seq);
-
-	    seq++;
-
-            /* Result:
-                  if (qual)      base_name ++ "." ++ qual ++ seqtxt
-                  if (not qual)  base_name ++ "." ++ pid  ++ seqtxt
-            */
-            VG_(sprintf)( logfilename, 
-                          "%s.%s%s",
-                          VG_(clo_log_name), 
-                          qual ? qual : pidtxt,
-                          seqtxt );
-
-            // EXCL: it will fail with EEXIST if the file already exists.
-            sres = VG_(open)(logfilename, 
-                             VKI_O_CREAT|VKI_O_WRONLY|VKI_O_EXCL|VKI_O_TRUNC, 
-                             VKI_S_IRUSR|VKI_S_IWUSR);
-	    if (!sres.isError) {
-               tmp_log_fd = sres.res;
-	       break; /* for (;;) */
-	    } else {
-               // If the file already existed, we try the next name.  If it
-               // was some other file error, we give up.
-	       if (sres.err != VKI_EEXIST) {
-		  VG_(message)(Vg_UserMsg, 
-			       "Can't create log file '%s' (%s); giving up!", 
-			       logfilename, VG_(strerror)(sres.err));
-		  VG_(err_bad_option)(
-		     "--log-file=<file> (didn't work out for some reason.)");
-                  /*NOTREACHED*/
-	       }
-	    }
-	 }
+         tmp_log_fd = create_log_file();
+         logging_to_pid_file = True;
          break; /* switch (VG_(clo_log_to)) */
       }
 
@@ -938,6 +1006,31 @@ static void print_preamble(Bool logging_to_fd, const char* toolname)
    }
 }
 
+/* Called in the child after a tool has done VG_(fork_process).  With
+   --log-file the child would otherwise interleave its output with the
+   parent's, so give it its own file, named by its own pid, with a
+   preamble of its own.  Other logging sinks are left shared. */
+void VG_(reopen_log_file_for_child) ( void )
+{
+   Int tmp, fd;
+
+   if (!logging_to_pid_file)
+      return;
+
+   tmp = create_log_file();
+   if (tmp < 0)
+      return;
+   fd = VG_(fcntl)(tmp, VKI_F_DUPFD, VG_(fd_hard_limit));
+   VG_(close)(tmp);
+   if (fd < 0)
+      return;
+   VG_(fcntl)(fd, VKI_F_SETFD, VKI_FD_CLOEXEC);
+
+   VG_(close)(VG_(clo_log_fd));
+   VG_(clo_log_fd) = fd;
+   print_preamble(False, logging_toolname);
+}
+
 
 /*====================================================================*/
 /*=== File descriptor setup                                        ===*/
@@ -1598,6 +1691,7 @@ Int valgrind_main ( Int argc, HChar **argv, HChar **envp )
    //--------------------------------------------------------------
    VG_(debugLog)(1, "main", "Print the preamble...\n");
    print_preamble(logging_to_fd, toolname);
+   logging_toolname = toolname;
    VG_(debugLog)(1, "main", "...finished the preamble\n");
 
    //--------------------------------------------------------------
@@ -1974,6 +2068,9 @@ void shutdown_actions_NORETURN( ThreadId tid,
    if (VG_(clo_verbosity) > 0)
       VG_(message)(Vg_UserMsg, "");
 
+   if (VG_(needs).tool_errors)
+      VG_(add_final_error_counts)();
+
    if (VG_(clo_xml)) {
       HChar buf[50];
       if (VG_(needs).core_errors || VG_(needs).tool_errors) {
@@ -1998,6 +2095,8 @@ void shutdown_actions_NORETURN( ThreadId tid,
 
    VG_TDICT_CALL(tool_fini, 0/*exitcode*/);
 
+   VG_(save_persisted_translations)();
+
    if (VG_(clo_xml)) {
       VG_(message)(Vg_UserMsg, "");
       VG_(message)(Vg_UserMsg, "</valgrindoutput>");
@@ -1392,6 +1392,73 @@ void* VG_(arena_realloc) ( ArenaId aid, void* ptr, SizeT req_pszB )
 }
 
 
+// Make the payload at ptr at least req_pszB long without moving it, by
+// taking over the free block after it (or as much of that as needed).
+// Returns False, changing nothing, if the successor isn't free or isn't
+// big enough.
+Bool VG_(arena_grow_in_place) ( ArenaId aid, void* ptr, SizeT req_pszB )
+{
+   Superblock* sb;
+   Block*      b;
+   Block*      other_b;
+   SizeT       b_bszB, other_bszB, req_bszB, frag_bszB, old_pszB;
+   Arena*      a;
+
+   ensure_mm_init(aid);
+   a = arenaId_to_ArenaP(aid);
+
+   vg_assert(req_pszB < MAX_PSZB);
+
+   b = get_payload_block(a, ptr);
+   vg_assert(is_inuse_block(b));
+   b_bszB   = get_bszB(b);
+   old_pszB = bszB_to_pszB(a, b_bszB);
+
+   if (req_pszB <= old_pszB) {
+      return True;
+   }
+   req_pszB = align_req_pszB(req_pszB);
+   req_bszB = pszB_to_bszB(a, req_pszB);
+
+   // Is there a free successor in this superblock?
+   sb      = findSb( a, b );
+   other_b = b + b_bszB;
+   if (other_b+min_useful_bszB(a)-1 
+       > (Block*)&sb->payload_bytes[sb->n_payload_bytes - 1]) {
+      return False;
+   }
+   if (is_inuse_block(other_b)) {
+      return False;
+   }
+   other_bszB = get_bszB(other_b);
+   if (b_bszB + other_bszB < req_bszB) {
+      return False;
+   }
+
+   // Absorb it, splitting off whatever is left if that's still useful.
+   unlinkBlock( a, other_b, pszB_to_listNo(bszB_to_pszB(a, other_bszB)) );
+   frag_bszB = b_bszB + other_bszB - req_bszB;
+   if (frag_bszB >= min_useful_bszB(a)) {
+      mkInuseBlock(a, b, req_bszB);
+      mkFreeBlock(a, &b[req_bszB], frag_bszB, 
+                     pszB_to_listNo(bszB_to_pszB(a, frag_bszB)));
+   } else {
+      mkInuseBlock(a, b, b_bszB + other_bszB);
+   }
+
+   // Update stats
+   a->bytes_on_loan += get_pszB(a, b) - old_pszB;
+   if (a->bytes_on_loan > a->bytes_on_loan_max)
+      a->bytes_on_loan_max = a->bytes_on_loan;
+
+#  ifdef DEBUG_MALLOC
+   sanity_check_malloc_arena(aid);
+#  endif
+
+   return True;
+}
+
+
 /* Inline just for the wrapper VG_(strdup) below */
 __inline__ Char* VG_(arena_strdup) ( ArenaId aid, const Char* s )
 {
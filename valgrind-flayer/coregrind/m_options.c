@@ -77,6 +77,13 @@ Int    VG_(clo_backtrace_size) = 12;
 Char*  VG_(clo_sim_hints)      = NULL;
 Bool   VG_(clo_sym_offsets)    = False;
 Bool   VG_(clo_run_libc_freeres) = True;
+Bool   VG_(clo_lazy_debuginfo) = True;
+HChar* VG_(clo_debuginfo_cache) = NULL;
+Bool   VG_(clo_chain_translations) = True;
+HChar* VG_(clo_translation_cache) = NULL;
+Int    VG_(clo_num_transtab_sectors) = 8;
+Int    VG_(clo_max_transtab_sectors) = 0;
+Int    VG_(clo_avg_transtab_entry_size) = 0;
 Bool   VG_(clo_track_fds)      = False;
 Bool   VG_(clo_show_below_main)= False;
 Bool   VG_(clo_show_emwarns)   = False;
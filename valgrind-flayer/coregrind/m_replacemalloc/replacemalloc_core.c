@@ -108,6 +108,11 @@ void VG_(cli_free) ( void* p )
    VG_(arena_free) ( VG_AR_CLIENT, p );                          
 }
 
+Bool VG_(cli_grow_in_place) ( void* p, SizeT nbytes )
+{
+   return VG_(arena_grow_in_place) ( VG_AR_CLIENT, p, nbytes );
+}
+
 Bool VG_(addr_is_in_block)( Addr a, Addr start, SizeT size, SizeT rz_szB )
 {
    return ( start - rz_szB <= a  &&  a < start + size + rz_szB );
@@ -167,6 +167,7 @@ HChar* name_of_sched_event ( UInt event )
       case VG_TRC_INNER_COUNTERZERO:  return "COUNTERZERO";
       case VG_TRC_INNER_FASTMISS:     return "FASTMISS";
       case VG_TRC_FAULT_SIGNAL:       return "FAULTSIGNAL";
+      case VG_TRC_CHAIN_ME:           return "CHAINME";
       default:                        return "??UNKNOWN??";
   }
 }
@@ -758,6 +759,21 @@ static void handle_tt_miss ( ThreadId tid )
    }
 }
 
+/* A chainable exit was taken, to tid's IP.  If that has a
+   translation already, chain the exit to it.  If not, just make one:
+   doing so might recycle the sector holding the exit, so chaining is
+   left to the next time the exit is taken. */
+static void handle_chain_me ( ThreadId tid )
+{
+   Addr site = VG_(tt_chain_me_site);
+   Addr ip   = VG_(get_IP)(tid);
+
+   if (VG_(search_transtab)( NULL, ip, True/*upd_fast_cache*/ ))
+      VG_(chain_translation)( site, ip );
+   else
+      handle_tt_miss(tid);
+}
+
 static void handle_syscall(ThreadId tid)
 {
    ThreadState *tst = VG_(get_ThreadState)(tid);
@@ -958,6 +974,10 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
 	 vg_assert(VG_(dispatch_ctr) > 1);
 	 handle_tt_miss(tid);
 	 break;
+
+      case VG_TRC_CHAIN_ME:
+         handle_chain_me(tid);
+         break;
 	    
       case VEX_TRC_JMP_CLIENTREQ:
 	 do_client_request(tid);
@@ -985,6 +1005,9 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
       case VG_TRC_INNER_COUNTERZERO:
 	 /* Timeslice is out.  Let a new thread be scheduled. */
 	 vg_assert(VG_(dispatch_ctr) == 1);
+         /* Note what was about to run, so that hot code survives
+            its sector being recycled. */
+         VG_(sample_translation)( VG_(get_IP)(tid) );
 	 break;
 
       case VG_TRC_FAULT_SIGNAL:
@@ -762,6 +762,20 @@ static void ensure_initialised ( void )
    }
 }
 
+/* Called from a tool's pre_syscall function: the syscall about to be
+   done by 'tid' does not go to the kernel, but completes at once with
+   result 'res'.  The post-handlers (core and tool) run as usual. */
+void VG_(tool_complete_syscall) ( ThreadId tid, SysRes res )
+{
+   SyscallInfo* sci;
+   vg_assert(VG_(is_valid_tid)(tid));
+   sci = & syscallInfo[tid];
+   vg_assert(sci->status.what == SsHandToKernel);
+   sci->status.what = SsComplete;
+   sci->status.sres = res;
+}
+
+
 /* --- This is the main function of this file. --- */
 
 void VG_(client_syscall) ( ThreadId tid )
@@ -831,16 +845,19 @@ void VG_(client_syscall) ( ThreadId tid )
 
    PRINT("SYSCALL[%d,%d](%3lld) ", VG_(getpid)(), tid, (ULong)sysno);
 
-   /* Do any pre-syscall actions */
+   /* Do any pre-syscall actions.  The tool may complete the syscall
+      itself (see VG_(tool_complete_syscall)), in which case our own
+      pre-handler has nothing left to do. */
    if (VG_(needs).syscall_wrapper) {
       VG_TDICT_CALL(tool_pre_syscall, tid, sysno);
    }
 
    vg_assert(ent);
    vg_assert(ent->before);
-   (ent->before)( tid,
-                  &layout, 
-                  &sci->args, &sci->status, &sci->flags );
+   if (sci->status.what == SsHandToKernel)
+      (ent->before)( tid,
+                     &layout, 
+                     &sci->args, &sci->status, &sci->flags );
    
    /* The pre-handler may have modified:
          sci->args
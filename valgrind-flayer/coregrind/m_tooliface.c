@@ -94,6 +94,11 @@ VgNeeds VG_(needs) = {
    .data_syms	         = False,
    .malloc_replacement   = False,
    .xml_output           = False,
+   .stack_traces         = False,
+   .error_stream         = False,
+   .error_stream_only    = False,
+   .final_error_counts   = False,
+   .persistent_translations = False,
 };
 
 /* static */
@@ -164,6 +169,14 @@ NEEDS(core_errors)
 NEEDS(data_syms)
 NEEDS(xml_output)
 
+void VG_(needs_persistent_translations)(
+   Bool (*value_affects_code)(Char*)
+)
+{
+   VG_(needs).persistent_translations = True;
+   VG_(tdict).tool_option_value_affects_code = value_affects_code;
+}
+
 void VG_(needs_superblock_discards)(
    void (*discard)(Addr64, VexGuestExtents)
 )
@@ -234,6 +247,32 @@ void VG_(needs_sanity_checks)(
    VG_(tdict).tool_expensive_sanity_check = expen;
 }
 
+void VG_(needs_stack_traces)(
+   UInt (*get_StackTrace)(ThreadId, Addr*, UInt)
+)
+{
+   VG_(needs).stack_traces = True;
+   VG_(tdict).tool_get_StackTrace = get_StackTrace;
+}
+
+void VG_(needs_error_stream)(
+   void (*recorded)(Error*, Bool),
+   Bool log_errors
+)
+{
+   VG_(needs).error_stream      = True;
+   VG_(needs).error_stream_only = !log_errors;
+   VG_(tdict).tool_error_recorded = recorded;
+}
+
+void VG_(needs_final_error_counts)(
+   UInt (*more_occurrences)(Error*)
+)
+{
+   VG_(needs).final_error_counts = True;
+   VG_(tdict).tool_more_occurrences = more_occurrences;
+}
+
 void VG_(needs_malloc_replacement)(
    void* (*malloc)               ( ThreadId, SizeT ),
    void* (*__builtin_new)        ( ThreadId, SizeT ),
@@ -1195,6 +1195,30 @@ Bool VG_(translate) ( ThreadId tid,
       verbosity = VG_(clo_trace_flags);
    }
 
+   /* Set up closure args. */
+   closure.tid    = tid;
+   closure.nraddr = nraddr;
+   closure.readdr = addr;
+
+   /* Has an earlier run left a translation we can use?  Not if this
+      one is to be traced, self-checking or unredirected. */
+   if (!debugging_translation && verbosity == 0
+       && !do_self_check && kind != T_NoRedir) {
+      AddrH pcode;
+      UInt  pcode_len;
+      if (VG_(find_persisted_translation)( nraddr, addr,
+                                           chase_into_ok, &closure,
+                                           &vge, &pcode, &pcode_len )) {
+         for (i = 0; i < vge.n_used; i++) {
+            NSegment const* pseg = VG_(am_find_nsegment)( vge.base[i] );
+            VG_(am_set_segment_hasT_if_SkFileC_or_SkAnonC)( (NSegment*)pseg );
+         }
+         VG_(add_to_transtab)( &vge, nraddr, pcode, pcode_len,
+                               False/*!is_self_checking*/ );
+         return True;
+      }
+   }
+
    /* Figure out which preamble-mangling callback to send. */
    preamble_fn = NULL;
    if (kind == T_Redir_Replace)
@@ -1247,11 +1271,6 @@ Bool VG_(translate) ( ThreadId tid,
    vex_abiinfo.host_ppc_calls_use_fndescrs    = True;
 #  endif
 
-   /* Set up closure args. */
-   closure.tid    = tid;
-   closure.nraddr = nraddr;
-   closure.readdr = addr;
-
    /* Set up args for LibVEX_Translate. */
    vta.arch_guest       = vex_arch;
    vta.archinfo_guest   = vex_archinfo;
@@ -1312,6 +1331,18 @@ Bool VG_(translate) ( ThreadId tid,
 #    error "Unknown arch"
 #  endif
 
+   /* Have exits to constant addresses made chainable, except in
+      no-redir translations, which live outside the main TT/TC and
+      are run by their own dispatcher.  See m_transtab.c. */
+#  if defined(VGA_x86)
+   vta.dispatch_chain_me
+      = (allow_redirection && VG_(clo_chain_translations))
+        ? (void*) VG_(run_innerloop__chain_me)
+        : NULL;
+#  else
+   vta.dispatch_chain_me = NULL;
+#  endif
+
    /* Sheesh.  Finally, actually _do_ the translation! */
    tres = LibVEX_Translate ( &vta );
 
@@ -1319,6 +1350,12 @@ Bool VG_(translate) ( ThreadId tid,
    vg_assert(tmpbuf_used <= N_TMPBUF);
    vg_assert(tmpbuf_used > 0);
 
+   /* Offer it to --translation-cache, before anything is chained to
+      or from it. */
+   VG_(persist_translation)( !debugging_translation && !do_self_check
+                                && kind != T_NoRedir,
+                             &vge, nraddr, (AddrH)&tmpbuf[0], tmpbuf_used );
+
    /* Tell aspacem of all segments that have had translations taken
       from them.  Optimisation: don't re-look up vge.base[0] since seg
       should already point to it. */
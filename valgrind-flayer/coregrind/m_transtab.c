@@ -30,16 +30,23 @@
 */
 
 #include "pub_core_basics.h"
+#include "pub_core_vki.h"
 #include "pub_core_debuglog.h"
+#include "pub_core_dispatch.h"   // For VG_(run_innerloop__chain_me) etc
 #include "pub_core_machine.h"    // For VG(machine_get_VexArchInfo)
 #include "pub_core_libcbase.h"
 #include "pub_core_libcassert.h"
+#include "pub_core_libcfile.h"
 #include "pub_core_libcprint.h"
+#include "pub_core_libcproc.h"    // For VG_(getpid)
 #include "pub_core_options.h"
+#include "pub_core_threadstate.h" // For VG_O_INSTR_PTR
 #include "pub_core_tooliface.h"  // For VG_(details).avg_translation_sizeB
 #include "pub_core_transtab.h"
 #include "pub_core_aspacemgr.h"
 #include "pub_core_mallocfree.h" // VG_(out_of_memory_NORETURN)
+#include "pub_core_xarray.h"
+#include "pub_core_clientstate.h" // For VG_(args_for_valgrind)
 
 /* #define DEBUG_TRANSTAB */
 
@@ -50,9 +57,11 @@
 
 /*------------------ CONSTANTS ------------------*/
 
-/* Number of sectors the TC is divided into.  If you need a larger
-   overall translation cache, increase this value. */
-#define N_SECTORS 8
+/* Most sectors the TC can be divided into.  How many are used to
+   start with is set by --num-transtab-sectors, and the cache grows
+   under pressure up to --max-transtab-sectors; see "Keeping hot
+   translations" below. */
+#define MAX_N_SECTORS VG_MAX_TRANSTAB_SECTORS
 
 /* Number of TC entries in each sector.  This needs to be a prime
    number to work properly, it must be <= 65535 (so that a TT index
@@ -81,20 +90,46 @@
 
 #define EC2TTE_DELETED  0xFFFF /* 16-bit special value */
 
+/* When a sector is recycled, at most this much of the new one, by
+   both code and entries, is given to translations kept from it. */
+#define MIGRATE_LIMIT_PERCENT 25
+
+/* Add a sector, rather than recycle one, if at least this many of the
+   translations made while filling the last sector were of code thrown
+   out by an earlier recycle. */
+#define GROW_RETRANS_PERCENT 25
+
+/* Size of the bitmap remembering which entry addresses have been
+   thrown out. */
+#define DUMPED_BITS (1 << 20)
+
 
 /*------------------ TYPES ------------------*/
 
+/* An exit, in the code of sector .sno, which has been patched to jump
+   straight to another translation (see "Chaining" below).  .site is
+   the address just past the exit, as pushed by its call to
+   VG_(run_innerloop__chain_me). */
+typedef
+   struct {
+      Addr site;
+      Int  sno;
+   }
+   ChainSite;
+
 /* A translation-table entry.  This indicates precisely which areas of
    guest code are included in the translation, and contains all other
    auxiliary info too.  */
 typedef
    struct {
-      /* Profiling only: the count and weight (arbitrary meaning) for
-         this translation.  Weight is a property of the translation
-         itself and computed once when the translation is created.
-         Count is an entry count for the translation and is
-         incremented by 1 every time the translation is used, if we
-         are profiling. */
+      /* The count and weight (arbitrary meaning) for this
+         translation.  Weight is a property of the translation itself
+         and computed once when the translation is created.  If we are
+         profiling, count is an entry count for the translation and is
+         incremented by 1 every time the translation is used.
+         Otherwise it is the number of timeslices which have ended
+         just as it was about to run (see VG_(sample_translation))
+         since it was made or last moved to a new sector. */
       UInt     count;
       UShort   weight;
 
@@ -107,6 +142,10 @@ typedef
          This is a pointer into the sector's tc (code) area. */
       ULong* tcptr;
 
+      /* The length of the code at tcptr, not counting the chain
+         entry stub in front of it. */
+      UInt code_len;
+
       /* This is the original guest address that purportedly is the
          entry point of the translation.  You might think that .entry
          should be the same as .vge->base[0], and most of the time it
@@ -136,6 +175,14 @@ typedef
       //    sec->ec2tte[ tte2ec_ec[i] ][ tte2ec_ix[i] ] 
       // should be the index 
       // of this TTEntry in the containing Sector's tt array.
+
+      /* The exits, in any sector, which jump straight to this
+         translation's chain entry point, and so have to be put back
+         when it goes away.  Always empty unless
+         --chain-translations=yes. */
+      UInt       n_chained_from;
+      UInt       size_chained_from;
+      ChainSite* chained_from;
    }
    TTEntry;
 
@@ -180,19 +227,25 @@ typedef
 
 /*------------------ DECLS ------------------*/
 
-/* The root data structure is an array of sectors.  The index of the
-   youngest sector is recorded, and new translations are put into that
-   sector.  When it fills up, we move along to the next sector and
-   start to fill that up, wrapping around at the end of the array.
-   That way, once all N_TC_SECTORS have been bought into use for the
-   first time, and are full, we then re-use the oldest sector,
-   endlessly. 
+/* The root data structure is an array of sectors, the first
+   n_sectors of which are in use, in the order given by sector_ring.
+   The index of the youngest sector is recorded, and new translations
+   are put into that sector.  When it fills up, we move along to the
+   next sector in the ring and start to fill that up, wrapping around
+   at the end.  That way, once all n_sectors have been bought into use
+   for the first time, and are full, we then re-use the oldest sector,
+   endlessly -- unless the cache is found to be too small, in which
+   case a new sector is put into the ring just after the youngest.
 
    When running, youngest sector should be between >= 0 and <
-   N_TC_SECTORS.  The initial -1 value indicates the TT/TC system is
-   not yet initialised. 
+   n_sectors, and sector_ring[youngest_pos] == youngest_sector.  The
+   initial -1 value indicates the TT/TC system is not yet
+   initialised.
 */
-static Sector sectors[N_SECTORS];
+static Sector sectors[MAX_N_SECTORS];
+static Int    n_sectors = 0;
+static Int    sector_ring[MAX_N_SECTORS];
+static Int    youngest_pos = 0;
 static Int    youngest_sector = -1;
 
 /* The number of ULongs in each TCEntry area.  This is computed once
@@ -278,6 +331,25 @@ ULong n_dump_osize = 0;
 ULong n_disc_count = 0;
 ULong n_disc_osize = 0;
 
+/* Number of exits chained, and put back again. */
+ULong n_chained   = 0;
+ULong n_unchained = 0;
+
+/* Number/tsize of translations kept when their sector was recycled,
+   number of translations of code which had been thrown out by an
+   earlier recycle, and number of sectors added under pressure. */
+ULong n_migr_count = 0;
+ULong n_migr_tsize = 0;
+ULong n_retrans    = 0;
+ULong n_grown      = 0;
+
+/* Number of translations read from --translation-cache, used in place
+   of new ones, found to be out of date, and written back. */
+ULong n_pt_loaded = 0;
+ULong n_pt_reused = 0;
+ULong n_pt_stale  = 0;
+ULong n_pt_saved  = 0;
+
 
 /*-------------------------------------------------------------*/
 /*--- Address-range equivalence class stuff                 ---*/
@@ -567,7 +639,7 @@ static Bool sanity_check_all_sectors ( void )
    Int     sno;
    Bool    sane;
    Sector* sec;
-   for (sno = 0; sno < N_SECTORS; sno++) {
+   for (sno = 0; sno < n_sectors; sno++) {
       sec = &sectors[sno];
       if (sec->tc == NULL)
          continue;
@@ -597,7 +669,7 @@ static UInt vge_osize ( VexGuestExtents* vge )
 
 static Bool isValidSector ( Int sector )
 {
-   if (sector < 0 || sector >= N_SECTORS)
+   if (sector < 0 || sector >= n_sectors)
       return False;
    return True;
 }
@@ -688,21 +760,446 @@ static Bool sanity_check_fastcache ( void )
    return True;
 }
 
+
+/*-------------------------------------------------------------*/
+/*--- Chaining.                                             ---*/
+/*-------------------------------------------------------------*/
+
+/* With --chain-translations=yes (x86 only), VEX makes each exit to a
+   constant guest address call VG_(run_innerloop__chain_me) (see
+   VexTranslateArgs.dispatch_chain_me).  The scheduler then finds the
+   next translation, and VG_(chain_translation) overwrites the exit's
+
+      movl $VG_(run_innerloop__chain_me), %edx ; call *%edx
+
+   with
+
+      jmp <next translation's chain entry point> ; ud2
+
+   so that from then on control goes straight there.  The chain entry
+   point is a stub which add_to_transtab puts in front of each
+   translation, to do what the dispatcher would otherwise have done:
+
+      movl %eax, OFFSET_x86_EIP(%ebp)
+      subl $1, VG_(dispatch_ctr)
+      jz   VG_(run_innerloop__counter_is_zero)
+
+   Chains may cross sectors.  A translation records the exits chained
+   to it, and puts them back when it is deleted or its sector is
+   recycled.  A recycled sector's own exits are also struck off the
+   records of the translations they were chained to, as the code they
+   are in is about to be overwritten. */
+
+#define CHAIN_SITE_SZB   7
+#define CHAIN_ENTRY_SZB  19
+/* The stub is padded in front to a whole number of ULongs, so that
+   translations stay 8-aligned. */
+#define CHAIN_ENTRY_SZQ  ((CHAIN_ENTRY_SZB + 7) / 8)
+
+/* Set by the dispatcher; see pub_core_transtab.h. */
+/*global*/ Addr VG_(tt_chain_me_site) = 0;
+
+/* forward */
+static void invalidate_icache ( void *ptr, Int nbytes );
+
+#if defined(VGA_x86)
+static void put32 ( UChar* p, UInt w )
+{
+   p[0] = toUChar(w);
+   p[1] = toUChar(w >> 8);
+   p[2] = toUChar(w >> 16);
+   p[3] = toUChar(w >> 24);
+}
+
+static UInt get32 ( UChar* p )
+{
+   return ((UInt)p[0]) | (((UInt)p[1]) << 8) 
+          | (((UInt)p[2]) << 16) | (((UInt)p[3]) << 24);
+}
+#endif
+
+/* Write the chain entry stub into the CHAIN_ENTRY_SZQ ULongs before
+   code. */
+static void emit_chain_entry ( UChar* code )
+{
+#  if defined(VGA_x86)
+   UChar* p = code - CHAIN_ENTRY_SZB;
+   UChar* q;
+   for (q = code - 8 * CHAIN_ENTRY_SZQ; q < p; q++)
+      *q = 0x90; /* nop */
+   /* movl %eax, OFFSET_x86_EIP(%ebp) */
+   p[0] = 0x89; p[1] = 0x85;
+   put32(&p[2], VG_O_INSTR_PTR);
+   /* subl $1, VG_(dispatch_ctr) */
+   p[6] = 0x83; p[7] = 0x2D;
+   put32(&p[8], (UInt)&VG_(dispatch_ctr));
+   p[12] = 0x01;
+   /* jz VG_(run_innerloop__counter_is_zero) */
+   p[13] = 0x0F; p[14] = 0x84;
+   put32(&p[15], (UInt)VG_(run_innerloop__counter_is_zero) - (UInt)code);
+#  else
+   vg_assert(0); /* --chain-translations is x86 only */
+#  endif
+}
+
+/* Make the exit ending at site jump to target. */
+static void patch_chain_site ( Addr site, UChar* target )
+{
+#  if defined(VGA_x86)
+   UChar* p = (UChar*)(site - CHAIN_SITE_SZB);
+   /* It must still be: movl $VG_(run_innerloop__chain_me), %edx ;
+      call *%edx */
+   vg_assert(p[0] == 0xBA && p[5] == 0xFF && p[6] == 0xD2);
+   vg_assert(get32(&p[1]) == (UInt)VG_(run_innerloop__chain_me));
+   /* jmp target ; ud2 */
+   p[0] = 0xE9;
+   put32(&p[1], (UInt)target - (UInt)&p[5]);
+   p[5] = 0x0F; p[6] = 0x0B;
+   invalidate_icache( p, CHAIN_SITE_SZB );
+#  else
+   vg_assert(0); /* --chain-translations is x86 only */
+#  endif
+}
+
+/* Undo patch_chain_site. */
+static void unpatch_chain_site ( Addr site )
+{
+#  if defined(VGA_x86)
+   UChar* p = (UChar*)(site - CHAIN_SITE_SZB);
+   vg_assert(p[0] == 0xE9 && p[5] == 0x0F && p[6] == 0x0B);
+   /* movl $VG_(run_innerloop__chain_me), %edx ; call *%edx */
+   p[0] = 0xBA;
+   put32(&p[1], (UInt)VG_(run_innerloop__chain_me));
+   p[5] = 0xFF; p[6] = 0xD2;
+   invalidate_icache( p, CHAIN_SITE_SZB );
+#  else
+   vg_assert(0); /* --chain-translations is x86 only */
+#  endif
+}
+
+/* Note that the exit ending at site, in sector sno, now jumps to
+   tte. */
+static void add_chained_from ( TTEntry* tte, Addr site, Int sno )
+{
+   UInt       old_sz, new_sz, i;
+   ChainSite *old_ar, *new_ar;
+
+   if (tte->n_chained_from >= tte->size_chained_from) {
+      old_sz = tte->size_chained_from;
+      old_ar = tte->chained_from;
+      new_sz = old_sz==0 ? 4 : 2*old_sz;
+      new_ar = VG_(arena_malloc)(VG_AR_TTAUX, new_sz * sizeof(ChainSite));
+      for (i = 0; i < old_sz; i++)
+         new_ar[i] = old_ar[i];
+      if (old_ar)
+         VG_(arena_free)(VG_AR_TTAUX, old_ar);
+      tte->size_chained_from = new_sz;
+      tte->chained_from = new_ar;
+   }
+
+   i = tte->n_chained_from++;
+   tte->chained_from[i].site = site;
+   tte->chained_from[i].sno  = sno;
+}
+
+/* tte is going away: put back every exit chained to it, so that they
+   go through the dispatcher again. */
+static void unchain_tte ( TTEntry* tte )
+{
+   UInt i;
+   for (i = 0; i < tte->n_chained_from; i++)
+      unpatch_chain_site( tte->chained_from[i].site );
+   n_unchained += tte->n_chained_from;
+   if (tte->chained_from)
+      VG_(arena_free)(VG_AR_TTAUX, tte->chained_from);
+   tte->n_chained_from    = 0;
+   tte->size_chained_from = 0;
+   tte->chained_from      = NULL;
+}
+
+/* Sector sno is being recycled.  Put back its exits which are
+   chained to translations in other sectors, and strike them off those
+   translations' records, so that nothing tries to put them back once
+   new code is in their place.  Putting them back matters only for the
+   translations kept from the sector, whose code is moved: a chained
+   exit's jump is relative to where it is. */
+static void forget_chains_from_sector ( Int sno )
+{
+   Int      s, i;
+   UInt     j, k;
+   TTEntry* tte;
+
+   for (s = 0; s < n_sectors; s++) {
+      if (s == sno || sectors[s].tt == NULL)
+         continue;
+      for (i = 0; i < N_TTES_PER_SECTOR; i++) {
+         tte = &sectors[s].tt[i];
+         if (tte->status != InUse || tte->n_chained_from == 0)
+            continue;
+         k = 0;
+         for (j = 0; j < tte->n_chained_from; j++) {
+            if (tte->chained_from[j].sno != sno) {
+               tte->chained_from[k++] = tte->chained_from[j];
+            } else {
+               unpatch_chain_site( tte->chained_from[j].site );
+               n_unchained++;
+            }
+         }
+         tte->n_chained_from = k;
+      }
+   }
+}
+
+/* Which sector's tc holds a, or -1. */
+static Int sector_of_code ( Addr a )
+{
+   Int sno;
+   for (sno = 0; sno < n_sectors; sno++) {
+      if (sectors[sno].tc != NULL
+          && a >= (Addr)&sectors[sno].tc[0]
+          && a <  (Addr)&sectors[sno].tc[tc_sector_szQ])
+         return sno;
+   }
+   return -1;
+}
+
+/*-------------------------------------------------------------*/
+/*--- Keeping hot translations.                             ---*/
+/*-------------------------------------------------------------*/
+
+/* Recycling the oldest sector wholesale throws out everything in it,
+   including the hottest loops of a program too big for the cache,
+   which then have to be translated again, and again.  Two things make
+   that rarer:
+
+   - Each time a timeslice ends, the scheduler calls
+     VG_(sample_translation) for the translation about to run, which
+     adds one to its .count: a lookup per SCHEDULING_QUANTUM blocks.
+     When a sector is recycled, its translations which have been
+     sampled are moved to the start of it, the most sampled first, up
+     to MIGRATE_LIMIT_PERCENT of the sector, and their counts start
+     again from zero.  Only what is left is thrown out.
+
+   - Recycling notes which entry addresses it threw out, in
+     dumped_bits.  If GROW_RETRANS_PERCENT of the translations made
+     while filling the youngest sector were of those, the cache is too
+     small for the program, and rather than recycle the oldest sector,
+     a new one is put into the ring, up to --max-transtab-sectors.
+     The bits are cleared once every sector has been recycled since
+     they last were.
+
+   With --profile-flags, .count is an exact entry count and the oldest
+   sector is always recycled as it is, so neither is done. */
+
+typedef
+   struct {
+      Int    tteno;
+      UInt   count;
+      ULong* tcptr;
+   }
+   Migrant;
+
+static UChar dumped_bits[DUMPED_BITS / 8];
+static Int   recycles_since_clear = 0;
+
+/* For the translations made while filling the youngest sector. */
+static ULong in_count_at_switch = 0;
+static ULong retrans_at_switch  = 0;
+
+/* Which of the recycled sector's translations are being kept. */
+static UChar migrating[(N_TTES_PER_SECTOR + 7) / 8];
+
+static inline Bool keeping_hot ( void )
+{
+   return VG_(clo_profile_flags) == 0;
+}
+
+static inline UInt dumped_bit ( Addr64 entry )
+{
+   UInt k = (UInt)entry ^ (UInt)(entry >> 32);
+   return (k ^ (k >> 20)) & (DUMPED_BITS - 1);
+}
+
+static inline Bool is_set ( UChar* bits, UInt i )
+{
+   return (bits[i >> 3] & (1 << (i & 7))) != 0;
+}
+
+static inline void set_bit ( UChar* bits, UInt i )
+{
+   bits[i >> 3] |= (1 << (i & 7));
+}
+
+/* How many ULongs of tc a translation of code_len bytes takes. */
+static Int code_szQ ( UInt code_len )
+{
+   Int reqdQ = (code_len + 7) >> 3;
+   if (VG_(clo_chain_translations))
+      reqdQ += CHAIN_ENTRY_SZQ;
+   return reqdQ;
+}
+
+static Int cmp_Migrant_by_count ( void* v1, void* v2 )
+{
+   Migrant* m1 = (Migrant*)v1;
+   Migrant* m2 = (Migrant*)v2;
+   if (m1->count > m2->count) return -1;
+   if (m1->count < m2->count) return 1;
+   return 0;
+}
+
+static Int cmp_Migrant_by_tcptr ( void* v1, void* v2 )
+{
+   Migrant* m1 = (Migrant*)v1;
+   Migrant* m2 = (Migrant*)v2;
+   if (m1->tcptr < m2->tcptr) return -1;
+   if (m1->tcptr > m2->tcptr) return 1;
+   return 0;
+}
+
+/* Choose which of sector sno's translations to keep when it is
+   recycled, and mark them in migrating[].  Returns how many, in
+   *res (in VG_AR_TTAUX, or NULL if none), in order of address: moving
+   them down to the start of the sector in that order never overwrites
+   one not yet moved. */
+static Int choose_migrants ( Int sno, /*OUT*/Migrant** res )
+{
+   Sector*  sec   = &sectors[sno];
+   Int      limQ  = (tc_sector_szQ * MIGRATE_LIMIT_PERCENT) / 100;
+   Int      limN  = (N_TTES_PER_SECTOR_USABLE * MIGRATE_LIMIT_PERCENT)
+                    / 100;
+   Migrant* ms;
+   Int      i, n, n_kept, usedQ;
+
+   VG_(memset)(migrating, 0, sizeof(migrating));
+   *res = NULL;
+
+   n = 0;
+   for (i = 0; i < N_TTES_PER_SECTOR; i++)
+      if (sec->tt[i].status == InUse && sec->tt[i].count > 0)
+         n++;
+   if (n == 0)
+      return 0;
+
+   ms = VG_(arena_malloc)(VG_AR_TTAUX, n * sizeof(Migrant));
+   n = 0;
+   for (i = 0; i < N_TTES_PER_SECTOR; i++) {
+      if (sec->tt[i].status == InUse && sec->tt[i].count > 0) {
+         ms[n].tteno = i;
+         ms[n].count = sec->tt[i].count;
+         ms[n].tcptr = sec->tt[i].tcptr;
+         n++;
+      }
+   }
+
+   VG_(ssort)(ms, n, sizeof(Migrant), cmp_Migrant_by_count);
+   n_kept = 0;
+   usedQ  = 0;
+   for (i = 0; i < n && n_kept < limN; i++) {
+      Int reqdQ = code_szQ(sec->tt[ms[i].tteno].code_len);
+      if (usedQ + reqdQ > limQ)
+         continue;
+      usedQ += reqdQ;
+      ms[n_kept++] = ms[i];
+      set_bit(migrating, ms[i].tteno);
+   }
+   VG_(ssort)(ms, n_kept, sizeof(Migrant), cmp_Migrant_by_tcptr);
+
+   *res = ms;
+   return n_kept;
+}
+
+/* forward */
+static void add_to_sector ( Int y, VexGuestExtents* vge, Addr64 entry,
+                            UChar* code, UInt code_len );
+
+/* Map sector sno's tc and tt.  False if there isn't the space. */
+static Bool allocate_sector ( Int sno )
+{
+   Sector* sec = &sectors[sno];
+   SysRes  sres;
+
+   vg_assert(sec->tc == NULL && sec->tt == NULL);
+   sres = VG_(am_mmap_anon_float_valgrind)( 8 * tc_sector_szQ );
+   if (sres.isError)
+      return False;
+   sec->tc = (ULong*)sres.res;
+
+   sres = VG_(am_mmap_anon_float_valgrind)
+             ( N_TTES_PER_SECTOR * sizeof(TTEntry) );
+   if (sres.isError) {
+      sres = VG_(am_munmap_valgrind)( (Addr)sec->tc, 8 * tc_sector_szQ );
+      vg_assert(!sres.isError);
+      sec->tc = NULL;
+      return False;
+   }
+   sec->tt = (TTEntry*)sres.res;
+   return True;
+}
+
+/* The youngest sector is full.  Move on to the next one in the ring,
+   or, if that would mean recycling a sector while code is being
+   thrown out and retranslated, put a new sector after the youngest --
+   if there is room for one; otherwise recycle after all, and stop
+   trying to grow.  Returns the new youngest sector, which the caller
+   must initialise. */
+static Int advance_youngest_sector ( void )
+{
+   Int   i, next_pos;
+   ULong made   = n_in_count - in_count_at_switch;
+   ULong redone = n_retrans  - retrans_at_switch;
+
+   in_count_at_switch = n_in_count;
+   retrans_at_switch  = n_retrans;
+
+   next_pos = youngest_pos + 1;
+   if (next_pos >= n_sectors)
+      next_pos = 0;
+
+   if (sectors[sector_ring[next_pos]].tc != NULL
+       && keeping_hot()
+       && n_sectors < VG_(clo_max_transtab_sectors)
+       && 100 * redone >= GROW_RETRANS_PERCENT * made) {
+      if (!allocate_sector(n_sectors)) {
+         VG_(debugLog)(1,"transtab",
+                         "can't grow past %d sectors: out of memory\n",
+                         n_sectors);
+         VG_(clo_max_transtab_sectors) = n_sectors;
+         goto recycle;
+      }
+      for (i = n_sectors; i > youngest_pos + 1; i--)
+         sector_ring[i] = sector_ring[i-1];
+      sector_ring[youngest_pos + 1] = n_sectors;
+      next_pos = youngest_pos + 1;
+      n_sectors++;
+      n_grown++;
+      VG_(debugLog)(1,"transtab",
+                      "grow to %d sectors (%lld of last %lld "
+                      "translations were of code thrown out)\n",
+                      n_sectors, redone, made);
+   }
+
+  recycle:
+   youngest_pos    = next_pos;
+   youngest_sector = sector_ring[next_pos];
+   return youngest_sector;
+}
+
+
 static void initialiseSector ( Int sno )
 {
-   Int    i;
-   SysRes sres;
-   Sector* sec;
+   Int      i, n_migrants = 0;
+   Sector*  sec;
+   Migrant* migrants = NULL;
+   TTEntry* kept = NULL;
    vg_assert(isValidSector(sno));
 
    sec = &sectors[sno];
 
-   if (sec->tc == NULL) {
+   if (sec->tc_next == NULL) {
 
       /* Sector has never been used before.  Need to allocate tt and
-         tc. */
-      vg_assert(sec->tt == NULL);
-      vg_assert(sec->tc_next == NULL);
+         tc, unless advance_youngest_sector already has. */
       vg_assert(sec->tt_n_inuse == 0);
       for (i = 0; i < ECLASS_N; i++) {
          vg_assert(sec->ec2tte_size[i] == 0);
@@ -712,26 +1209,19 @@ static void initialiseSector ( Int sno )
 
       VG_(debugLog)(1,"transtab", "allocate sector %d\n", sno);
 
-      sres = VG_(am_mmap_anon_float_valgrind)( 8 * tc_sector_szQ );
-      if (sres.isError) {
-         VG_(out_of_memory_NORETURN)("initialiseSector(TC)", 
-                                     8 * tc_sector_szQ );
-	 /*NOTREACHED*/
-      }
-      sec->tc = (ULong*)sres.res;
-
-      sres = VG_(am_mmap_anon_float_valgrind)
-                ( N_TTES_PER_SECTOR * sizeof(TTEntry) );
-      if (sres.isError) {
-         VG_(out_of_memory_NORETURN)("initialiseSector(TT)", 
-                                     N_TTES_PER_SECTOR * sizeof(TTEntry) );
+      if (sec->tc == NULL && !allocate_sector(sno)) {
+         VG_(out_of_memory_NORETURN)("initialiseSector", 
+                                     8 * tc_sector_szQ
+                                     + N_TTES_PER_SECTOR * sizeof(TTEntry) );
 	 /*NOTREACHED*/
       }
-      sec->tt = (TTEntry*)sres.res;
 
       for (i = 0; i < N_TTES_PER_SECTOR; i++) {
          sec->tt[i].status   = Empty;
          sec->tt[i].n_tte2ec = 0;
+         sec->tt[i].n_chained_from    = 0;
+         sec->tt[i].size_chained_from = 0;
+         sec->tt[i].chained_from      = NULL;
       }
 
       if (VG_(clo_verbosity) > 2)
@@ -739,23 +1229,51 @@ static void initialiseSector ( Int sno )
 
    } else {
 
-      /* Sector has been used before.  Dump the old contents. */
+      /* Sector has been used before.  Dump the old contents, except
+         for the hot translations, which are moved down to the start
+         of it. */
       VG_(debugLog)(1,"transtab", "recycle sector %d\n", sno);
       vg_assert(sec->tt != NULL);
       vg_assert(sec->tc_next != NULL);
-      n_dump_count += sec->tt_n_inuse;
+
+      /* First put back every chained exit into or out of the sector,
+         so that the code to be kept can be moved. */
+      if (VG_(clo_chain_translations)) {
+         forget_chains_from_sector(sno);
+         for (i = 0; i < N_TTES_PER_SECTOR; i++)
+            if (sec->tt[i].status == InUse)
+               unchain_tte(&sec->tt[i]);
+      }
+
+      if (keeping_hot()) {
+         n_migrants = choose_migrants(sno, &migrants);
+         if (n_migrants > 0)
+            kept = VG_(arena_malloc)(VG_AR_TTAUX,
+                                     n_migrants * sizeof(TTEntry));
+         for (i = 0; i < n_migrants; i++)
+            kept[i] = sec->tt[migrants[i].tteno];
+         if (++recycles_since_clear >= n_sectors) {
+            VG_(memset)(dumped_bits, 0, sizeof(dumped_bits));
+            recycles_since_clear = 0;
+         }
+      }
 
       /* Visit each just-about-to-be-abandoned translation. */
       for (i = 0; i < N_TTES_PER_SECTOR; i++) {
          if (sec->tt[i].status == InUse) {
             vg_assert(sec->tt[i].n_tte2ec >= 1);
             vg_assert(sec->tt[i].n_tte2ec <= 3);
-            n_dump_osize += vge_osize(&sec->tt[i].vge);
-            /* Tell the tool too. */
-            if (VG_(needs).superblock_discards) {
-               VG_TDICT_CALL( tool_discard_superblock_info,
-                              sec->tt[i].entry,
-                              sec->tt[i].vge );
+            if (n_migrants == 0 || !is_set(migrating, i)) {
+               n_dump_count++;
+               n_dump_osize += vge_osize(&sec->tt[i].vge);
+               if (keeping_hot())
+                  set_bit(dumped_bits, dumped_bit(sec->tt[i].entry));
+               /* Tell the tool too. */
+               if (VG_(needs).superblock_discards) {
+                  VG_TDICT_CALL( tool_discard_superblock_info,
+                                 sec->tt[i].entry,
+                                 sec->tt[i].vge );
+               }
             }
          } else {
             vg_assert(sec->tt[i].n_tte2ec == 0);
@@ -785,6 +1303,23 @@ static void initialiseSector ( Int sno )
    sec->tc_next = sec->tc;
    sec->tt_n_inuse = 0;
 
+   /* Move the kept translations down, in order of address, each to
+      no higher than it was. */
+   for (i = 0; i < n_migrants; i++) {
+      vg_assert(kept[i].tcptr == migrants[i].tcptr);
+      add_to_sector( sno, &kept[i].vge, kept[i].entry,
+                     (UChar*)kept[i].tcptr, kept[i].code_len );
+      n_migr_count++;
+      n_migr_tsize += kept[i].code_len;
+   }
+   if (n_migrants > 0)
+      VG_(debugLog)(1,"transtab", "kept %d translations in sector %d\n",
+                      n_migrants, sno);
+   if (migrants)
+      VG_(arena_free)(VG_AR_TTAUX, migrants);
+   if (kept)
+      VG_(arena_free)(VG_AR_TTAUX, kept);
+
    invalidateFastCache();
 }
 
@@ -826,75 +1361,21 @@ static void invalidate_icache ( void *ptr, Int nbytes )
 }
 
 
-/* Add a translation of vge to TT/TC.  The translation is temporarily
-   in code[0 .. code_len-1].
-
-   pre: youngest_sector points to a valid (although possibly full)
-   sector.
+/* Put a translation of vge, which is in code[0 .. code_len-1], into
+   sector y, which must have room for it.  code may be in y's own tc,
+   when a translation is being kept by initialiseSector, so long as it
+   is no lower than where it is going.
 */
-void VG_(add_to_transtab)( VexGuestExtents* vge,
-                           Addr64           entry,
-                           AddrH            code,
-                           UInt             code_len,
-                           Bool             is_self_checking )
+static void add_to_sector ( Int y, VexGuestExtents* vge, Addr64 entry,
+                            UChar* code, UInt code_len )
 {
-   Int    tcAvailQ, reqdQ, y, i;
+   Int    tcAvailQ, reqdQ, i;
    ULong  *tcptr, *tcptr2;
    UChar* srcP;
    UChar* dstP;
 
-   vg_assert(init_done);
-   vg_assert(vge->n_used >= 1 && vge->n_used <= 3);
-
-   /* 60000: should agree with N_TMPBUF in m_translate.c. */
-   vg_assert(code_len > 0 && code_len < 60000);
-
-   if (0)
-      VG_(printf)("add_to_transtab(entry = 0x%llx, len = %d)\n",
-                  entry, code_len);
-
-   n_in_count++;
-   n_in_tsize += code_len;
-   n_in_osize += vge_osize(vge);
-   if (is_self_checking)
-      n_in_sc_count++;
-
-   y = youngest_sector;
    vg_assert(isValidSector(y));
-
-   if (sectors[y].tc == NULL)
-      initialiseSector(y);
-
-   /* Try putting the translation in this sector. */
-   reqdQ = (code_len + 7) >> 3;
-
-   /* Will it fit in tc? */
-   tcAvailQ = ((ULong*)(&sectors[y].tc[tc_sector_szQ]))
-              - ((ULong*)(sectors[y].tc_next));
-   vg_assert(tcAvailQ >= 0);
-   vg_assert(tcAvailQ <= tc_sector_szQ);
-
-   if (tcAvailQ < reqdQ 
-       || sectors[y].tt_n_inuse >= N_TTES_PER_SECTOR_USABLE) {
-      /* No.  So move on to the next sector.  Either it's never been
-         used before, in which case it will get its tt/tc allocated
-         now, or it has been used before, in which case it is set to be
-         empty, hence throwing out the oldest sector. */
-      vg_assert(tc_sector_szQ > 0);
-      VG_(debugLog)(1,"transtab", 
-                      "declare sector %d full "
-                      "(TT loading %2d%%, TC loading %2d%%)\n",
-                      y,
-                      (100 * sectors[y].tt_n_inuse) 
-                         / N_TTES_PER_SECTOR,
-                      (100 * (tc_sector_szQ - tcAvailQ)) 
-                         / tc_sector_szQ);
-      youngest_sector++;
-      if (youngest_sector >= N_SECTORS)
-         youngest_sector = 0;
-      y = youngest_sector;
-      initialiseSector(y);
-   }
+   reqdQ = code_szQ(code_len);
 
    /* Be sure ... */
    tcAvailQ = ((ULong*)(&sectors[y].tc[tc_sector_szQ]))
@@ -910,14 +1391,22 @@ void VG_(add_to_transtab)( VexGuestExtents* vge,
    vg_assert(tcptr >= &sectors[y].tc[0]);
    vg_assert(tcptr <= &sectors[y].tc[tc_sector_szQ]);
 
+   if (VG_(clo_chain_translations))
+      tcptr += CHAIN_ENTRY_SZQ;
+
    dstP = (UChar*)tcptr;
-   srcP = (UChar*)code;
+   srcP = code;
+   vg_assert(dstP <= srcP
+             || srcP >= (UChar*)&sectors[y].tc[tc_sector_szQ]
+             || srcP + code_len <= (UChar*)sectors[y].tc);
    for (i = 0; i < code_len; i++)
       dstP[i] = srcP[i];
+   if (VG_(clo_chain_translations))
+      emit_chain_entry(dstP);
    sectors[y].tc_next += reqdQ;
    sectors[y].tt_n_inuse++;
 
-   invalidate_icache( dstP, code_len );
+   invalidate_icache( sectors[y].tc_next - reqdQ, 8 * reqdQ );
 
    /* more paranoia */
    tcptr2 = sectors[y].tc_next;
@@ -939,10 +1428,14 @@ void VG_(add_to_transtab)( VexGuestExtents* vge,
 
    sectors[y].tt[i].status = InUse;
    sectors[y].tt[i].tcptr  = tcptr;
+   sectors[y].tt[i].code_len = code_len;
    sectors[y].tt[i].count  = 0;
    sectors[y].tt[i].weight = 1;
    sectors[y].tt[i].vge    = *vge;
    sectors[y].tt[i].entry  = entry;
+   sectors[y].tt[i].n_chained_from    = 0;
+   sectors[y].tt[i].size_chained_from = 0;
+   sectors[y].tt[i].chained_from      = NULL;
 
    /* Update the fast-cache. */
    setFastCacheEntry( entry, tcptr, &sectors[y].tt[i].count );
@@ -952,20 +1445,88 @@ void VG_(add_to_transtab)( VexGuestExtents* vge,
 }
 
 
-/* Search for the translation of the given guest address.  If
-   requested, a successful search can also cause the fast-caches to be
-   updated.  
+/* Add a translation of vge to TT/TC.  The translation is temporarily
+   in code[0 .. code_len-1].
+
+   pre: youngest_sector points to a valid (although possibly full)
+   sector.
 */
-Bool VG_(search_transtab) ( /*OUT*/AddrH* result,
-                            Addr64        guest_addr, 
-                            Bool          upd_cache )
+void VG_(add_to_transtab)( VexGuestExtents* vge,
+                           Addr64           entry,
+                           AddrH            code,
+                           UInt             code_len,
+                           Bool             is_self_checking )
 {
-   Int i, j, k, kstart, sno;
+   Int tcAvailQ, reqdQ, y;
 
    vg_assert(init_done);
+   vg_assert(vge->n_used >= 1 && vge->n_used <= 3);
+
+   /* 60000: should agree with N_TMPBUF in m_translate.c. */
+   vg_assert(code_len > 0 && code_len < 60000);
+
+   if (0)
+      VG_(printf)("add_to_transtab(entry = 0x%llx, len = %d)\n",
+                  entry, code_len);
+
+   n_in_count++;
+   n_in_tsize += code_len;
+   n_in_osize += vge_osize(vge);
+   if (is_self_checking)
+      n_in_sc_count++;
+   if (keeping_hot() && is_set(dumped_bits, dumped_bit(entry)))
+      n_retrans++;
+
+   y = youngest_sector;
+   vg_assert(isValidSector(y));
+
+   if (sectors[y].tc == NULL)
+      initialiseSector(y);
+
+   /* Try putting the translation in this sector. */
+   reqdQ = code_szQ(code_len);
+
+   /* Will it fit in tc? */
+   tcAvailQ = ((ULong*)(&sectors[y].tc[tc_sector_szQ]))
+              - ((ULong*)(sectors[y].tc_next));
+   vg_assert(tcAvailQ >= 0);
+   vg_assert(tcAvailQ <= tc_sector_szQ);
+
+   if (tcAvailQ < reqdQ 
+       || sectors[y].tt_n_inuse >= N_TTES_PER_SECTOR_USABLE) {
+      /* No.  So move on to the next sector.  Either it's never been
+         used before, in which case it will get its tt/tc allocated
+         now, or it has been used before, in which case it is set to be
+         empty, hence throwing out the oldest sector -- apart from its
+         hot translations, which initialiseSector keeps.  They take at
+         most MIGRATE_LIMIT_PERCENT of it, so there is room left. */
+      vg_assert(tc_sector_szQ > 0);
+      VG_(debugLog)(1,"transtab", 
+                      "declare sector %d full "
+                      "(TT loading %2d%%, TC loading %2d%%)\n",
+                      y,
+                      (100 * sectors[y].tt_n_inuse) 
+                         / N_TTES_PER_SECTOR,
+                      (100 * (tc_sector_szQ - tcAvailQ)) 
+                         / tc_sector_szQ);
+      y = advance_youngest_sector();
+      initialiseSector(y);
+   }
+
+   add_to_sector( y, vge, entry, (UChar*)code, code_len );
+}
+
+
+/* Find the translation of the given guest address, as a sector
+   number and an index into its tt.
+*/
+static Bool find_tte ( /*OUT*/Int* res_sno, /*OUT*/Int* res_tteno,
+                       Addr64 guest_addr )
+{
+   Int i, j, k, kstart, pos, sno;
+
    /* Find the initial probe point just once.  It will be the same in
       all sectors and avoids multiple expensive % operations. */
-   n_full_lookups++;
    k      = -1;
    kstart = HASH_TT(guest_addr);
    vg_assert(kstart >= 0 && kstart < N_TTES_PER_SECTOR);
@@ -973,9 +1534,10 @@ Bool VG_(search_transtab) ( /*OUT*/AddrH* result,
    /* Search in all the sectors.  Although the order should not matter,
       it might be most efficient to search in the order youngest to
       oldest. */
-   sno = youngest_sector;
-   for (i = 0; i < N_SECTORS; i++) {
+   pos = youngest_pos;
+   for (i = 0; i < n_sectors; i++) {
 
+      sno = sector_ring[pos];
       if (sectors[sno].tc == NULL)
          goto notfound; /* sector not in use. */
 
@@ -985,12 +1547,8 @@ Bool VG_(search_transtab) ( /*OUT*/AddrH* result,
          if (sectors[sno].tt[k].status == InUse
              && sectors[sno].tt[k].entry == guest_addr) {
             /* found it */
-            if (upd_cache)
-               setFastCacheEntry( 
-                  guest_addr, sectors[sno].tt[k].tcptr, 
-                              &sectors[sno].tt[k].count );
-            if (result)
-               *result = (AddrH)sectors[sno].tt[k].tcptr;
+            *res_sno   = sno;
+            *res_tteno = k;
             return True;
          }
          if (sectors[sno].tt[k].status == Empty)
@@ -1006,7 +1564,7 @@ Bool VG_(search_transtab) ( /*OUT*/AddrH* result,
 
      notfound:
       /* move to the next oldest sector */
-      sno = sno==0 ? (N_SECTORS-1) : (sno-1);
+      pos = pos==0 ? (n_sectors-1) : (pos-1);
    }
 
    /* Not found in any sector. */
@@ -1014,12 +1572,74 @@ Bool VG_(search_transtab) ( /*OUT*/AddrH* result,
 }
 
 
+/* Search for the translation of the given guest address.  If
+   requested, a successful search can also cause the fast-caches to be
+   updated.  
+*/
+Bool VG_(search_transtab) ( /*OUT*/AddrH* result,
+                            Addr64        guest_addr, 
+                            Bool          upd_cache )
+{
+   Int sno, k;
+
+   vg_assert(init_done);
+   n_full_lookups++;
+
+   if (!find_tte( &sno, &k, guest_addr ))
+      return False;
+
+   if (upd_cache)
+      setFastCacheEntry( 
+         guest_addr, sectors[sno].tt[k].tcptr, 
+                     &sectors[sno].tt[k].count );
+   if (result)
+      *result = (AddrH)sectors[sno].tt[k].tcptr;
+   return True;
+}
+
+
+void VG_(sample_translation) ( Addr64 guest_addr )
+{
+   Int sno, k;
+
+   vg_assert(init_done);
+   if (keeping_hot() && find_tte( &sno, &k, guest_addr ))
+      sectors[sno].tt[k].count++;
+}
+
+
+/* The chainable exit ending at site has just been taken to
+   guest_addr.  If guest_addr has a translation, patch the exit to
+   jump straight to it. */
+void VG_(chain_translation) ( Addr site, Addr64 guest_addr )
+{
+   Int      from_sno, sno, k;
+   TTEntry* tte;
+
+   vg_assert(init_done);
+   vg_assert(VG_(clo_chain_translations));
+
+   /* Only translations in the main TT/TC have chainable exits. */
+   from_sno = sector_of_code( site - CHAIN_SITE_SZB );
+   vg_assert(from_sno != -1);
+
+   if (!find_tte( &sno, &k, guest_addr ))
+      return;
+
+   tte = &sectors[sno].tt[k];
+   patch_chain_site( site, (UChar*)tte->tcptr - CHAIN_ENTRY_SZB );
+   add_chained_from( tte, site, from_sno );
+   n_chained++;
+}
+
+
 /*-------------------------------------------------------------*/
 /*--- Delete translations.                                  ---*/
 /*-------------------------------------------------------------*/
 
 /* forward */
 static void unredir_discard_translations( Addr64, ULong );
+static void skip_persisted_translations( Addr64, ULong );
 
 /* Stuff for deleting translations which intersect with a given
    address range.  Unfortunately, to make this run at a reasonable
@@ -1078,6 +1698,7 @@ static void delete_tte ( /*MOD*/Sector* sec, Int tteno )
    }
 
    /* Now fix up this TTEntry. */
+   unchain_tte(tte);
    tte->status   = Deleted;
    tte->n_tte2ec = 0;
 
@@ -1212,7 +1833,7 @@ void VG_(discard_translations) ( Addr64 guest_start, ULong range,
       /* Fast scheme */
       vg_assert(ec >= 0 && ec < ECLASS_MISC);
 
-      for (sno = 0; sno < N_SECTORS; sno++) {
+      for (sno = 0; sno < n_sectors; sno++) {
          sec = &sectors[sno];
          if (sec->tc == NULL)
             continue;
@@ -1229,7 +1850,7 @@ void VG_(discard_translations) ( Addr64 guest_start, ULong range,
       VG_(debugLog)(2, "transtab",
                        "                    SLOW, ec = %d\n", ec);
 
-      for (sno = 0; sno < N_SECTORS; sno++) {
+      for (sno = 0; sno < n_sectors; sno++) {
          sec = &sectors[sno];
          if (sec->tc == NULL)
             continue;
@@ -1245,6 +1866,9 @@ void VG_(discard_translations) ( Addr64 guest_start, ULong range,
    /* don't forget the no-redir cache */
    unredir_discard_translations( guest_start, range );
 
+   /* nor --translation-cache's copies */
+   skip_persisted_translations( guest_start, range );
+
    /* Post-deletion sanity check */
    if (VG_(clo_sanity_level >= 4)) {
       Int      i;
@@ -1253,7 +1877,7 @@ void VG_(discard_translations) ( Addr64 guest_start, ULong range,
       vg_assert(sane);
       /* But now, also check the requested address range isn't
          present anywhere. */
-      for (sno = 0; sno < N_SECTORS; sno++) {
+      for (sno = 0; sno < n_sectors; sno++) {
          sec = &sectors[sno];
          if (sec->tc == NULL)
             continue;
@@ -1267,6 +1891,495 @@ void VG_(discard_translations) ( Addr64 guest_start, ULong range,
    }
 }
 
+/* For tools.  Deleting a translation only marks its tt entry; the
+   code itself is left in the sector until the sector is recycled, so
+   a translation that calls out to a helper which discards it can
+   still return into it and run to its end.  Any exits chained to it,
+   its own included, have been put back by then, so that it leaves
+   through the dispatcher. */
+void VG_(discard_translations_safely) ( Addr64 guest_start, ULong range,
+                                        HChar* who )
+{
+   VG_(discard_translations)( guest_start, range, who );
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Persistence (--translation-cache).                   ---*/
+/*------------------------------------------------------------*/
+
+/* A fuzzer starts the same program thousands of times, and each run
+   translates the same hot code all over again.  With
+   --translation-cache=<dir>, the translations made in a run are
+   written to a file in <dir> at exit, and the next run reads the file
+   at startup and, when asked to translate an address which has a
+   translation in it, uses that rather than calling VEX.
+
+   One file serves one (tool, program, command line, host): its name
+   is a hash of the tool's name, the identity of the tool executable
+   (so that its helpers are where the saved code calls them), the
+   client's name, the host's hwcaps (so that, say, SSE2 code is not
+   handed to a host without it), and the options, which covers anything
+   that changes what the tool generates.  Options whose values make no
+   difference to the code -- the core's output and cache paths, and
+   whichever of its own the tool says -- are hashed by name only, so
+   that eg. a fresh output directory for every session does not mean a
+   fresh cache file too.
+
+   Nothing is relocated.  Generated code refers to guest addresses, and
+   to the core's and the tool's code and globals, which are at fixed
+   addresses; a tool whose code refers to anything else can't
+   need_persistent_translations, or must mark such translations
+   transient.  So a saved translation is keyed by its entry address and
+   is used only if the guest code it was made from is still at the same
+   place, byte for byte, and could still be chased into in the same
+   way.  Otherwise it is stale, and is dropped when the file is next
+   written.
+
+   Saved code is as VEX made it, before add_to_transtab gave it a chain
+   entry or any of its exits were chained.  Self-checking and no-redir
+   translations are never saved.
+
+   The file is a header and then records, each a PTRec followed by its
+   code padded to 8 bytes.  It is mapped privately and its records are
+   used in place; records for translations made in this run are
+   allocated in VG_AR_TTAUX.  One open-addressed table indexes both by
+   entry, a newer record replacing an older one.  The file is written
+   under a temporary name and renamed into place, and only by a process
+   which made new translations itself, so that a fork server's
+   children don't each write back what they inherited. */
+
+#define PTCACHE_MAGIC "VGTTCA01"
+
+typedef
+   struct {
+      UChar magic[8];
+      ULong key;          /* guards against a hash collision */
+      UInt  n_recs;
+      UInt  sizeof_rec;   /* catch a change of layout */
+   }
+   PTCacheHdr;
+
+typedef
+   struct {
+      Addr64          entry;
+      ULong           bytes_hash;  /* of the guest code in .vge */
+      VexGuestExtents vge;
+      UInt            code_len;
+      UInt            state;       /* a PTState; 0 on disk */
+   }
+   PTRec;
+
+typedef
+   enum {
+      PT_Usable    = 0,
+      PT_Discarded = 1,  /* not to be used again this run, but kept */
+      PT_Stale     = 2   /* the guest code has changed; dropped */
+   }
+   PTState;
+
+static ULong   pt_key       = 0;
+static Addr    pt_image     = 0;     /* the mapped file, or 0 */
+static SizeT   pt_image_szB = 0;
+static PTRec** pt_index     = NULL;
+static UInt    pt_index_size = 0;    /* a power of 2 */
+static UInt    pt_index_used = 0;
+static Int     pt_dirty_pid = 0;     /* last process to add a record */
+static Bool    pt_transient = False;
+
+static ULong fnv64 ( ULong h, UChar* p, SizeT n )
+{
+   while (n-- > 0) {
+      h ^= *p++;
+      h *= 0x100000001b3ULL;
+   }
+   return h;
+}
+
+static ULong fnv64_str ( ULong h, HChar* s )
+{
+   return fnv64(h, (UChar*)s, VG_(strlen)(s) + 1);
+}
+
+/* Does the value of core option arg make no difference to the code? */
+static Bool core_option_value_irrelevant ( HChar* arg )
+{
+   static HChar* names[] = {
+      "--log-", "--xml-file=", "--suppressions=",
+      "--translation-cache=", "--debuginfo-cache=", NULL
+   };
+   Int i;
+   for (i = 0; names[i] != NULL; i++)
+      if (VG_(strncmp)(arg, names[i], VG_(strlen)(names[i])) == 0)
+         return True;
+   return False;
+}
+
+static ULong make_pt_key ( void )
+{
+   struct vki_stat st;
+   VexArch     arch;
+   VexArchInfo archinfo;
+   SysRes res;
+   ULong  h = 0xcbf29ce484222325ULL;   /* FNV-1a */
+   HChar* eq;
+   Int    i;
+
+   h = fnv64_str(h, PTCACHE_MAGIC);
+   h = fnv64_str(h, VG_(details).name);
+   res = VG_(stat)("/proc/self/exe", &st);
+   if (!res.isError) {
+      ULong id[3];
+      id[0] = st.st_size;
+      id[1] = st.st_mtime;
+      id[2] = st.st_ino;
+      h = fnv64(h, (UChar*)id, sizeof(id));
+   }
+   VG_(machine_get_VexArchInfo)( &arch, &archinfo );
+   h = fnv64(h, (UChar*)&arch, sizeof(arch));
+   h = fnv64(h, (UChar*)&archinfo.hwcaps, sizeof(archinfo.hwcaps));
+   if (VG_(args_the_exename) != NULL)
+      h = fnv64_str(h, VG_(args_the_exename));
+   for (i = 0; i < VG_(sizeXA)(VG_(args_for_valgrind)); i++) {
+      HChar* arg = *(HChar**)VG_(indexXA)(VG_(args_for_valgrind), i);
+      eq = VG_(strchr)(arg, '=');
+      if (eq != NULL
+          && (core_option_value_irrelevant(arg)
+              || !VG_TDICT_CALL(tool_option_value_affects_code, arg))) {
+         h = fnv64(h, (UChar*)arg, eq + 1 - arg);
+         continue;
+      }
+      h = fnv64_str(h, arg);
+   }
+   return h;
+}
+
+/* The cache file, with 'suffix' appended; in VG_AR_TTAUX. */
+static HChar* pt_file_name ( HChar* suffix )
+{
+   HChar* name = VG_(arena_malloc)( VG_AR_TTAUX,
+                                    VG_(strlen)(VG_(clo_translation_cache))
+                                    + VG_(strlen)(suffix) + 32 );
+   VG_(sprintf)(name, "%s/%016llx.tt%s", VG_(clo_translation_cache),
+                pt_key, suffix);
+   return name;
+}
+
+static inline UChar* pt_code ( PTRec* rec )
+{
+   return (UChar*)(rec + 1);
+}
+
+static inline SizeT pt_rec_szB ( PTRec* rec )
+{
+   return sizeof(PTRec) + VG_ROUNDUP(rec->code_len, 8);
+}
+
+static inline Bool pt_in_image ( PTRec* rec )
+{
+   return (Addr)rec >= pt_image && (Addr)rec < pt_image + pt_image_szB;
+}
+
+static inline UInt pt_hash ( Addr64 entry )
+{
+   return (UInt)(entry ^ (entry >> 13)) & (pt_index_size - 1);
+}
+
+static void pt_index_put ( PTRec* rec );
+
+static void pt_index_grow ( void )
+{
+   PTRec** old      = pt_index;
+   UInt    old_size = pt_index_size;
+   UInt    i;
+
+   pt_index_size = old_size == 0 ? 1024 : 2 * old_size;
+   pt_index_used = 0;
+   pt_index = VG_(arena_malloc)( VG_AR_TTAUX,
+                                 pt_index_size * sizeof(PTRec*) );
+   for (i = 0; i < pt_index_size; i++)
+      pt_index[i] = NULL;
+   for (i = 0; i < old_size; i++)
+      if (old[i] != NULL)
+         pt_index_put(old[i]);
+   if (old != NULL)
+      VG_(arena_free)( VG_AR_TTAUX, old );
+}
+
+/* Add rec, replacing any record with the same entry. */
+static void pt_index_put ( PTRec* rec )
+{
+   UInt i;
+
+   if (2 * (pt_index_used + 1) > pt_index_size)
+      pt_index_grow();
+   for (i = pt_hash(rec->entry);
+        pt_index[i] != NULL;
+        i = (i + 1) & (pt_index_size - 1)) {
+      if (pt_index[i]->entry == rec->entry) {
+         if (!pt_in_image(pt_index[i]))
+            VG_(arena_free)( VG_AR_TTAUX, pt_index[i] );
+         pt_index[i] = rec;
+         return;
+      }
+   }
+   pt_index[i] = rec;
+   pt_index_used++;
+}
+
+static PTRec* pt_index_get ( Addr64 entry )
+{
+   UInt i;
+
+   if (pt_index_size == 0)
+      return NULL;
+   for (i = pt_hash(entry);
+        pt_index[i] != NULL;
+        i = (i + 1) & (pt_index_size - 1)) {
+      if (pt_index[i]->entry == entry)
+         return pt_index[i];
+   }
+   return NULL;
+}
+
+static void load_persisted_translations ( void )
+{
+   PTCacheHdr* h;
+   HChar*      name;
+   SysRes      fd, sres;
+   Int         n_img;
+   SizeT       off;
+   UInt        i;
+
+   pt_key = make_pt_key();
+   name = pt_file_name("");
+   fd = VG_(open)(name, VKI_O_RDONLY, 0);
+   VG_(arena_free)(VG_AR_TTAUX, name);
+   if (fd.isError)
+      return;
+
+   n_img = VG_(fsize)(fd.res);
+   if (n_img < (Int)sizeof(PTCacheHdr)) {
+      VG_(close)(fd.res);
+      return;
+   }
+   sres = VG_(am_mmap_file_float_valgrind)
+             ( n_img, VKI_PROT_READ|VKI_PROT_WRITE, fd.res, 0 );
+   VG_(close)(fd.res);
+   if (sres.isError)
+      return;
+   pt_image     = sres.res;
+   pt_image_szB = n_img;
+
+   /* Check the whole file before using any of it. */
+   h = (PTCacheHdr*)pt_image;
+   off = VG_ROUNDUP(sizeof(PTCacheHdr), 8);
+   if (VG_(memcmp)(h->magic, PTCACHE_MAGIC, 8) != 0
+       || h->key != pt_key
+       || h->sizeof_rec != sizeof(PTRec))
+      goto bad;
+   for (i = 0; i < h->n_recs; i++) {
+      PTRec* rec = (PTRec*)(pt_image + off);
+      if (pt_image_szB - off < sizeof(PTRec)
+          || rec->code_len == 0 || rec->code_len >= 65536
+          || rec->vge.n_used < 1 || rec->vge.n_used > 3
+          || pt_image_szB - off < pt_rec_szB(rec))
+         goto bad;
+      off += pt_rec_szB(rec);
+   }
+
+   off = VG_ROUNDUP(sizeof(PTCacheHdr), 8);
+   for (i = 0; i < h->n_recs; i++) {
+      PTRec* rec = (PTRec*)(pt_image + off);
+      rec->state = PT_Usable;
+      pt_index_put(rec);
+      off += pt_rec_szB(rec);
+   }
+   n_pt_loaded = h->n_recs;
+
+   VG_(debugLog)(1, "transtab", "read %d translations from cache\n",
+                    (Int)h->n_recs);
+   return;
+
+  bad:
+   {
+      SysRes m_res = VG_(am_munmap_valgrind) ( pt_image, pt_image_szB );
+      vg_assert(!m_res.isError);
+      pt_image     = 0;
+      pt_image_szB = 0;
+   }
+}
+
+/* Called from m_translate before it calls VEX.  Is there a saved
+   translation of entry which was made from the guest code now at
+   vge.base[0] == addr, and every other part of which could be chased
+   into now, according to chase_ok?  If so, say where its code and
+   extents are. */
+Bool VG_(find_persisted_translation) ( Addr64 entry, Addr64 addr,
+                                       Bool (*chase_ok)(void*, Addr64),
+                                       void* opaque,
+                                       /*OUT*/VexGuestExtents* vge,
+                                       /*OUT*/AddrH* code,
+                                       /*OUT*/UInt* code_len )
+{
+   PTRec* rec;
+   ULong  hash = 0xcbf29ce484222325ULL;
+   Int    i;
+
+   if (VG_(clo_translation_cache) == NULL)
+      return False;
+   rec = pt_index_get(entry);
+   if (rec == NULL || rec->state != PT_Usable)
+      return False;
+   if (rec->vge.base[0] != addr)
+      return False;
+
+   for (i = 0; i < rec->vge.n_used; i++) {
+      if (i > 0 && !chase_ok(opaque, rec->vge.base[i]))
+         return False;
+      if (!VG_(am_is_valid_for_client)( (Addr)rec->vge.base[i],
+                                        rec->vge.len[i], VKI_PROT_READ ))
+         return False;
+      hash = fnv64(hash, (UChar*)(Addr)rec->vge.base[i], rec->vge.len[i]);
+   }
+   if (hash != rec->bytes_hash) {
+      rec->state = PT_Stale;
+      n_pt_stale++;
+      return False;
+   }
+
+   n_pt_reused++;
+   *vge      = rec->vge;
+   *code     = (AddrH)pt_code(rec);
+   *code_len = rec->code_len;
+   return True;
+}
+
+void VG_(mark_translation_transient) ( void )
+{
+   pt_transient = True;
+}
+
+/* Called from m_translate after every call to VEX, with the code VEX
+   made, so that it can be saved at exit if it's 'eligible' and the
+   tool didn't mark it transient. */
+void VG_(persist_translation) ( Bool eligible, VexGuestExtents* vge,
+                                Addr64 entry, AddrH code, UInt code_len )
+{
+   PTRec* rec;
+   ULong  hash = 0xcbf29ce484222325ULL;
+   Int    i;
+   Bool   transient = pt_transient;
+
+   pt_transient = False;
+   if (VG_(clo_translation_cache) == NULL || !eligible || transient)
+      return;
+
+   for (i = 0; i < vge->n_used; i++)
+      hash = fnv64(hash, (UChar*)(Addr)vge->base[i], vge->len[i]);
+
+   rec = VG_(arena_malloc)( VG_AR_TTAUX,
+                            sizeof(PTRec) + VG_ROUNDUP(code_len, 8) );
+   rec->entry      = entry;
+   rec->bytes_hash = hash;
+   rec->vge        = *vge;
+   rec->code_len   = code_len;
+   rec->state      = PT_Usable;
+   VG_(memset)(pt_code(rec), 0, VG_ROUNDUP(code_len, 8));
+   VG_(memcpy)(pt_code(rec), (void*)code, code_len);
+   pt_index_put(rec);
+   pt_dirty_pid = VG_(getpid)();
+}
+
+/* Translations of [start, start+range) have been discarded, so the
+   tool or the client wants them made afresh: don't hand out the saved
+   ones again in this run.  They are still written back, since the
+   next run will start as this one did. */
+static void skip_persisted_translations ( Addr64 start, ULong range )
+{
+   UInt i;
+
+   for (i = 0; i < pt_index_size; i++) {
+      PTRec* rec = pt_index[i];
+      if (rec != NULL && rec->state == PT_Usable
+          && overlaps(start, range, &rec->vge))
+         rec->state = PT_Discarded;
+   }
+}
+
+static Bool write_all ( Int fd, UChar* buf, SizeT szB )
+{
+   while (szB > 0) {
+      Int n = VG_(write)(fd, buf, szB > 1048576 ? 1048576 : szB);
+      if (n <= 0)
+         return False;
+      buf += n;
+      szB -= n;
+   }
+   return True;
+}
+
+void VG_(save_persisted_translations) ( void )
+{
+   PTCacheHdr* h;
+   UChar*      img;
+   HChar*      name;
+   HChar*      tmp;
+   HChar       suffix[32];
+   SizeT       img_szB, off;
+   SysRes      fd;
+   UInt        i;
+   Bool        ok;
+
+   if (VG_(clo_translation_cache) == NULL
+       || pt_dirty_pid != VG_(getpid)())
+      return;
+
+   img_szB = VG_ROUNDUP(sizeof(PTCacheHdr), 8);
+   for (i = 0; i < pt_index_size; i++)
+      if (pt_index[i] != NULL && pt_index[i]->state != PT_Stale)
+         img_szB += pt_rec_szB(pt_index[i]);
+
+   img = VG_(arena_malloc)(VG_AR_TTAUX, img_szB);
+   VG_(memset)(img, 0, VG_ROUNDUP(sizeof(PTCacheHdr), 8));
+   h = (PTCacheHdr*)img;
+   VG_(memcpy)(h->magic, PTCACHE_MAGIC, 8);
+   h->key        = pt_key;
+   h->sizeof_rec = sizeof(PTRec);
+   h->n_recs     = 0;
+   off = VG_ROUNDUP(sizeof(PTCacheHdr), 8);
+   for (i = 0; i < pt_index_size; i++) {
+      PTRec* rec = pt_index[i];
+      if (rec == NULL || rec->state == PT_Stale)
+         continue;
+      VG_(memcpy)(img + off, rec, pt_rec_szB(rec));
+      ((PTRec*)(img + off))->state = PT_Usable;
+      off += pt_rec_szB(rec);
+      h->n_recs++;
+   }
+   vg_assert(off == img_szB);
+   n_pt_saved = h->n_recs;
+
+   VG_(sprintf)(suffix, ".%d.tmp", VG_(getpid)());
+   name = pt_file_name("");
+   tmp  = pt_file_name(suffix);
+   fd = VG_(open)(tmp, VKI_O_CREAT|VKI_O_WRONLY|VKI_O_TRUNC,
+                       VKI_S_IRUSR|VKI_S_IWUSR);
+   if (fd.isError) {
+      if (VG_(clo_verbosity) > 1)
+         VG_(message)(Vg_DebugMsg, "Can't create %s", tmp);
+   } else {
+      ok = write_all(fd.res, img, img_szB);
+      VG_(close)(fd.res);
+      if (!ok || VG_(rename)(tmp, name) != 0)
+         VG_(unlink)(tmp);
+   }
+
+   VG_(arena_free)(VG_AR_TTAUX, name);
+   VG_(arena_free)(VG_AR_TTAUX, tmp);
+   VG_(arena_free)(VG_AR_TTAUX, img);
+}
+
 
 /*------------------------------------------------------------*/
 /*--- AUXILIARY: the unredirected TT/TC                    ---*/
@@ -1460,16 +2573,28 @@ void VG_(init_tt_tc) ( void )
                    "(startup of code management)");
 
    /* Figure out how big each tc area should be.  */
-   avg_codeszQ   = (VG_(details).avg_translation_sizeB + 7) / 8;
+   if (VG_(clo_avg_transtab_entry_size) > 0)
+      avg_codeszQ = (VG_(clo_avg_transtab_entry_size) + 7) / 8;
+   else
+      avg_codeszQ = (VG_(details).avg_translation_sizeB + 7) / 8;
+   if (VG_(clo_chain_translations))
+      avg_codeszQ += CHAIN_ENTRY_SZQ;
    tc_sector_szQ = N_TTES_PER_SECTOR_USABLE * (1 + avg_codeszQ);
 
-   /* Ensure the calculated value is not way crazy. */
+   /* Ensure the calculated value is not way crazy.  The upper limit
+      allows for --avg-transtab-entry-size=4000. */
    vg_assert(tc_sector_szQ >= 2 * N_TTES_PER_SECTOR_USABLE);
-   vg_assert(tc_sector_szQ <= 80 * N_TTES_PER_SECTOR_USABLE);
-
-   /* Initialise the sectors */
+   vg_assert(tc_sector_szQ <= 510 * N_TTES_PER_SECTOR_USABLE);
+
+   /* Initialise the sectors, and put the first n_sectors in the
+      ring */
+   vg_assert(VG_(clo_num_transtab_sectors) >= 1);
+   vg_assert(VG_(clo_num_transtab_sectors) <= MAX_N_SECTORS);
+   n_sectors       = VG_(clo_num_transtab_sectors);
+   youngest_pos    = 0;
    youngest_sector = 0;
-   for (i = 0; i < N_SECTORS; i++) {
+   for (i = 0; i < MAX_N_SECTORS; i++) {
+      sector_ring[i] = i;
       sectors[i].tc = NULL;
       sectors[i].tt = NULL;
       sectors[i].tc_next = NULL;
@@ -1491,26 +2616,32 @@ void VG_(init_tt_tc) ( void )
    /* and the unredir tt/tc */
    init_unredir_tt_tc();
 
+   /* and whatever earlier runs saved */
+   if (VG_(clo_translation_cache) != NULL)
+      load_persisted_translations();
+
    if (VG_(clo_verbosity) > 2) {
       VG_(message)(Vg_DebugMsg,
-         "TT/TC: cache: %d sectors of %d bytes each = %d total", 
-          N_SECTORS, 8 * tc_sector_szQ,
-          N_SECTORS * 8 * tc_sector_szQ );
+         "TT/TC: cache: %d sectors of %d bytes each = %llu total "
+         "(up to %d sectors)", 
+          n_sectors, 8 * tc_sector_szQ,
+          (ULong)n_sectors * 8 * tc_sector_szQ,
+          VG_(clo_max_transtab_sectors) );
       VG_(message)(Vg_DebugMsg,
          "TT/TC: table: %d total entries, max occupancy %d (%d%%)",
-         N_SECTORS * N_TTES_PER_SECTOR,
-         N_SECTORS * N_TTES_PER_SECTOR_USABLE, 
+         n_sectors * N_TTES_PER_SECTOR,
+         n_sectors * N_TTES_PER_SECTOR_USABLE, 
          SECTOR_TT_LIMIT_PERCENT );
    }
 
    VG_(debugLog)(2, "transtab",
-      "cache: %d sectors of %d bytes each = %d total\n", 
-       N_SECTORS, 8 * tc_sector_szQ,
-       N_SECTORS * 8 * tc_sector_szQ );
+      "cache: %d sectors of %d bytes each = %llu total\n", 
+       n_sectors, 8 * tc_sector_szQ,
+       (ULong)n_sectors * 8 * tc_sector_szQ );
    VG_(debugLog)(2, "transtab",
       "table: %d total entries, max occupancy %d (%d%%)\n",
-      N_SECTORS * N_TTES_PER_SECTOR,
-      N_SECTORS * N_TTES_PER_SECTOR_USABLE, 
+      n_sectors * N_TTES_PER_SECTOR,
+      n_sectors * N_TTES_PER_SECTOR_USABLE, 
       SECTOR_TT_LIMIT_PERCENT );
 }
 
@@ -1550,6 +2681,21 @@ void VG_(print_tt_tc_stats) ( void )
    VG_(message)(Vg_DebugMsg,
                 " transtab: discarded  %,llu (%,llu -> ?" "?)",
                 n_disc_count, n_disc_osize );
+   if (VG_(clo_chain_translations))
+      VG_(message)(Vg_DebugMsg,
+                   " transtab: chained    %,llu exits, %,llu put back",
+                   n_chained, n_unchained );
+   if (keeping_hot())
+      VG_(message)(Vg_DebugMsg,
+                   " transtab: kept       %,llu (-> %,llu) "
+                   "[%,llu retranslated; %d sectors, %,llu added]",
+                   n_migr_count, n_migr_tsize, n_retrans, n_sectors,
+                   n_grown );
+   if (VG_(clo_translation_cache) != NULL)
+      VG_(message)(Vg_DebugMsg,
+                   " transtab: reused     %,llu of %,llu saved "
+                   "(%,llu stale), %,llu written",
+                   n_pt_reused, n_pt_loaded, n_pt_stale, n_pt_saved );
 
    if (0) {
       Int i;
@@ -1587,7 +2733,7 @@ ULong VG_(get_BB_profile) ( BBProfEntry tops[], UInt n_tops )
 
    score_total = 0;
 
-   for (sno = 0; sno < N_SECTORS; sno++) {
+   for (sno = 0; sno < n_sectors; sno++) {
       if (sectors[sno].tc == NULL)
          continue;
       for (i = 0; i < N_TTES_PER_SECTOR; i++) {
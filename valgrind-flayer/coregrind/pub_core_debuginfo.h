@@ -72,6 +72,8 @@ extern void VG_(di_aix5_notify_segchange)(
             );
 #endif
 
+extern void VG_(print_debuginfo_stats) ( void );
+
 extern Bool VG_(get_fnname_nodemangle)( Addr a, 
                                         Char* fnname, Int n_fnname );
 
@@ -71,6 +71,19 @@ UWord VG_(run_innerloop) ( void* guest_state, UWord do_profiling );
 extern void VG_(run_innerloop__dispatch_unprofiled);
 extern void VG_(run_innerloop__dispatch_profiled);
 #endif
+#if defined(VGA_x86)
+/* Chainable exits call VG_(run_innerloop__chain_me); chained ones
+   jump to the next translation's chain entry point, which leaves
+   through VG_(run_innerloop__counter_is_zero) when the timeslice is
+   up.  See m_transtab.c.  Declared as arrays so that their addresses
+   can be used without taking the address of a void. */
+extern UChar VG_(run_innerloop__chain_me)[];
+extern UChar VG_(run_innerloop__counter_is_zero)[];
+#endif
+
+/* Decremented each time a translation is entered; VG_(run_innerloop)
+   returns when it reaches zero.  Set by the scheduler. */
+extern UInt VG_(dispatch_ctr);
 
 
 /* Run a no-redir translation.  argblock points to 4 UWords, 2 to carry args
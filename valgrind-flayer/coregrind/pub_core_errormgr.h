@@ -51,6 +51,8 @@ typedef
 
 extern void VG_(load_suppressions)        ( void );
 
+extern void VG_(add_final_error_counts)   ( void );
+
 extern void VG_(show_all_errors)          ( void );
 
 extern void VG_(show_error_counts_as_XML) ( void );
@@ -59,10 +61,12 @@ extern Bool VG_(is_action_requested)      ( Char* action, Bool* clo );
 
 extern Bool VG_(showing_core_errors)      ( void );
 
-extern UInt VG_(get_n_errs_found)         ( void );
-
 extern void VG_(print_errormgr_stats)     ( void );
 
+// Called when debug info is discarded, as names looked up for
+// suppression matching may then be out of date.
+extern void VG_(discard_supp_caches)      ( void );
+
 #endif   // __PUB_CORE_ERRORMGR_H
 
 /*--------------------------------------------------------------------*/
@@ -63,8 +63,6 @@ extern UShort VG_(ntohs) ( UShort x );
 
 extern Int VG_(write_socket)( Int sd, void *msg, Int count );
 extern Int VG_(connect_via_socket)( UChar* str );
-extern Int VG_(getsockname) ( Int sd, struct vki_sockaddr *name, Int *namelen );
-extern Int VG_(getpeername) ( Int sd, struct vki_sockaddr *name, Int *namelen );
 extern Int VG_(getsockopt)  ( Int sd, Int level, Int optname, void *optval,
                               Int *optlen );
 
@@ -91,6 +91,7 @@ extern void  VG_(arena_free)    ( ArenaId arena, void* ptr );
 extern void* VG_(arena_calloc)  ( ArenaId arena, 
                                   SizeT nmemb, SizeT bytes_per_memb );
 extern void* VG_(arena_realloc) ( ArenaId arena, void* ptr, SizeT size );
+extern Bool  VG_(arena_grow_in_place) ( ArenaId aid, void* ptr, SizeT size );
 extern void* VG_(arena_memalign)( ArenaId aid, SizeT req_alignB, 
                                                SizeT req_pszB );
 extern Char* VG_(arena_strdup)  ( ArenaId aid, const Char* s);
@@ -149,6 +149,27 @@ extern Bool  VG_(clo_track_fds);
    is ignored.  Ie if a tool says no, I don't want this to run, that
    cannot be overridden from the command line. */
 extern Bool  VG_(clo_run_libc_freeres);
+/* Read an object's line numbers and CFI only when a lookup first
+   needs them, rather than when it is mapped?  Default: YES */
+extern Bool  VG_(clo_lazy_debuginfo);
+/* Directory to cache canonicalised debug info in, or NULL for
+   none.  Default: NULL */
+extern HChar* VG_(clo_debuginfo_cache);
+/* Patch exits to constant addresses to jump straight to the next
+   translation?  x86 only, and not when profiling.  Default: YES */
+extern Bool  VG_(clo_chain_translations);
+/* Directory to save translations in for later runs to reuse, or NULL
+   for none.  Only for tools which need_persistent_translations.
+   Default: NULL */
+extern HChar* VG_(clo_translation_cache);
+/* Number of sectors the translation cache starts with, and the most
+   it may grow to.  Defaults: 8, and 16 on 64-bit hosts or 2 more than
+   the first on 32-bit ones (set up in m_main.c from 0) */
+extern Int   VG_(clo_num_transtab_sectors);
+extern Int   VG_(clo_max_transtab_sectors);
+/* Expected size in bytes of a translation, which sets the size of
+   each sector, or 0 for the tool's own estimate.  Default: 0 */
+extern Int   VG_(clo_avg_transtab_entry_size);
 /* Continue stack traces below main()?  Default: NO */
 extern Bool VG_(clo_show_below_main);
 
@@ -71,8 +71,6 @@ extern SysRes VG_(mk_SysRes_ppc32_linux) ( UInt  val, UInt  cr0so );
 extern SysRes VG_(mk_SysRes_ppc64_linux) ( ULong val, ULong cr0so );
 extern SysRes VG_(mk_SysRes_ppc32_aix5)  ( UInt val, UInt err );
 extern SysRes VG_(mk_SysRes_ppc64_aix5)  ( ULong val, ULong err );
-extern SysRes VG_(mk_SysRes_Error)       ( UWord val );
-extern SysRes VG_(mk_SysRes_Success)     ( UWord val );
 
 
 /* Return a string which gives the name of an error value.  Note,
@@ -91,6 +91,11 @@ typedef
       Bool data_syms;
       Bool malloc_replacement;
       Bool xml_output;
+      Bool stack_traces;
+      Bool error_stream;
+      Bool error_stream_only;
+      Bool final_error_counts;
+      Bool persistent_translations;
    } 
    VgNeeds;
 
@@ -155,6 +160,18 @@ typedef struct {
    void* (*tool_realloc)             (ThreadId, void*, SizeT);
    SizeT tool_client_redzone_szB;
 
+   // VG_(needs).stack_traces
+   UInt (*tool_get_StackTrace)(ThreadId, Addr*, UInt);
+
+   // VG_(needs).error_stream
+   void (*tool_error_recorded)(Error*, Bool);
+
+   // VG_(needs).final_error_counts
+   UInt (*tool_more_occurrences)(Error*);
+
+   // VG_(needs).persistent_translations
+   Bool (*tool_option_value_affects_code)(Char*);
+
    // -- Event tracking functions ------------------------------------
    void (*track_new_mem_startup)     (Addr, SizeT, Bool, Bool, Bool);
    void (*track_new_mem_stack_signal)(Addr, SizeT);
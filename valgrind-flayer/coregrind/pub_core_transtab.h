@@ -38,6 +38,7 @@
 //--------------------------------------------------------------------
 
 #include "pub_core_transtab_asm.h"
+#include "pub_tool_transtab.h"
 
 /* The fast-cache for tt-lookup, and for finding counters.  Unused
    entries are denoted by .guest == 1, which is assumed to be a bogus
@@ -56,6 +57,10 @@ extern __attribute__((aligned(16)))
 
 extern UInt*          VG_(tt_fastN)[VG_TT_FAST_SIZE];
 
+/* The most sectors --num-transtab-sectors and --max-transtab-sectors
+   may ask for. */
+#define VG_MAX_TRANSTAB_SECTORS 64
+
 extern void VG_(init_tt_tc)       ( void );
 
 extern
@@ -69,9 +74,34 @@ extern Bool VG_(search_transtab) ( /*OUT*/AddrH* result,
                                    Addr64        guest_addr, 
                                    Bool          upd_cache );
 
+/* A timeslice has ended with guest_addr about to run: count it
+   towards keeping guest_addr's translation when its sector is
+   recycled. */
+extern void VG_(sample_translation) ( Addr64 guest_addr );
+
 extern void VG_(discard_translations) ( Addr64 start, ULong range,
                                         HChar* who );
 
+/* With --chain-translations=yes: the address just past the exit which
+   last went to VG_(run_innerloop__chain_me), and the means to patch
+   that exit to jump straight to guest_addr's translation. */
+extern Addr VG_(tt_chain_me_site);
+extern void VG_(chain_translation) ( Addr site, Addr64 guest_addr );
+
+/* With --translation-cache: use a translation saved by an earlier
+   run, instead of asking VEX for one; offer each new translation to be
+   saved; and save them all at exit. */
+extern Bool VG_(find_persisted_translation) ( Addr64 entry, Addr64 addr,
+                                              Bool (*chase_ok)(void*, Addr64),
+                                              void* opaque,
+                                              /*OUT*/VexGuestExtents* vge,
+                                              /*OUT*/AddrH* code,
+                                              /*OUT*/UInt* code_len );
+extern void VG_(persist_translation) ( Bool eligible, VexGuestExtents* vge,
+                                       Addr64 entry, AddrH code,
+                                       UInt code_len );
+extern void VG_(save_persisted_translations) ( void );
+
 extern void VG_(print_tt_tc_stats) ( void );
 
 extern UInt VG_(get_bbs_translated) ( void );
@@ -0,0 +1,185 @@
+/*--------------------------------------------------------------------*/
+/*--- Demoting often-reported tainted branches.                    ---*/
+/*---                                             fl_branchsites.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Flayer, a heavyweight Valgrind tool for
+   tracking marked/tainted data through memory.
+
+   Copyright (C) 2006-2007 Google Inc. (Will Drewry)
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+/* A tainted branch in a loop is reported on every trip round it, and
+ * each report goes through VG_(maybe_record_error) only to bump the
+ * count of an error already recorded.  With --demote-branches-after=N
+ * a branch site reported N times has its translations discarded; when
+ * it is instrumented again its guard just adds 1 to a counter of the
+ * site, inline, with no helper call.  At exit each site's count is
+ * added to the count of the error reported there, before the error
+ * counts are shown, and with --xml=yes also listed in <demotedcounts>.
+ *
+ * Sites are keyed by the guest address of the branch's instruction.
+ * They are never freed, as demoted translations hold the address of
+ * their counter.
+ */
+
+#include "pub_tool_basics.h"
+#include "pub_tool_libcbase.h"
+#include "pub_tool_libcassert.h"
+#include "pub_tool_libcprint.h"
+#include "pub_tool_hashtable.h"
+#include "pub_tool_mallocfree.h"
+#include "pub_tool_options.h"
+#include "pub_tool_tooliface.h"     // Needed for fl_include.h
+#include "pub_tool_transtab.h"
+
+#include "fl_include.h"
+
+typedef
+   struct _BranchSite {
+      struct _BranchSite* next;
+      Addr                pc;        // key
+      UInt                reports;   // while not yet demoted
+      Bool                demoted;
+      UWord               count;     // bumped by demoted translations
+      Bool                merged;    // has count gone to an error?
+      UInt                unique;    // if so, that error's unique
+   }
+   BranchSite;
+
+static VgHashTable branch_sites = NULL;
+
+static BranchSite* get_branch_site ( Addr pc )
+{
+   BranchSite* bs;
+
+   if (branch_sites == NULL)
+      branch_sites = VG_(HT_construct)( 4099 );
+   bs = VG_(HT_lookup)( branch_sites, pc );
+   if (bs == NULL) {
+      bs = VG_(malloc)(sizeof(BranchSite));
+      bs->pc      = pc;
+      bs->reports = 0;
+      bs->demoted = False;
+      bs->count   = 0;
+      bs->merged  = False;
+      bs->unique  = 0;
+      VG_(HT_add_node)( branch_sites, bs );
+   }
+   return bs;
+}
+
+/* Called after the branch at pc has been reported once more.  Returns
+   True if it has now been reported often enough to be demoted. */
+Bool FL_(branch_site_reported) ( Addr pc )
+{
+   BranchSite* bs = get_branch_site(pc);
+
+   if (bs->demoted || ++bs->reports < (UInt)FL_(clo_demote_branches_after))
+      return False;
+   bs->demoted = True;
+   /* The translation that called us carries on to its end, and its
+      code stays put until then; see VG_(discard_translations_safely). */
+   VG_(discard_translations_safely)( (Addr64)pc, 1, "flayer" );
+   return True;
+}
+
+/* A new persistent-mode iteration starts with no errors recorded, so
+   every site must be reported afresh: forget the reports, and have the
+   demoted sites instrumented with the helper call again.  The sites
+   themselves stay, as translations still running may hold their
+   counters' addresses. */
+void FL_(branch_sites_new_run) ( void )
+{
+   BranchSite* bs;
+
+   if (branch_sites == NULL)
+      return;
+   VG_(HT_ResetIter)( branch_sites );
+   while ((bs = VG_(HT_Next)( branch_sites )) != NULL) {
+      if (bs->demoted)
+         VG_(discard_translations_safely)( (Addr64)bs->pc, 1, "flayer" );
+      bs->reports = 0;
+      bs->demoted = False;
+      bs->count   = 0;
+      bs->merged  = False;
+      bs->unique  = 0;
+   }
+}
+
+/* For the instrumenter: the counter a demoted site's guard adds to,
+   or NULL if the site should still be reported. */
+UWord* FL_(branch_site_counter) ( Addr pc )
+{
+   BranchSite* bs;
+
+   if (branch_sites == NULL)
+      return NULL;
+   bs = VG_(HT_lookup)( branch_sites, pc );
+   return (bs != NULL && bs->demoted) ? &bs->count : NULL;
+}
+
+/* For VG_(needs_final_error_counts): how many times the branch at pc
+   was taken on tainted data without being reported, to be added to
+   the count of error 'unique', reported there.  Errors with different
+   stacks can share a site; its count goes to the first one asked
+   about, which is the one most recently recorded. */
+UInt FL_(branch_site_merge) ( Addr pc, UInt unique )
+{
+   BranchSite* bs;
+
+   if (branch_sites == NULL)
+      return 0;
+   bs = VG_(HT_lookup)( branch_sites, pc );
+   if (bs == NULL || bs->merged || bs->count == 0)
+      return 0;
+   bs->merged = True;
+   bs->unique = unique;
+   // Error counts are Ints.
+   return bs->count > (1 << 30) ? (1 << 30) : (UInt)bs->count;
+}
+
+/* With --xml=yes, list how much of each error's count came from
+   demoted sites. */
+void FL_(branch_sites_fini) ( void )
+{
+   BranchSite* bs;
+
+   if (!VG_(clo_xml) || branch_sites == NULL)
+      return;
+   VG_(message)(Vg_UserMsg, "<demotedcounts>");
+   VG_(HT_ResetIter)( branch_sites );
+   while ((bs = VG_(HT_Next)( branch_sites )) != NULL) {
+      if (!bs->merged)
+         continue;
+      VG_(message)(Vg_UserMsg, "  <pair>\n"
+                               "    <count>%lu</count>\n"
+                               "    <unique>0x%x</unique>\n"
+                               "  </pair>",
+                   bs->count, bs->unique);
+   }
+   VG_(message)(Vg_UserMsg, "</demotedcounts>");
+   VG_(message)(Vg_UserMsg, "");
+}
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
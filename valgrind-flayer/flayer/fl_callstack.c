@@ -0,0 +1,153 @@
+/*--------------------------------------------------------------------*/
+/*--- Shadow call stack, for cheap stack traces.                   ---*/
+/*---                                                fl_callstack.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Flayer, a heavyweight Valgrind tool for
+   tracking marked/tainted data through memory.
+
+   Copyright (C) 2006-2007 Google Inc. (Will Drewry)
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+/* Every error and every recorded allocation site wants a stack trace,
+ * and unwinding the guest stack with CFI each time is slow.  So
+ * with --shadow-stack=yes (the default) the instrumentation pushes the
+ * return address of every superblock ending in a call, and pops on
+ * every one ending in a return; a stack trace is then just a copy of
+ * the top few entries.  VG_(record_ExeContext) gets its traces from
+ * here through VG_(needs_stack_traces).
+ *
+ * Each entry also records the stack pointer just after the call.  A
+ * return pops every entry whose stack pointer is below the one it
+ * returns to, so that longjmp() and exceptions, which skip returns,
+ * are caught up with on the next return that does happen.
+ *
+ * A thread that overflows its shadow stack counts the calls it can't
+ * record, and falls back on the unwinder until it has returned from
+ * them.
+ */
+
+#include "pub_tool_basics.h"
+#include "pub_tool_libcbase.h"
+#include "pub_tool_libcassert.h"
+#include "pub_tool_hashtable.h"
+#include "pub_tool_machine.h"
+#include "pub_tool_mallocfree.h"
+#include "pub_tool_threadstate.h"
+#include "pub_tool_tooliface.h"     // Needed for fl_include.h
+
+#include "fl_include.h"
+
+#define FL_SHADOW_STACK_DEPTH 1024
+
+typedef
+   struct {
+      Addr ret;      // return address pushed by the call
+      Addr sp;       // stack pointer just after the call
+   }
+   ShadowFrame;
+
+typedef
+   struct {
+      UInt        depth;     // entries in use in frames[]
+      UInt        lost;      // calls beyond FL_SHADOW_STACK_DEPTH
+      ShadowFrame frames[FL_SHADOW_STACK_DEPTH];
+   }
+   ShadowStack;
+
+/* Allocated on a thread's first call. */
+static ShadowStack* shadow_stacks[VG_N_THREADS];
+
+static ShadowStack* get_shadow_stack ( ThreadId tid )
+{
+   tl_assert(tid < VG_N_THREADS);
+   if (shadow_stacks[tid] == NULL) {
+      shadow_stacks[tid] = VG_(malloc)(sizeof(ShadowStack));
+      shadow_stacks[tid]->depth = 0;
+      shadow_stacks[tid]->lost  = 0;
+   }
+   return shadow_stacks[tid];
+}
+
+VG_REGPARM(2)
+void FL_(helperc_shadow_call) ( Addr ret, Addr sp )
+{
+   ShadowStack* ss = get_shadow_stack(VG_(get_running_tid)());
+
+   if (ss->lost > 0 || ss->depth == FL_SHADOW_STACK_DEPTH) {
+      ss->lost++;
+      return;
+   }
+   ss->frames[ss->depth].ret = ret;
+   ss->frames[ss->depth].sp  = sp;
+   ss->depth++;
+}
+
+VG_REGPARM(1)
+void FL_(helperc_shadow_ret) ( Addr sp )
+{
+   ShadowStack* ss = shadow_stacks[VG_(get_running_tid)()];
+
+   if (ss == NULL)
+      return;
+   if (ss->lost > 0) {
+      ss->lost--;
+      return;
+   }
+   while (ss->depth > 0 && ss->frames[ss->depth-1].sp < sp)
+      ss->depth--;
+}
+
+/* For VG_(needs_stack_traces): the current IP, then the return
+   addresses from the innermost out.  0 means ask the unwinder. */
+UInt FL_(shadow_stack_trace) ( ThreadId tid, Addr* ips, UInt n_ips )
+{
+   ShadowStack* ss;
+   UInt         i, n;
+
+   if (!FL_(clo_shadow_stack) || n_ips == 0)
+      return 0;
+   ss = shadow_stacks[tid];
+   if (ss != NULL && ss->lost > 0)
+      return 0;
+
+   ips[0] = VG_(get_IP)(tid);
+   n = 1;
+   if (ss != NULL) {
+      for (i = ss->depth; i > 0 && n < n_ips; i--)
+         ips[n++] = ss->frames[i-1].ret;
+   }
+   return n;
+}
+
+/* A new thread starts with nothing on its stack. */
+void FL_(shadow_stack_thread_create) ( ThreadId parent, ThreadId child )
+{
+   tl_assert(child < VG_N_THREADS);
+   if (shadow_stacks[child] != NULL) {
+      shadow_stacks[child]->depth = 0;
+      shadow_stacks[child]->lost  = 0;
+   }
+}
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
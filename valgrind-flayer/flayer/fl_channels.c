@@ -0,0 +1,457 @@
+/*--------------------------------------------------------------------*/
+/*--- Shadow FIFOs: taint through pipes and local sockets.         ---*/
+/*---                                                fl_channels.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Flayer, a heavyweight Valgrind tool for
+   tracking marked/tainted data through memory.
+
+   Copyright (C) 2006-2007 Google Inc. (Will Drewry)
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+/* When the client writes to one end of a pipe, socketpair, AF_UNIX or
+ * loopback TCP connection and reads the data back at the other end
+ * (typically in another thread), the kernel buffer in between would
+ * wash the taint out.  So for each direction of each such channel we
+ * keep a shadow FIFO: write() appends the taint of the bytes written,
+ * as runs of tainted/untainted bytes, and read() at the other end
+ * pops as many bytes as it got and applies their taint to the buffer.
+ *
+ * Pipes and socketpairs are paired when created.  A connect() to a
+ * loopback or AF_UNIX address creates a pending channel, which an
+ * accept() in this process on the matching listener completes;
+ * connections to other processes simply never get paired.
+ *
+ * Bytes read beyond what the FIFO holds came from elsewhere (another
+ * process sharing the fd, say) and are left to the usual fd tainting
+ * policy.  Data is treated as a byte stream: datagram boundaries and
+ * truncation are not modelled.
+ */
+
+#include "pub_tool_basics.h"
+#include "pub_tool_vki.h"
+#include "pub_tool_libcbase.h"
+#include "pub_tool_libcassert.h"
+#include "pub_tool_libcfile.h"
+#include "pub_tool_libcprint.h"
+#include "pub_tool_mallocfree.h"
+#include "pub_tool_aspacemgr.h"
+#include "pub_tool_hashtable.h"
+#include "pub_tool_tooliface.h"     // Needed for fl_include.h
+
+#include "fl_include.h"
+
+typedef
+   struct _TaintRun {
+      struct _TaintRun* next;
+      SizeT             len;
+      Bool              tainted;
+   }
+   TaintRun;
+
+typedef
+   struct {
+      TaintRun* head;
+      TaintRun* tail;
+      SizeT     queued;    // bytes in all the runs
+      Int       refs;      // endpoints using it
+   }
+   ShadowFifo;
+
+typedef
+   struct {
+      ShadowFifo* in;      // what reads from this fd see
+      ShadowFifo* out;     // where writes to this fd go
+      Bool        paired;  // is the other end in this process?
+   }
+   Endpoint;
+
+static Endpoint endpoints[FL_MAXIMUM_FDS];
+
+/* What identifies a connection at both ends: for AF_INET, the
+   connecting socket's local address and port (network order); for
+   AF_UNIX, the listener's path. */
+typedef
+   struct {
+      Int   family;
+      UInt  addr;
+      UShort port;
+      Char  path[VKI_UNIX_PATH_MAX];
+   }
+   ChannelKey;
+
+typedef
+   struct _PendingConn {
+      struct _PendingConn* next;
+      ChannelKey           key;
+      Int                  fd;    // the connecting end
+   }
+   PendingConn;
+
+static PendingConn* pending = NULL;
+
+/* More unread bytes than a pipe or socket buffer normally holds: the
+   reader must be in another process (after a fork, say, or a connect()
+   to a listener elsewhere), so stop queueing for it. */
+#define MAX_QUEUED (1 << 22)
+
+/* ------------------------- FIFOs ------------------------- */
+
+static ShadowFifo* new_fifo ( void )
+{
+   ShadowFifo* f = VG_(malloc)(sizeof(ShadowFifo));
+   f->head = f->tail = NULL;
+   f->queued = 0;
+   f->refs = 0;
+   return f;
+}
+
+static void clear_fifo ( ShadowFifo* f )
+{
+   TaintRun *r, *next;
+
+   for (r = f->head; r != NULL; r = next) {
+      next = r->next;
+      VG_(free)(r);
+   }
+   f->head = f->tail = NULL;
+   f->queued = 0;
+}
+
+static void unref_fifo ( ShadowFifo* f )
+{
+   if (f == NULL || --f->refs > 0)
+      return;
+   clear_fifo(f);
+   VG_(free)(f);
+}
+
+static void push_run ( ShadowFifo* f, SizeT len, Bool tainted )
+{
+   TaintRun* r;
+
+   f->queued += len;
+   if (f->tail != NULL && f->tail->tainted == tainted) {
+      f->tail->len += len;
+      return;
+   }
+   r = VG_(malloc)(sizeof(TaintRun));
+   r->next    = NULL;
+   r->len     = len;
+   r->tainted = tainted;
+   if (f->tail != NULL)
+      f->tail->next = r;
+   else
+      f->head = r;
+   f->tail = r;
+}
+
+/* Applies the taint of up to len queued bytes to [a,a+len), dropping
+   them from the FIFO unless peeking.  Returns how many were queued. */
+static SizeT pop_runs ( ShadowFifo* f, Addr a, SizeT len, Bool peek )
+{
+   TaintRun* r = f->head;
+   SizeT     done = 0, n;
+
+   while (r != NULL && done < len) {
+      n = r->len < len - done ? r->len : len - done;
+      if (r->tainted)
+         FL_(make_mem_undefined)(a + done, n);
+      else
+         FL_(make_mem_defined)(a + done, n);
+      done += n;
+
+      if (peek) {
+         r = r->next;
+      } else if (n < r->len) {
+         r->len -= n;
+         f->queued -= n;
+      } else {
+         f->queued -= n;
+         f->head = r->next;
+         if (f->head == NULL)
+            f->tail = NULL;
+         VG_(free)(r);
+         r = f->head;
+      }
+   }
+   return done;
+}
+
+/* ----------------------- Endpoints ----------------------- */
+
+static Bool valid_fd ( Int fd )
+{
+   return fd > -1 && fd < FL_MAXIMUM_FDS;
+}
+
+static void set_endpoint ( Int fd, ShadowFifo* in, ShadowFifo* out,
+                           Bool paired )
+{
+   FL_(channel_close)(fd);
+   endpoints[fd].in     = in;
+   endpoints[fd].out    = out;
+   endpoints[fd].paired = paired;
+   in->refs++;
+   out->refs++;
+}
+
+void FL_(channel_close) ( Int fd )
+{
+   PendingConn **pp, *p;
+
+   if (!valid_fd(fd) || endpoints[fd].in == NULL)
+      return;
+
+   for (pp = &pending; (p = *pp) != NULL; ) {
+      if (p->fd == fd) {
+         *pp = p->next;
+         VG_(free)(p);
+      } else {
+         pp = &p->next;
+      }
+   }
+   unref_fifo(endpoints[fd].in);
+   unref_fifo(endpoints[fd].out);
+   VG_(memset)(&endpoints[fd], 0, sizeof(endpoints[fd]));
+}
+
+void FL_(channel_dup) ( Int oldfd, Int newfd )
+{
+   if (!valid_fd(oldfd) || !valid_fd(newfd) || oldfd == newfd)
+      return;
+   if (endpoints[oldfd].in == NULL) {
+      FL_(channel_close)(newfd);
+      return;
+   }
+   set_endpoint(newfd, endpoints[oldfd].in, endpoints[oldfd].out,
+                endpoints[oldfd].paired);
+}
+
+void FL_(channel_pipe) ( Int rfd, Int wfd )
+{
+   ShadowFifo* f;
+   if (!valid_fd(rfd) || !valid_fd(wfd))
+      return;
+   // The unused direction of each end gets a FIFO of its own, which
+   // nothing will ever fill.
+   f = new_fifo();
+   set_endpoint(rfd, f, new_fifo(), True);
+   set_endpoint(wfd, new_fifo(), f, True);
+}
+
+void FL_(channel_socketpair) ( Int fd0, Int fd1 )
+{
+   ShadowFifo *a, *b;
+   if (!valid_fd(fd0) || !valid_fd(fd1))
+      return;
+   a = new_fifo();
+   b = new_fifo();
+   set_endpoint(fd0, b, a, True);
+   set_endpoint(fd1, a, b, True);
+}
+
+/* Is f the outgoing FIFO of a connection not yet accepted?  If
+   'forget', it won't be paired any more. */
+static Bool is_pending ( ShadowFifo* f, Bool forget )
+{
+   PendingConn **pp, *p;
+
+   for (pp = &pending; (p = *pp) != NULL; pp = &p->next) {
+      if (endpoints[p->fd].out == f) {
+         if (forget) {
+            *pp = p->next;
+            VG_(free)(p);
+         }
+         return True;
+      }
+   }
+   return False;
+}
+
+void FL_(channel_write) ( Int fd, Addr buf, SizeT len )
+{
+   ShadowFifo* f;
+   SizeT       n;
+   Bool        tainted;
+   Int         i;
+
+   if (!valid_fd(fd) || (f = endpoints[fd].out) == NULL)
+      return;
+   // Nothing will ever read what an unpaired end writes, unless it is
+   // a connection that accept() may still pair up.
+   if (!endpoints[fd].paired && !is_pending(f, False))
+      return;
+   if (f->queued + len > MAX_QUEUED) {
+      // Unpair both ends, and any dups of them, so that neither
+      // writes into nor reads from the emptied FIFO again.
+      is_pending(f, True);
+      clear_fifo(f);
+      for (i = 0; i < FL_MAXIMUM_FDS; i++)
+         if (endpoints[i].in == f || endpoints[i].out == f)
+            endpoints[i].paired = False;
+      return;
+   }
+   if (!VG_(am_is_valid_for_client)(buf, len, VKI_PROT_READ))
+      return;
+   while (len > 0) {
+      n = FL_(taint_run_length)(buf, len, &tainted);
+      push_run(f, n, tainted);
+      buf += n;
+      len -= n;
+   }
+}
+
+SizeT FL_(channel_read) ( Int fd, Addr buf, SizeT len, Bool peek )
+{
+   if (!valid_fd(fd) || !endpoints[fd].paired)
+      return 0;
+   return pop_runs(endpoints[fd].in, buf, len, peek);
+}
+
+/* ------------------ Local connections ------------------ */
+
+/* Fills in 'key' from a sockaddr, for AF_INET and AF_UNIX only. */
+static Bool key_from_sockaddr ( ChannelKey* key,
+                                struct vki_sockaddr* sa, Int salen )
+{
+   VG_(memset)(key, 0, sizeof(*key));
+   if (salen < sizeof(sa->sa_family))
+      return False;
+
+   if (sa->sa_family == VKI_AF_INET
+       && salen >= sizeof(struct vki_sockaddr_in)) {
+      struct vki_sockaddr_in* sin = (struct vki_sockaddr_in*)sa;
+      key->family = VKI_AF_INET;
+      key->addr   = sin->sin_addr.s_addr;
+      key->port   = sin->sin_port;
+      return True;
+   }
+   if (sa->sa_family == VKI_AF_UNIX) {
+      struct vki_sockaddr_un* un = (struct vki_sockaddr_un*)sa;
+      Int n = salen - (Int)sizeof(un->sun_family);
+      if (n <= 0)
+         return False;
+      if (n > VKI_UNIX_PATH_MAX)
+         n = VKI_UNIX_PATH_MAX;
+      key->family = VKI_AF_UNIX;
+      if (un->sun_path[0] != '\0') {
+         // A pathname: salen may well cover junk after its NUL, which
+         // getsockname() on the listener won't give back.
+         Int i;
+         for (i = 0; i < n && un->sun_path[i] != '\0'; i++)
+            key->path[i] = un->sun_path[i];
+      } else {
+         // Abstract names start with a NUL and go up to salen.
+         VG_(memcpy)(key->path, un->sun_path, n);
+      }
+      return True;
+   }
+   return False;
+}
+
+static Bool is_loopback ( UInt addr /* network order */ )
+{
+   return ((UChar*)&addr)[0] == 127;
+}
+
+/* After connect(fd, sa, salen) -- successful or in progress. */
+void FL_(channel_connect) ( Int fd, Addr sa, Int salen )
+{
+   union {
+      struct vki_sockaddr    sa;
+      struct vki_sockaddr_in sin;
+      struct vki_sockaddr_un un;
+   } name;
+   Int          namelen;
+   ChannelKey   key;
+   PendingConn* p;
+
+   if (!valid_fd(fd) || sa == 0 || salen <= 0
+       || !VG_(am_is_valid_for_client)(sa, salen, VKI_PROT_READ))
+      return;
+   if (!key_from_sockaddr(&key, (struct vki_sockaddr*)sa, salen))
+      return;
+
+   if (key.family == VKI_AF_INET) {
+      // Only the local end identifies this connection to accept().
+      if (!is_loopback(key.addr))
+         return;
+      namelen = sizeof(name);
+      if (VG_(getsockname)(fd, &name.sa, &namelen) != 0
+          || !key_from_sockaddr(&key, &name.sa, namelen))
+         return;
+   }
+
+   set_endpoint(fd, new_fifo(), new_fifo(), False);
+   p = VG_(malloc)(sizeof(PendingConn));
+   p->key  = key;
+   p->fd   = fd;
+   p->next = pending;
+   pending = p;
+}
+
+/* After accept() on lfd returned fd. */
+void FL_(channel_accept) ( Int lfd, Int fd )
+{
+   union {
+      struct vki_sockaddr    sa;
+      struct vki_sockaddr_in sin;
+      struct vki_sockaddr_un un;
+   } name;
+   Int           namelen = sizeof(name);
+   ChannelKey    key;
+   PendingConn **pp, **oldest = NULL, *p;
+
+   if (!valid_fd(lfd) || !valid_fd(fd))
+      return;
+
+   // The peer's name for AF_INET, our own (the listener's) for AF_UNIX,
+   // since the connecting end of those is usually unnamed.
+   if (VG_(getpeername)(fd, &name.sa, &namelen) != 0
+       || !key_from_sockaddr(&key, &name.sa, namelen)
+       || key.family != VKI_AF_INET) {
+      namelen = sizeof(name);
+      if (VG_(getsockname)(lfd, &name.sa, &namelen) != 0
+          || !key_from_sockaddr(&key, &name.sa, namelen)
+          || key.family != VKI_AF_UNIX)
+         return;
+   }
+
+   // Several clients may be queued on one AF_UNIX path; the listen
+   // queue is FIFO, so take the one that connected first.
+   for (pp = &pending; (p = *pp) != NULL; pp = &p->next) {
+      if (VG_(memcmp)(&p->key, &key, sizeof(key)) == 0)
+         oldest = pp;
+   }
+   if (oldest == NULL)
+      return;
+
+   p = *oldest;
+   *oldest = p->next;
+   endpoints[p->fd].paired = True;
+   set_endpoint(fd, endpoints[p->fd].out, endpoints[p->fd].in, True);
+   VG_(free)(p);
+}
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
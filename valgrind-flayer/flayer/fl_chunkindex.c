@@ -0,0 +1,297 @@
+/*--------------------------------------------------------------------*/
+/*--- Index of malloc'd blocks.                                    ---*/
+/*---                                              fl_chunkindex.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Flayer, a heavyweight Valgrind tool for
+   tracking marked/tainted data through memory.
+
+   Copyright (C) 2006-2007 Google Inc. (Will Drewry)
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+/* FL_(malloc_list) used to be a VgHashTable with a fixed 80021 chains,
+ * which get long with millions of live blocks.  This replaces it with
+ *
+ * - an open addressing table (linear probing) of FL_Chunk pointers,
+ *   keyed by block address, for malloc/free/realloc.  When it gets
+ *   3/4 full a table twice the size is started; new blocks go there,
+ *   and every operation moves a few entries across from the old one,
+ *   so there is never a stop-the-world rehash.  Entries removed from
+ *   the old table leave tombstones, so that nothing is moved behind
+ *   the migration's back.
+ *
+ * - an OSet of the blocks in address order, so that describe_addr()
+ *   can find the block enclosing an interior pointer in O(log n).
+ */
+
+#include "pub_tool_basics.h"
+#include "pub_tool_libcbase.h"
+#include "pub_tool_libcassert.h"
+#include "pub_tool_hashtable.h"
+#include "pub_tool_mallocfree.h"
+#include "pub_tool_oset.h"
+#include "pub_tool_replacemalloc.h"
+#include "pub_tool_tooliface.h"     // Needed for fl_include.h
+
+#include "fl_include.h"
+
+#define INITIAL_SLOTS  (1 << 16)
+#define MIGRATE_STEP   16
+
+/* Marks a slot of the old table whose entry has gone. */
+#define TOMBSTONE      ((FL_Chunk*)1)
+
+typedef
+   struct {
+      FL_Chunk** slots;
+      UInt       n_slots;     // a power of two, or 0
+      UInt       n_used;      // live entries (not tombstones)
+   }
+   Table;
+
+typedef
+   struct {
+      Addr      data;         // key: mc->data
+      FL_Chunk* mc;
+   }
+   AddrNode;
+
+struct _FL_ChunkIndex {
+   Table cur;                 // where new entries go
+   Table old;                 // being drained into cur, if n_slots != 0
+   UInt  migrate_pos;         // next slot of old to drain
+   OSet* by_addr;             // AddrNodes, in address order
+};
+
+static UInt home_slot ( Table* t, Addr data )
+{
+   UWord h = (UWord)data >> 3;
+   h *= 2654435761U;
+   return (UInt)(h ^ (h >> 16)) & (t->n_slots - 1);
+}
+
+static void init_table ( Table* t, UInt n_slots )
+{
+   t->slots   = VG_(calloc)(n_slots, sizeof(FL_Chunk*));
+   t->n_slots = n_slots;
+   t->n_used  = 0;
+}
+
+/* Slot of the entry for 'data' in t, or -1. */
+static Int find_slot ( Table* t, Addr data )
+{
+   UInt i;
+
+   if (t->n_slots == 0)
+      return -1;
+   for (i = home_slot(t, data); t->slots[i] != NULL;
+        i = (i + 1) & (t->n_slots - 1)) {
+      if (t->slots[i] != TOMBSTONE && t->slots[i]->data == data)
+         return i;
+   }
+   return -1;
+}
+
+static void insert_into ( Table* t, FL_Chunk* mc )
+{
+   UInt i = home_slot(t, mc->data);
+   while (t->slots[i] != NULL)
+      i = (i + 1) & (t->n_slots - 1);
+   t->slots[i] = mc;
+   t->n_used++;
+}
+
+/* Remove slot i from cur, shifting later entries of its probe run back
+   so that no tombstone is needed. */
+static void remove_from_cur ( Table* t, UInt i )
+{
+   UInt mask = t->n_slots - 1;
+   UInt j = i;
+   UInt k;
+
+   t->slots[i] = NULL;
+   t->n_used--;
+   while (True) {
+      j = (j + 1) & mask;
+      if (t->slots[j] == NULL)
+         return;
+      k = home_slot(t, t->slots[j]->data);
+      /* Can the entry at j move to i?  Only if its home isn't
+         cyclically in (i, j]. */
+      if ( (i <= j) ? (i < k && k <= j) : (i < k || k <= j) )
+         continue;
+      t->slots[i] = t->slots[j];
+      t->slots[j] = NULL;
+      i = j;
+   }
+}
+
+/* Move a few entries of the old table into the new one. */
+static void migrate_some ( FL_ChunkIndex* ci )
+{
+   Int n;
+
+   if (ci->old.n_slots == 0)
+      return;
+   for (n = 0; n < MIGRATE_STEP && ci->migrate_pos < ci->old.n_slots; n++) {
+      FL_Chunk* mc = ci->old.slots[ci->migrate_pos];
+      if (mc != NULL && mc != TOMBSTONE) {
+         insert_into(&ci->cur, mc);
+         ci->old.slots[ci->migrate_pos] = TOMBSTONE;
+         ci->old.n_used--;
+      }
+      ci->migrate_pos++;
+   }
+   if (ci->migrate_pos == ci->old.n_slots) {
+      tl_assert(ci->old.n_used == 0);
+      VG_(free)(ci->old.slots);
+      ci->old.slots   = NULL;
+      ci->old.n_slots = 0;
+   }
+}
+
+static Word cmp_addr ( void* key, void* elem )
+{
+   Addr a = *(Addr*)key;
+   Addr b = ((AddrNode*)elem)->data;
+   return a < b ? -1 : a > b ? 1 : 0;
+}
+
+typedef
+   struct {
+      Addr  a;
+      SizeT rzB;
+   }
+   EnclosingKey;
+
+static Word cmp_enclosing ( void* key, void* elem )
+{
+   EnclosingKey* k  = (EnclosingKey*)key;
+   FL_Chunk*     mc = ((AddrNode*)elem)->mc;
+   if (VG_(addr_is_in_block)( k->a, mc->data, mc->szB, k->rzB ))
+      return 0;
+   return k->a < mc->data ? -1 : 1;
+}
+
+FL_ChunkIndex* FL_(chunk_index_create) ( void )
+{
+   FL_ChunkIndex* ci = VG_(malloc)(sizeof(FL_ChunkIndex));
+   init_table(&ci->cur, INITIAL_SLOTS);
+   ci->old.slots   = NULL;
+   ci->old.n_slots = 0;
+   ci->old.n_used  = 0;
+   ci->migrate_pos = 0;
+   ci->by_addr     = VG_(OSet_Create)(offsetof(AddrNode, data), cmp_addr,
+                                      VG_(malloc), VG_(free));
+   return ci;
+}
+
+void FL_(chunk_index_add) ( FL_ChunkIndex* ci, FL_Chunk* mc )
+{
+   AddrNode* n;
+
+   /* A client can describe the same block twice with MALLOCLIKE_BLOCK;
+      the later one wins, as it did in the VgHashTable. */
+   FL_(chunk_index_remove)(ci, mc->data);
+
+   if (ci->old.n_slots == 0 && ci->cur.n_used + 1 > ci->cur.n_slots / 4 * 3) {
+      /* Start moving to a table twice the size. */
+      ci->old = ci->cur;
+      ci->migrate_pos = 0;
+      init_table(&ci->cur, ci->old.n_slots * 2);
+   }
+   insert_into(&ci->cur, mc);
+
+   n = VG_(OSet_AllocNode)(ci->by_addr, sizeof(AddrNode));
+   n->data = mc->data;
+   n->mc   = mc;
+   VG_(OSet_Insert)(ci->by_addr, n);
+}
+
+FL_Chunk* FL_(chunk_index_lookup) ( FL_ChunkIndex* ci, Addr data )
+{
+   Int i = find_slot(&ci->cur, data);
+   if (i >= 0)
+      return ci->cur.slots[i];
+   i = find_slot(&ci->old, data);
+   if (i >= 0)
+      return ci->old.slots[i];
+   return NULL;
+}
+
+FL_Chunk* FL_(chunk_index_remove) ( FL_ChunkIndex* ci, Addr data )
+{
+   FL_Chunk* mc;
+   AddrNode* n;
+   Int       i;
+
+   migrate_some(ci);
+   if ((i = find_slot(&ci->cur, data)) >= 0) {
+      mc = ci->cur.slots[i];
+      remove_from_cur(&ci->cur, i);
+   } else if ((i = find_slot(&ci->old, data)) >= 0) {
+      mc = ci->old.slots[i];
+      ci->old.slots[i] = TOMBSTONE;
+      ci->old.n_used--;
+   } else {
+      return NULL;
+   }
+
+   n = VG_(OSet_Remove)(ci->by_addr, &data);
+   tl_assert(n != NULL && n->mc == mc);
+   VG_(OSet_FreeNode)(ci->by_addr, n);
+   return mc;
+}
+
+/* The block whose extent, with rzB either side, covers a. */
+FL_Chunk* FL_(chunk_index_find_enclosing) ( FL_ChunkIndex* ci,
+                                            Addr a, SizeT rzB )
+{
+   EnclosingKey k;
+   AddrNode*    n;
+
+   k.a   = a;
+   k.rzB = rzB;
+   n = VG_(OSet_LookupWithCmp)(ci->by_addr, &k, cmp_enclosing);
+   return n ? n->mc : NULL;
+}
+
+UInt FL_(chunk_index_size) ( FL_ChunkIndex* ci )
+{
+   return ci->cur.n_used + ci->old.n_used;
+}
+
+/* Visits the blocks in address order.  Like VG_(OSet_Next), stops
+   (returns NULL) if the index is changed along the way. */
+void FL_(chunk_index_reset_iter) ( FL_ChunkIndex* ci )
+{
+   VG_(OSet_ResetIter)(ci->by_addr);
+}
+
+FL_Chunk* FL_(chunk_index_next) ( FL_ChunkIndex* ci )
+{
+   AddrNode* n = VG_(OSet_Next)(ci->by_addr);
+   return n ? n->mc : NULL;
+}
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
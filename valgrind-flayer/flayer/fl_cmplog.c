@@ -0,0 +1,223 @@
+/*--------------------------------------------------------------------*/
+/*--- Logging of comparisons against tainted data.                 ---*/
+/*---                                                  fl_cmplog.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Flayer, a heavyweight Valgrind tool for
+   tracking marked/tainted data through memory.
+
+   Copyright (C) 2006-2007 Google Inc. (Will Drewry)
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+/* With --emit-cmp-log=<file>, every equality comparison of tainted
+ * against untainted data -- CmpEQ/CmpNE on 32 and 64 bit values, and
+ * strcmp(), strncmp() and memcmp() -- is appended to <file>, so that a
+ * driver can find the tainted operand's bytes in its input and patch
+ * in the value it was compared with instead of flipping the branch
+ * blindly.  libflayer's valgrind.cmplog reads it.
+ *
+ * The file is FL_CMPLOG_MAGIC followed by records of
+ *
+ *   UChar kind        FL_CmpLog_Insn, _Str or _Mem
+ *   UChar len         bytes per operand, at most FL_CMPLOG_MAX_LEN
+ *   ULong pc          the comparing instruction, or the string
+ *                     function's caller; little-endian
+ *   UChar tainted[len]    the tainted operand
+ *   UChar untainted[len]  the untainted operand
+ *   UChar mask[len]       0xff for each byte of 'tainted' that is
+ *                         (even partly) tainted, else 0
+ *
+ * Instruction operands are written little-endian.  Repeats of the same
+ * comparison are mostly dropped.  In fork server children the log goes
+ * to <file>.<pid>.
+ */
+
+#include "pub_tool_basics.h"
+#include "pub_tool_vki.h"
+#include "pub_tool_libcbase.h"
+#include "pub_tool_libcassert.h"
+#include "pub_tool_libcfile.h"
+#include "pub_tool_libcprint.h"
+#include "pub_tool_libcproc.h"
+#include "pub_tool_machine.h"
+#include "pub_tool_hashtable.h"
+#include "pub_tool_stacktrace.h"
+#include "pub_tool_threadstate.h"
+#include "pub_tool_tooliface.h"     // Needed for fl_include.h
+
+#include "fl_include.h"
+
+#define FL_CMPLOG_MAGIC "FLCMPLG1"
+
+static Int   cmp_log_fd = -1;
+static UChar cmp_log_buf[65536];
+static Int   cmp_log_used = 0;
+
+/* Hashes of recently logged comparisons, direct mapped. */
+#define N_SEEN 4096
+static UInt seen[N_SEEN];
+
+static Bool open_cmp_log ( Char* path )
+{
+   SysRes sres = VG_(open)(path, VKI_O_CREAT|VKI_O_TRUNC|VKI_O_WRONLY,
+                           VKI_S_IRUSR|VKI_S_IWUSR);
+   if (sres.isError) {
+      VG_(message)(Vg_UserMsg, "can't create cmp log '%s'", path);
+      return False;
+   }
+   cmp_log_fd = sres.res;
+   VG_(memcpy)(cmp_log_buf, FL_CMPLOG_MAGIC, 8);
+   cmp_log_used = 8;
+   VG_(memset)(seen, 0, sizeof(seen));
+   return True;
+}
+
+Bool FL_(setup_cmp_log) ( void )
+{
+   if (FL_(clo_emit_cmp_log) == NULL)
+      return True;
+   return open_cmp_log(FL_(clo_emit_cmp_log));
+}
+
+void FL_(cmp_log_flush) ( void )
+{
+   if (cmp_log_fd < 0 || cmp_log_used == 0)
+      return;
+   VG_(write)(cmp_log_fd, cmp_log_buf, cmp_log_used);
+   cmp_log_used = 0;
+}
+
+/* In a fork server child: start a log of its own. */
+void FL_(cmp_log_reopen_for_child) ( void )
+{
+   Char path[VKI_PATH_MAX];
+
+   if (cmp_log_fd < 0)
+      return;
+   VG_(close)(cmp_log_fd);
+   cmp_log_fd = -1;
+   cmp_log_used = 0;
+   VG_(snprintf)(path, sizeof(path), "%s.%d",
+                 FL_(clo_emit_cmp_log), VG_(getpid)());
+   open_cmp_log(path);
+}
+
+void FL_(cmp_log_fini) ( void )
+{
+   FL_(cmp_log_flush)();
+   if (cmp_log_fd >= 0)
+      VG_(close)(cmp_log_fd);
+   cmp_log_fd = -1;
+}
+
+static UInt hash_bytes ( UInt h, const UChar* p, Int n )
+{
+   Int i;
+   for (i = 0; i < n; i++)
+      h = (h ^ p[i]) * 16777619;
+   return h;
+}
+
+void FL_(cmp_log) ( UChar kind, Addr pc, const UChar* tainted,
+                    const UChar* untainted, const UChar* mask, Int len )
+{
+   ULong pc64 = pc;
+   UInt  h;
+   Int   i;
+   UChar* p;
+
+   if (cmp_log_fd < 0 || len <= 0)
+      return;
+   if (len > FL_CMPLOG_MAX_LEN)
+      len = FL_CMPLOG_MAX_LEN;
+
+   h = hash_bytes(2166136261U, (UChar*)&pc64, sizeof(pc64));
+   h = hash_bytes(h, tainted, len);
+   h = hash_bytes(h, untainted, len);
+   h = (h ^ kind) | 1;
+   if (seen[h % N_SEEN] == h)
+      return;
+   seen[h % N_SEEN] = h;
+
+   if (cmp_log_used + 2 + 8 + 3 * len > sizeof(cmp_log_buf))
+      FL_(cmp_log_flush)();
+
+   p = &cmp_log_buf[cmp_log_used];
+   *p++ = kind;
+   *p++ = (UChar)len;
+   for (i = 0; i < 8; i++)
+      *p++ = (UChar)(pc64 >> (8 * i));
+   VG_(memcpy)(p, tainted, len);    p += len;
+   VG_(memcpy)(p, untainted, len);  p += len;
+   VG_(memcpy)(p, mask, len);       p += len;
+   cmp_log_used = p - cmp_log_buf;
+}
+
+/* Called from generated code, guarded so that only compares with some
+   taint get here.  Logged if exactly one side is tainted. */
+static void log_cmp_insn ( Int szB, ULong x, ULong y, ULong vx, ULong vy )
+{
+   UChar  t[8], u[8], m[8];
+   ULong  tv, uv, tvbits;
+   Int    i;
+
+   if (vx != 0 && vy == 0) {
+      tv = x; tvbits = vx; uv = y;
+   } else if (vy != 0 && vx == 0) {
+      tv = y; tvbits = vy; uv = x;
+   } else {
+      return;
+   }
+   for (i = 0; i < szB; i++) {
+      t[i] = (UChar)(tv >> (8 * i));
+      u[i] = (UChar)(uv >> (8 * i));
+      m[i] = ((tvbits >> (8 * i)) & 0xFF) ? 0xFF : 0;
+   }
+   FL_(cmp_log)(FL_CmpLog_Insn, VG_(get_IP)(VG_(get_running_tid)()),
+                t, u, m, szB);
+}
+
+void FL_(helperc_log_cmp4) ( ULong x, ULong y, ULong vx, ULong vy )
+{
+   log_cmp_insn(4, x, y, vx & 0xFFFFFFFFULL, vy & 0xFFFFFFFFULL);
+}
+
+void FL_(helperc_log_cmp8) ( ULong x, ULong y, ULong vx, ULong vy )
+{
+   log_cmp_insn(8, x, y, vx, vy);
+}
+
+/* For the string functions in fl_main.c: the caller of the replacement
+   is more use than the replacement itself. */
+Addr FL_(cmp_log_caller) ( ThreadId tid )
+{
+   Addr ips[2];
+   UInt n_ips = FL_(shadow_stack_trace)(tid, ips, 2);
+   if (n_ips == 0)
+      n_ips = VG_(get_StackTrace)(tid, ips, 2);
+   if (n_ips < 2)
+      return VG_(get_IP)(tid);
+   return ips[1];
+}
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
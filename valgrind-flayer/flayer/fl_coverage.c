@@ -0,0 +1,129 @@
+/*--------------------------------------------------------------------*/
+/*--- AFL-style coverage bitmaps in shared memory.                 ---*/
+/*---                                                fl_coverage.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Flayer, a heavyweight Valgrind tool for
+   tracking marked/tainted data through memory.
+
+   Copyright (C) 2006-2007 Google Inc. (Will Drewry)
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+/* With --coverage-shm=<name>, generated code keeps two bitmaps of
+ * FL_COVERAGE_MAP_SIZE bytes each in the shared memory object
+ * /dev/shm/<name>, which the driver creates and clears before each
+ * run, so that it gets feedback without parsing the error log:
+ *
+ * - edges: entering a superblock adds one (wrapping, as AFL does) to
+ *   edges[prev ^ cur], where cur is a hash of the superblock's address
+ *   and prev is cur >> 1 of the superblock entered before it.
+ *
+ * - branches: a conditional exit whose guard is tainted sets
+ *   branches[(hash of its pc) << 1 | taken] to 1.  A driver altering
+ *   a branch can tell from this whether the other side was ever
+ *   actually taken.
+ *
+ * Both updates are inline in the generated code; see coverageEdge
+ * and coverageBranch in fl_translate.c.  A superblock may run on
+ * through several guest basic blocks, so an edge is really between
+ * superblocks, which is what VEX's chasing makes of AFL's blocks.
+ */
+
+#include "pub_tool_basics.h"
+#include "pub_tool_vki.h"
+#include "pub_tool_libcbase.h"
+#include "pub_tool_libcassert.h"
+#include "pub_tool_libcfile.h"
+#include "pub_tool_libcprint.h"
+#include "pub_tool_aspacemgr.h"
+#include "pub_tool_hashtable.h"
+#include "pub_tool_tooliface.h"     // Needed for fl_include.h
+
+#include "fl_include.h"
+
+#define MAX_PATH 256
+
+/* The edges map, followed by the branches map; NULL if not enabled. */
+UChar* FL_(coverage_map)  = NULL;
+/* cur >> 1 of the last superblock entered. */
+UWord  FL_(coverage_prev) = 0;
+
+Bool FL_(setup_coverage_shm) ( void )
+{
+   Char            path[MAX_PATH];
+   Char*           name = FL_(clo_coverage_shm);
+   struct vki_stat st;
+   SysRes          sres;
+   Int             fd;
+
+   if (name == NULL)
+      return True;
+
+   while (*name == '/')
+      name++;
+   if (*name == '\0'
+       || VG_(strlen)(name) + VG_(strlen)("/dev/shm/") >= MAX_PATH)
+      return False;
+   VG_(strcpy)(path, "/dev/shm/");
+   VG_(strcat)(path, name);
+
+   sres = VG_(open)(path, VKI_O_RDWR, 0);
+   if (sres.isError) {
+      VG_(message)(Vg_UserMsg, "can't open coverage shm '%s'", path);
+      return False;
+   }
+   fd = sres.res;
+   if (VG_(fstat)(fd, &st) != 0 || st.st_size < 2 * FL_COVERAGE_MAP_SIZE) {
+      VG_(message)(Vg_UserMsg, "coverage shm '%s' is smaller than %d bytes",
+                   path, 2 * FL_COVERAGE_MAP_SIZE);
+      VG_(close)(fd);
+      return False;
+   }
+   sres = VG_(am_shared_mmap_file_float_valgrind)
+             ( 2 * FL_COVERAGE_MAP_SIZE, VKI_PROT_READ|VKI_PROT_WRITE, fd, 0 );
+   VG_(close)(fd);
+   if (sres.isError) {
+      VG_(message)(Vg_UserMsg, "can't map coverage shm '%s'", path);
+      return False;
+   }
+
+   FL_(coverage_map)  = (UChar*)sres.res;
+   FL_(coverage_prev) = 0;
+   return True;
+}
+
+/* Where a superblock at a lands in the maps, before the xor. */
+UWord FL_(coverage_block_id) ( Addr64 a )
+{
+   UWord h = (UWord)a;
+   return ((h >> 4) ^ (h << 8)) & (FL_COVERAGE_MAP_SIZE - 1);
+}
+
+/* A fork server child or a new persistent-mode iteration starts a
+   fresh path; the driver has cleared the maps. */
+void FL_(coverage_new_run) ( void )
+{
+   FL_(coverage_prev) = 0;
+}
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
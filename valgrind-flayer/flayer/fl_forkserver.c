@@ -0,0 +1,185 @@
+/*--------------------------------------------------------------------*/
+/*--- Fork server: snapshot the process once it is initialised.   ---*/
+/*---                                               fl_forkserver.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Flayer, a heavyweight Valgrind tool for
+   tracking marked/tainted data through memory.
+
+   Copyright (C) 2006-2007 Google Inc. (Will Drewry)
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+/* With --fork-server=yes the client runs normally until the point
+ * chosen by --fork-at.  There the whole of valgrind -- translation
+ * cache, shadow memory, debuginfo and all -- turns into a server which
+ * forks one child per test case, so the children start from the
+ * snapshot copy-on-write instead of re-executing startup.
+ *
+ * The driver talks to us over two inherited fds:
+ *
+ *   FL_FORKSRV_CTL_FD  driver -> flayer  4 bytes per test case (ignored)
+ *   FL_FORKSRV_ST_FD   flayer -> driver  4 byte hello once, then per
+ *                                        test case the child's pid
+ *                                        followed by its wait status
+ *
+ * If the hello can't be written there is no driver and the client
+ * just carries on.  When the control fd hits EOF the server exits.
+ */
+
+#include "pub_tool_basics.h"
+#include "pub_tool_vki.h"
+#include "pub_tool_libcbase.h"
+#include "pub_tool_libcassert.h"
+#include "pub_tool_libcprint.h"
+#include "pub_tool_libcproc.h"
+#include "pub_tool_libcfile.h"
+#include "pub_tool_hashtable.h"
+#include "pub_tool_threadstate.h"
+#include "pub_tool_tooliface.h"     // Needed for fl_include.h
+
+#include "fl_include.h"
+
+typedef
+   enum {
+      ForkAt_FirstRead,       // just before the first read() of a tainted fd
+      ForkAt_ClientRequest,   // VALGRIND_FLAYER_FORK_SERVER in the client
+      ForkAt_Addr             // on reaching a given instruction
+   }
+   ForkAtKind;
+
+static ForkAtKind fork_at_kind = ForkAt_FirstRead;
+static Addr       fork_at_addr = 0;
+static Bool       fork_server_started = False;
+
+Bool FL_(setup_fork_server)( void )
+{
+   Char* str = FL_(clo_fork_at);
+
+   if (str == NULL || VG_STREQ(str, "first-read")) {
+      fork_at_kind = ForkAt_FirstRead;
+   } else if (VG_STREQ(str, "client-request")) {
+      fork_at_kind = ForkAt_ClientRequest;
+   } else if (VG_(strncmp)(str, "0x", 2) == 0) {
+      Char* p;
+      fork_at_kind = ForkAt_Addr;
+      fork_at_addr = 0;
+      for (p = str + 2; *p; p++) {
+         if      (*p >= '0' && *p <= '9') fork_at_addr = fork_at_addr*16 + (*p - '0');
+         else if (*p >= 'a' && *p <= 'f') fork_at_addr = fork_at_addr*16 + (*p - 'a' + 10);
+         else if (*p >= 'A' && *p <= 'F') fork_at_addr = fork_at_addr*16 + (*p - 'A' + 10);
+         else return False;
+      }
+   } else {
+      return False;
+   }
+   return True;
+}
+
+/* Runs the server loop.  Returns only in a child, or if no driver is
+   listening, in which case the client continues as if nothing
+   happened.  If rewind_fd is a seekable fd its offset is put back for
+   each child, so every test case reads the input from the start. */
+static void run_fork_server ( ThreadId tid, Int rewind_fd )
+{
+   UInt msg = 0;
+   Int  pid, status;
+   OffT offset = -1;
+
+   if (fork_server_started)
+      return;
+   fork_server_started = True;
+
+   if (VG_(write)(FL_FORKSRV_ST_FD, &msg, sizeof(msg)) != sizeof(msg)) {
+      VG_(message)(Vg_UserMsg,
+                   "fork server: no driver on fd %d, running normally",
+                   FL_FORKSRV_ST_FD);
+      return;
+   }
+
+   if (rewind_fd >= 0)
+      offset = VG_(lseek)(rewind_fd, 0, VKI_SEEK_CUR);
+   FL_(cmp_log_flush)();
+   FL_(output_flush)();
+
+   while (True) {
+      if (VG_(read)(FL_FORKSRV_CTL_FD, &msg, sizeof(msg)) != sizeof(msg))
+         VG_(exit)(0);
+
+      if (offset >= 0)
+         VG_(lseek)(rewind_fd, offset, VKI_SEEK_SET);
+
+      pid = VG_(fork_process)(tid);
+      if (pid < 0)
+         VG_(tool_panic)("fork server: fork failed");
+
+      if (pid == 0) {
+         /* The test case proper. */
+         VG_(close)(FL_FORKSRV_CTL_FD);
+         VG_(close)(FL_FORKSRV_ST_FD);
+         VG_(reopen_log_file_for_child)();
+         FL_(cmp_log_reopen_for_child)();
+         FL_(output_reopen_for_child)();
+         FL_(coverage_new_run)();
+         return;
+      }
+
+      if (VG_(write)(FL_FORKSRV_ST_FD, &pid, sizeof(pid)) != sizeof(pid))
+         VG_(exit)(1);
+      if (VG_(waitpid)(pid, &status, 0) < 0)
+         VG_(exit)(1);
+      if (VG_(write)(FL_FORKSRV_ST_FD, &status, sizeof(status))
+          != sizeof(status))
+         VG_(exit)(1);
+   }
+}
+
+void FL_(fork_server_pre_read) ( ThreadId tid, Int fd )
+{
+   if (FL_(clo_fork_server) && fork_at_kind == ForkAt_FirstRead)
+      run_fork_server(tid, fd);
+}
+
+void FL_(fork_server_client_request) ( ThreadId tid )
+{
+   if (FL_(clo_fork_server) && fork_at_kind == ForkAt_ClientRequest)
+      run_fork_server(tid, -1);
+}
+
+/* Whether to call FL_(helperc_fork_server) before the instruction at
+   a.  This depends on the options only, not on whether the server has
+   started, so that a translation made in a child (after a discard, say)
+   is the same as the one saved by --translation-cache; the helper does
+   nothing once the server is running. */
+Bool FL_(fork_server_at) ( Addr64 a )
+{
+   return FL_(clo_fork_server) && fork_at_kind == ForkAt_Addr
+          && (Addr)a == fork_at_addr;
+}
+
+/* Called from generated code at --fork-at=0xADDR. */
+void FL_(helperc_fork_server) ( void )
+{
+   run_fork_server(VG_(get_running_tid)(), -1);
+}
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
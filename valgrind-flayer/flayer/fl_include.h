@@ -77,6 +77,20 @@ typedef
    FL_Mempool;
 
 
+/* Index of malloc'd blocks, in fl_chunkindex.c. */
+typedef struct _FL_ChunkIndex FL_ChunkIndex;
+
+extern FL_ChunkIndex* FL_(chunk_index_create) ( void );
+extern void      FL_(chunk_index_add)    ( FL_ChunkIndex* ci, FL_Chunk* mc );
+extern FL_Chunk* FL_(chunk_index_lookup) ( FL_ChunkIndex* ci, Addr data );
+extern FL_Chunk* FL_(chunk_index_remove) ( FL_ChunkIndex* ci, Addr data );
+extern FL_Chunk* FL_(chunk_index_find_enclosing) ( FL_ChunkIndex* ci,
+                                                   Addr a, SizeT rzB );
+extern UInt      FL_(chunk_index_size)   ( FL_ChunkIndex* ci );
+extern void      FL_(chunk_index_reset_iter) ( FL_ChunkIndex* ci );
+extern FL_Chunk* FL_(chunk_index_next)   ( FL_ChunkIndex* ci );
+
+/* 'table' is the mempool's chunks, or NULL for FL_(malloc_list). */
 extern void* FL_(new_block)  ( ThreadId tid,
                                Addr p, SizeT size, SizeT align, UInt rzB,
                                Bool is_zeroed, FL_AllocKind kind,
@@ -96,8 +110,12 @@ extern Bool FL_(mempool_exists)  ( Addr pool );
 
 extern FL_Chunk* FL_(get_freed_list_head)( void );
 
+/* --heap-mode; FL_(malloc_redzone_szB) is 0 in fast mode. */
+extern Bool  FL_(setup_heap_mode)( void );
+extern SizeT FL_(malloc_redzone_szB);
+
 /* For tracking malloc'd blocks */
-extern VgHashTable FL_(malloc_list);
+extern FL_ChunkIndex* FL_(malloc_list);
 
 /* For tracking memory pools. */
 extern VgHashTable FL_(mempool_list);
@@ -108,6 +126,7 @@ extern void FL_(make_mem_noaccess) ( Addr a, SizeT len );
 extern void FL_(make_mem_undefined)( Addr a, SizeT len );
 extern void FL_(make_mem_defined)  ( Addr a, SizeT len );
 extern void FL_(copy_address_range_state) ( Addr src, Addr dst, SizeT len );
+extern SizeT FL_(taint_run_length) ( Addr a, SizeT len, Bool* tainted );
 
 extern void FL_(print_malloc_stats) ( void );
 
@@ -128,11 +147,91 @@ extern void FL_(syscall_socketcall)(ThreadId tid, SysRes res);
 extern void FL_(syscall_connect)(ThreadId tid, SysRes res);
 extern void FL_(syscall_accept)(ThreadId tid, SysRes res);
 extern void FL_(syscall_socket)(ThreadId tid, SysRes res);
+extern void FL_(syscall_bind)(ThreadId tid, SysRes res);
 extern void FL_(syscall_socketpair)(ThreadId tid, SysRes res);
 extern void FL_(syscall_recvfrom)(ThreadId tid, SysRes res);
 extern void FL_(syscall_recvmsg)(ThreadId tid, SysRes res);
+extern void FL_(syscall_send)(ThreadId tid, SysRes res);
+extern void FL_(syscall_write)(ThreadId tid, SysRes res);
+extern void FL_(syscall_pipe)(ThreadId tid, SysRes res);
+extern void FL_(syscall_dup)(ThreadId tid, SysRes res);
 extern void FL_(setup_tainted_map)( void );
+extern Bool FL_(setup_network_filter)( void );
+extern Bool FL_(setup_input_shm)( void );
 extern void FL_(setup_guest_args)( void );
+extern void FL_(syscall_pre_read)(ThreadId tid);
+extern void FL_(untaint_guest_state)( void );
+extern ULong FL_(n_input_bytes_tainted);
+
+/* fds above this are never tainted nor tracked. */
+#define FL_MAXIMUM_FDS 256
+
+/* Functions defined in fl_channels.c */
+extern void  FL_(channel_pipe)       ( Int rfd, Int wfd );
+extern void  FL_(channel_socketpair) ( Int fd0, Int fd1 );
+extern void  FL_(channel_connect)    ( Int fd, Addr sa, Int salen );
+extern void  FL_(channel_accept)     ( Int lfd, Int fd );
+extern void  FL_(channel_write)      ( Int fd, Addr buf, SizeT len );
+extern SizeT FL_(channel_read)       ( Int fd, Addr buf, SizeT len, Bool peek );
+extern void  FL_(channel_close)      ( Int fd );
+extern void  FL_(channel_dup)        ( Int oldfd, Int newfd );
+
+/* Functions defined in fl_cmplog.c */
+#define FL_CMPLOG_MAX_LEN 32
+typedef
+   enum {
+      FL_CmpLog_Insn = 0,   // CmpEQ/CmpNE in generated code
+      FL_CmpLog_Str  = 1,   // strcmp(), strncmp()
+      FL_CmpLog_Mem  = 2    // memcmp()
+   }
+   FL_CmpLogKind;
+extern Bool FL_(setup_cmp_log)( void );
+extern void FL_(cmp_log)( UChar kind, Addr pc, const UChar* tainted,
+                          const UChar* untainted, const UChar* mask,
+                          Int len );
+extern Addr FL_(cmp_log_caller)( ThreadId tid );
+extern void FL_(cmp_log_flush)( void );
+extern void FL_(cmp_log_reopen_for_child)( void );
+extern void FL_(cmp_log_fini)( void );
+extern void FL_(helperc_log_cmp4)( ULong x, ULong y, ULong vx, ULong vy );
+extern void FL_(helperc_log_cmp8)( ULong x, ULong y, ULong vx, ULong vy );
+
+/* Functions defined in fl_forkserver.c */
+#define FL_FORKSRV_CTL_FD 198
+#define FL_FORKSRV_ST_FD  199
+extern Bool FL_(setup_fork_server)( void );
+extern void FL_(fork_server_pre_read)( ThreadId tid, Int fd );
+extern void FL_(fork_server_client_request)( ThreadId tid );
+extern Bool FL_(fork_server_at)( Addr64 a );
+extern void FL_(helperc_fork_server)( void );
+
+/* Functions defined in fl_callstack.c */
+extern VG_REGPARM(2) void FL_(helperc_shadow_call)( Addr ret, Addr sp );
+extern VG_REGPARM(1) void FL_(helperc_shadow_ret)( Addr sp );
+extern UInt FL_(shadow_stack_trace)( ThreadId tid, Addr* ips, UInt n_ips );
+extern void FL_(shadow_stack_thread_create)( ThreadId parent, ThreadId child );
+
+/* Functions defined in fl_output.c */
+extern Bool FL_(setup_output)( void );
+extern void FL_(output_error)( Error* err, Bool is_new );
+extern void FL_(output_flush)( void );
+extern void FL_(output_reopen_for_child)( void );
+extern void FL_(output_fini)( void );
+
+/* Functions defined in fl_coverage.c */
+#define FL_COVERAGE_MAP_SIZE (1 << 16)
+extern UChar* FL_(coverage_map);
+extern UWord  FL_(coverage_prev);
+extern Bool   FL_(setup_coverage_shm)( void );
+extern UWord  FL_(coverage_block_id)( Addr64 a );
+extern void   FL_(coverage_new_run)( void );
+
+/* Functions defined in fl_branchsites.c */
+extern Bool   FL_(branch_site_reported)( Addr pc );
+extern UWord* FL_(branch_site_counter)( Addr pc );
+extern UInt   FL_(branch_site_merge)( Addr pc, UInt unique );
+extern void   FL_(branch_sites_new_run)( void );
+extern void   FL_(branch_sites_fini)( void );
 
 /*------------------------------------------------------------*/
 /*--- Profiling of memory events                           ---*/
@@ -285,10 +384,24 @@ extern Char* FL_(clo_alter_branch);
 extern Char* FL_(clo_alter_fn);
 extern Char* FL_(clo_taint_string);
 extern Char* FL_(clo_file_filter);
+extern Char* FL_(clo_network_filter);
 extern Bool FL_(clo_taint_file);
 extern Bool FL_(clo_taint_network);
 extern Bool FL_(clo_taint_stdin);
 extern Bool FL_(clo_verbose_instr);
+extern Bool FL_(clo_fork_server);
+extern Char* FL_(clo_fork_at);
+extern Char* FL_(clo_input_shm);
+extern Char* FL_(clo_emit_cmp_log);
+extern Char* FL_(clo_heap_mode);
+extern Bool FL_(clo_alloc_sites);
+extern Bool FL_(clo_shadow_stack);
+extern Int FL_(clo_alloc_stack_sample);
+extern Int FL_(clo_demote_branches_after);
+extern Char* FL_(clo_output_format);
+extern Char* FL_(clo_output_file);
+extern Char* FL_(clo_symbolise);
+extern Char* FL_(clo_coverage_shm);
 
 
 
@@ -302,6 +415,8 @@ extern void FL_(helperc_value_check8_fail) ( void );
 extern void FL_(helperc_value_check4_fail) ( void );
 extern void FL_(helperc_value_check1_fail) ( void );
 extern void FL_(helperc_value_check0_fail) ( void );
+extern Char* FL_(describe_Error) ( Error* err, Char* buf, Int szB );
+extern VG_REGPARM(1) void FL_(helperc_branch_check_fail) ( Addr );
 
 extern VG_REGPARM(1) void FL_(helperc_STOREV64be) ( Addr, ULong );
 extern VG_REGPARM(1) void FL_(helperc_STOREV64le) ( Addr, ULong );
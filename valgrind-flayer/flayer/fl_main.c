@@ -51,6 +51,8 @@
 #include "pub_tool_tooliface.h"
 #include "pub_tool_threadstate.h"
 #include "pub_tool_oset.h"
+#include "pub_tool_xarray.h"
+#include "pub_tool_errormgr.h"
 
 #include "fl_include.h"
 #include "flayer.h"   /* for client requests */
@@ -278,13 +280,15 @@ static INLINE Bool is_distinguished_sm ( SecMap* sm ) {
    return sm >= &sm_distinguished[0] && sm <= &sm_distinguished[2];
 }
 
-// Forward declaration
+// Forward declarations
 static void update_SM_counts(SecMap* oldSM, SecMap* newSM);
+static void note_dirty_sm ( Addr a );
 
 /* dist_sm points to one of our three distinguished secondaries.  Make
-   a copy of it so that we can write to it.
+   a copy of it so that we can write to it.  'a' is any address it
+   covers.
 */
-static SecMap* copy_for_writing ( SecMap* dist_sm )
+static SecMap* copy_for_writing ( SecMap* dist_sm, Addr a )
 {
    SecMap* new_sm;
    tl_assert(dist_sm == &sm_distinguished[0]
@@ -297,6 +301,7 @@ static SecMap* copy_for_writing ( SecMap* dist_sm )
                                    sizeof(SecMap) );
    VG_(memcpy)(new_sm, dist_sm, sizeof(SecMap));
    update_SM_counts(dist_sm, new_sm);
+   note_dirty_sm(a);
    return new_sm;
 }
 
@@ -366,6 +371,7 @@ typedef
    struct { 
       Addr    base;
       SecMap* sm;
+      Bool    dirty;   // on the dirty_SMs list?
    }
    AuxMapEnt;
 
@@ -572,14 +578,54 @@ static AuxMapEnt* find_or_alloc_in_auxmap ( Addr a )
 
    nyu = (AuxMapEnt*) VG_(OSet_AllocNode)( auxmap_L2, sizeof(AuxMapEnt) );
    tl_assert(nyu);
-   nyu->base = a;
-   nyu->sm   = &sm_distinguished[SM_DIST_NOACCESS];
+   nyu->base  = a;
+   nyu->sm    = &sm_distinguished[SM_DIST_NOACCESS];
+   nyu->dirty = False;
    VG_(OSet_Insert)( auxmap_L2, nyu );
    insert_into_auxmap_L1_at( AUXMAP_L1_INSERT_IX, nyu );
    n_auxmap_L2_nodes++;
    return nyu;
 }
 
+/* --------------- Dirty secondaries --------------- */
+
+/* Every 64k chunk whose secondary is a private copy, or the
+   distinguished TAINTED one, is listed in dirty_SMs: those are the
+   only places taint can be, so reset_all_taint() need look nowhere
+   else.  Chunks are added as their secondary changes, and each is
+   listed once -- sm_dirty (primary map) and AuxMapEnt.dirty (aux map)
+   say whether it already is.  Entries may go stale, eg. when a chunk
+   is later made noaccess; reset_all_taint() just skips those. */
+static XArray* dirty_SMs = NULL;               // of 64k-aligned Addr
+static UChar   sm_dirty[N_PRIMARY_MAP / 8];
+
+static void note_dirty_sm ( Addr a )
+{
+   a = start_of_this_sm(a);
+   if (a <= MAX_PRIMARY_ADDRESS) {
+      UWord pm_off = a >> 16;
+      if (sm_dirty[pm_off >> 3] & (1 << (pm_off & 7)))
+         return;
+      sm_dirty[pm_off >> 3] |= (1 << (pm_off & 7));
+   } else {
+      AuxMapEnt* am = find_or_alloc_in_auxmap(a);
+      if (am->dirty)
+         return;
+      am->dirty = True;
+   }
+   VG_(addToXA)(dirty_SMs, &a);
+}
+
+static void forget_dirty_sm ( Addr a )
+{
+   if (a <= MAX_PRIMARY_ADDRESS) {
+      UWord pm_off = a >> 16;
+      sm_dirty[pm_off >> 3] &= ~(1 << (pm_off & 7));
+   } else {
+      find_or_alloc_in_auxmap(a)->dirty = False;
+   }
+}
+
 /* --------------- SecMap fundamentals --------------- */
 
 // In all these, 'low' means it's definitely in the main primary map,
@@ -621,7 +667,7 @@ static INLINE SecMap* get_secmap_for_writing_low(Addr a)
 {
    SecMap** p = get_secmap_low_ptr(a);
    if (EXPECTED_NOT_TAKEN(is_distinguished_sm(*p)))
-      *p = copy_for_writing(*p);
+      *p = copy_for_writing(*p, a);
    return *p;
 }
 
@@ -629,7 +675,7 @@ static INLINE SecMap* get_secmap_for_writing_high ( Addr a )
 {
    SecMap** p = get_secmap_high_ptr(a);
    if (EXPECTED_NOT_TAKEN(is_distinguished_sm(*p)))
-      *p = copy_for_writing(*p);
+      *p = copy_for_writing(*p, a);
    return *p;
 }
 
@@ -1439,7 +1485,7 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
          lenA = 0;
       } else {
          PROF_EVENT(155, "set_address_range_perms-dist-sm1");
-         *sm_ptr = copy_for_writing(*sm_ptr);
+         *sm_ptr = copy_for_writing(*sm_ptr, a);
       }
    }
    sm = *sm_ptr;
@@ -1497,6 +1543,8 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
       update_SM_counts(*sm_ptr, example_dsm);
       // Make the sec-map entry point to the example DSM
       *sm_ptr = example_dsm;
+      if (example_dsm == &sm_distinguished[SM_DIST_TAINTED])
+         note_dirty_sm(a);
       lenB -= SM_SIZE;
       a    += SM_SIZE;
    }
@@ -1520,7 +1568,7 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
          return;
       } else {
          PROF_EVENT(162, "set_address_range_perms-dist-sm2");
-         *sm_ptr = copy_for_writing(*sm_ptr);
+         *sm_ptr = copy_for_writing(*sm_ptr, a);
       }
    }
    sm = *sm_ptr;
@@ -1587,6 +1635,97 @@ static void make_mem_defined_if_addressable ( Addr a, SizeT len )
    }
 }
 
+/* Make every addressable byte untainted, leaving addressibility alone:
+   make_mem_defined_if_addressable() over the whole address space, but
+   in time proportional to the number of secondaries that can hold
+   taint (see dirty_SMs).  Private secondaries which end up wholly
+   untainted are freed, as in set_address_range_perms().  Returns the
+   number of secondaries visited. */
+static Word reset_all_taint ( void )
+{
+   const UWord lo_bits = (UWord)0x5555555555555555ULL;
+   const UWord untainted_word = lo_bits << 1;
+   Word  i, j, n, n_kept = 0;
+
+   n = VG_(sizeXA)(dirty_SMs);
+   for (i = 0; i < n; i++) {
+      Addr     a      = *(Addr*)VG_(indexXA)(dirty_SMs, i);
+      SecMap** sm_ptr = get_secmap_ptr(a);
+      SecMap*  sm     = *sm_ptr;
+      UWord*   w;
+      Bool     all_untainted = True;
+
+      if (sm == &sm_distinguished[SM_DIST_TAINTED]) {
+         update_SM_counts(sm, &sm_distinguished[SM_DIST_UNTAINTED]);
+         *sm_ptr = &sm_distinguished[SM_DIST_UNTAINTED];
+         forget_dirty_sm(a);
+         continue;
+      }
+      if (is_distinguished_sm(sm)) {
+         // Stale entry.
+         forget_dirty_sm(a);
+         continue;
+      }
+
+      // Turn every accessible byte's 2 bits (01, 10 or 11) into 10, and
+      // leave noaccess (00) alone.  Stale secVBitTable nodes for bytes
+      // which were partially defined get dropped by the next GC.
+      w = (UWord*)sm->vabits8;
+      for (j = 0; j < SM_CHUNKS / sizeof(UWord); j++) {
+         w[j] = ((w[j] | (w[j] >> 1)) & lo_bits) << 1;
+         if (w[j] != untainted_word)
+            all_untainted = False;
+      }
+
+      if (all_untainted) {
+         VG_(am_munmap_valgrind)((Addr)sm, sizeof(SecMap));
+         update_SM_counts(sm, &sm_distinguished[SM_DIST_UNTAINTED]);
+         *sm_ptr = &sm_distinguished[SM_DIST_UNTAINTED];
+         forget_dirty_sm(a);
+      } else {
+         // Still private, so it can still pick up taint.
+         *(Addr*)VG_(indexXA)(dirty_SMs, n_kept++) = a;
+      }
+   }
+   VG_(dropTailXA)(dirty_SMs, n - n_kept);
+   return n;
+}
+
+/* Returns the length of the longest prefix of [a,a+len) whose bytes
+   are either all tainted (even partly) or all not, and sets *tainted
+   to say which.  Noaccess bytes count as untainted.  Used to record
+   the taint of data handed to the kernel (see fl_channels.c). */
+SizeT FL_(taint_run_length) ( Addr a, SizeT len, Bool* tainted )
+{
+   SizeT i;
+   UChar vabits2, whole8;
+   Bool  t;
+
+   if (len == 0) {
+      *tainted = False;
+      return 0;
+   }
+   vabits2 = get_vabits2(a);
+   t = (vabits2 == VA_BITS2_TAINTED || vabits2 == VA_BITS2_PARTUNTAINTED);
+   whole8 = t ? VA_BITS8_TAINTED : VA_BITS8_UNTAINTED;
+
+   i = 1;
+   while (i < len) {
+      if (VG_IS_4_ALIGNED(a+i) && len - i >= 4
+          && get_vabits8_for_aligned_word32(a+i) == whole8) {
+         i += 4;
+         continue;
+      }
+      vabits2 = get_vabits2(a+i);
+      if (t != (vabits2 == VA_BITS2_TAINTED
+                || vabits2 == VA_BITS2_PARTUNTAINTED))
+         break;
+      i++;
+   }
+   *tainted = t;
+   return i;
+}
+
 
 /* --- Block-copy permissions (needed for implementing realloc() and
        sys_mremap). --- */
@@ -2483,6 +2622,14 @@ static Bool fl_is_defined_asciiz ( Addr a, Addr* bad_addr )
 static
 void fl_pre_syscall(ThreadId tid, UInt syscallno) 
 {
+  switch (syscallno) {
+#ifdef __NR_read
+    case __NR_read:
+      if (FL_(clo_fork_server) || FL_(clo_input_shm))
+        FL_(syscall_pre_read)(tid);
+      break;
+#endif
+  }
 }
 
 static
@@ -2511,6 +2658,26 @@ void fl_post_syscall(ThreadId tid, UInt syscallno, SysRes res)
 # warn __NR_open not defined. No file tainting will be possible!
 #endif
 
+#ifdef __NR_write
+    case __NR_write:
+      FL_(syscall_write)(tid, res);
+      break;
+#endif
+#ifdef __NR_pipe
+    case __NR_pipe:
+      FL_(syscall_pipe)(tid, res);
+      break;
+#endif
+#ifdef __NR_dup
+    case __NR_dup:
+      FL_(syscall_dup)(tid, res);
+      break;
+#endif
+#ifdef __NR_dup2
+    case __NR_dup2:
+      FL_(syscall_dup)(tid, res);
+      break;
+#endif
 #ifdef __NR_socketcall
     case __NR_socketcall:
       FL_(syscall_socketcall)(tid, res);
@@ -2849,11 +3016,21 @@ struct _FL_Error {
 /*--- Printing errors                                      ---*/
 /*------------------------------------------------------------*/
 
+/* Set by FL_(describe_Error): fl_pp_msg then formats the description
+   into describe_buf instead of printing it, and the rest of
+   fl_pp_Error prints nothing. */
+static Char* describe_kind = NULL;
+static Char* describe_buf  = NULL;
+static Int   describe_szB  = 0;
+
 static void fl_pp_AddrInfo ( Addr a, AddrInfo* ai, Bool maybe_gcc )
 {
    HChar* xpre  = VG_(clo_xml) ? "  <auxwhat>" : " ";
    HChar* xpost = VG_(clo_xml) ? "</auxwhat>"  : "";
 
+   if (describe_buf != NULL)
+      return;
+
    switch (ai->tag) {
       case Addr_Unknown:
          if (maybe_gcc) {
@@ -2901,7 +3078,8 @@ static void fl_pp_AddrInfo ( Addr a, AddrInfo* ai, Bool maybe_gcc )
             : ai->Addr.Block.block_kind==Block_Freed ? "free'd" 
                                                      : "client-defined",
             xpost);
-         VG_(pp_ExeContext)(ai->Addr.Block.lastchange);
+         if (ai->Addr.Block.lastchange)
+            VG_(pp_ExeContext)(ai->Addr.Block.lastchange);
          break;
       }
 
@@ -2917,6 +3095,14 @@ static void fl_pp_msg( Char* xml_name, Error* err, const HChar* format, ... )
    Char buf[256];
    va_list vargs;
 
+   if (describe_buf != NULL) {
+      describe_kind = xml_name;
+      va_start(vargs, format);
+      VG_(vsnprintf) ( describe_buf, describe_szB, format, vargs );
+      va_end(vargs);
+      return;
+   }
+
    if (VG_(clo_xml))
       VG_(message)(Vg_UserMsg, "  <kind>%s</kind>", xml_name);
    // Stick xpre and xpost on the front and back of the format string.
@@ -3042,6 +3228,19 @@ static void fl_pp_Error ( Error* err )
    }
 }
 
+/* The XML kind of an error, eg. "TaintedCondition", with the one line
+   description fl_pp_Error would print put in buf. */
+Char* FL_(describe_Error) ( Error* err, Char* buf, Int szB )
+{
+   describe_kind = "";
+   describe_buf  = buf;
+   describe_szB  = szB;
+   buf[0] = 0;
+   fl_pp_Error(err);
+   describe_buf  = NULL;
+   return describe_kind;
+}
+
 /*------------------------------------------------------------*/
 /*--- Recording errors                                     ---*/
 /*------------------------------------------------------------*/
@@ -3125,9 +3324,22 @@ static void fl_record_value_error ( ThreadId tid, Int szB )
    VG_(maybe_record_error)( tid, Err_Value, /*addr*/0, /*s*/NULL, &extra );
 }
 
-static void fl_record_cond_error ( ThreadId tid )
+/* 'a' is the address of the branch, if known, for
+   --demote-branches-after; otherwise 0. */
+static void fl_record_cond_error ( ThreadId tid, Addr a )
+{
+   VG_(maybe_record_error)( tid, Err_Cond, a, /*s*/NULL, /*extra*/NULL);
+}
+
+/* For VG_(needs_final_error_counts): the times a demoted branch was
+   taken on tainted data, counted inline rather than reported. */
+static UInt fl_more_occurrences ( Error* err )
 {
-   VG_(maybe_record_error)( tid, Err_Cond, /*addr*/0, /*s*/NULL, /*extra*/NULL);
+   if (VG_(get_error_kind)(err) != Err_Cond
+       || VG_(get_error_address)(err) == 0)
+      return 0;
+   return FL_(branch_site_merge)( VG_(get_error_address)(err),
+                                  VG_(get_error_unique)(err) );
 }
 
 /* --- Called from non-generated code --- */
@@ -3291,7 +3503,7 @@ static Bool addr_is_in_FL_Chunk(FL_Chunk* mc, Addr a)
    // saying "12 bytes after block A" when really it's within block B.
    // Fixing would require adding redzone size to FL_Chunks, though.
    return VG_(addr_is_in_block)( a, mc->data, mc->szB,
-                                 FL_MALLOC_REDZONE_SZB );
+                                 FL_(malloc_redzone_szB) );
 }
 
 // Forward declaration
@@ -3336,17 +3548,16 @@ static void describe_addr ( Addr a, AddrInfo* ai )
       mc = mc->next; 
    }
    /* Search for a currently malloc'd block which might bracket it. */
-   VG_(HT_ResetIter)(FL_(malloc_list));
-   while ( (mc = VG_(HT_Next)(FL_(malloc_list))) ) {
-      if (addr_is_in_FL_Chunk(mc, a)) {
-         ai->tag = Addr_Block;
-         ai->Addr.Block.block_kind = Block_Mallocd;
-         ai->Addr.Block.block_desc = "block";
-         ai->Addr.Block.block_szB  = mc->szB;
-         ai->Addr.Block.rwoffset   = (Int)a - (Int)mc->data;
-         ai->Addr.Block.lastchange = mc->where;
-         return;
-      }
+   mc = FL_(chunk_index_find_enclosing)( FL_(malloc_list), a,
+                                         FL_(malloc_redzone_szB) );
+   if (mc) {
+      ai->tag = Addr_Block;
+      ai->Addr.Block.block_kind = Block_Mallocd;
+      ai->Addr.Block.block_desc = "block";
+      ai->Addr.Block.block_szB  = mc->szB;
+      ai->Addr.Block.rwoffset   = (Int)a - (Int)mc->data;
+      ai->Addr.Block.lastchange = mc->where;
+      return;
    }
    /* Clueless ... */
    ai->tag = Addr_Unknown;
@@ -4053,7 +4264,14 @@ void FL_(helperc_STOREV8) ( Addr a, UWord vbits8 )
 
 void FL_(helperc_value_check0_fail) ( void )
 {
-   fl_record_cond_error ( VG_(get_running_tid)() );
+   fl_record_cond_error ( VG_(get_running_tid)(), 0 );
+}
+
+/* An Ist_Exit guard, with --demote-branches-after. */
+VG_REGPARM(1) void FL_(helperc_branch_check_fail) ( Addr pc )
+{
+   fl_record_cond_error ( VG_(get_running_tid)(), pc );
+   FL_(branch_site_reported) ( pc );
 }
 
 void FL_(helperc_value_check1_fail) ( void )
@@ -4170,6 +4388,9 @@ static void init_shadow_memory ( void )
 
    /* Secondary V bit table */
    secVBitTable = createSecVBitTable();
+
+   /* Chunks that may hold taint */
+   dirty_SMs = VG_(newXA)( VG_(malloc), VG_(free), sizeof(Addr) );
 }
 
 
@@ -4279,10 +4500,24 @@ Char*         FL_(clo_alter_fn)                = NULL;
 Char*         FL_(clo_taint_string)           = NULL;
 static Char   FL_(default_file_filter)[] = "";
 Char*         FL_(clo_file_filter)            = FL_(default_file_filter);
+Char*         FL_(clo_network_filter)         = NULL;
 Bool          FL_(clo_taint_file)             = False;
 Bool          FL_(clo_taint_network)          = False;
 Bool          FL_(clo_taint_stdin)            = False;
 Bool          FL_(clo_verbose_instr)          = False;
+Bool          FL_(clo_fork_server)            = False;
+Char*         FL_(clo_fork_at)                = NULL;
+Char*         FL_(clo_input_shm)              = NULL;
+Char*         FL_(clo_emit_cmp_log)           = NULL;
+Char*         FL_(clo_heap_mode)              = "full";
+Bool          FL_(clo_alloc_sites)            = False;
+Bool          FL_(clo_shadow_stack)           = True;
+Int           FL_(clo_alloc_stack_sample)     = 1;
+Int           FL_(clo_demote_branches_after)  = 0;
+Char*         FL_(clo_output_format)          = NULL;
+Char*         FL_(clo_output_file)            = NULL;
+Char*         FL_(clo_symbolise)              = "eager";
+Char*         FL_(clo_coverage_shm)           = NULL;
 
 static Bool fl_process_cmd_line_options(Char* arg)
 {
@@ -4293,12 +4528,28 @@ static Bool fl_process_cmd_line_options(Char* arg)
    else VG_STR_CLO(arg, "--alter-fn", FL_(clo_alter_fn))
    else VG_STR_CLO(arg, "--taint-string", FL_(clo_taint_string))
    else VG_STR_CLO(arg, "--file-filter", FL_(clo_file_filter))
+   else VG_STR_CLO(arg, "--network-filter", FL_(clo_network_filter))
    else VG_BOOL_CLO(arg, "--taint-stdin", FL_(clo_taint_stdin))
    else VG_BOOL_CLO(arg, "--taint-file", FL_(clo_taint_file))
    else VG_BOOL_CLO(arg, "--taint-network", FL_(clo_taint_network))
    else VG_BOOL_CLO(arg, "--verbose-instrumentation", FL_(clo_verbose_instr))
+   else VG_BOOL_CLO(arg, "--fork-server", FL_(clo_fork_server))
+   else VG_STR_CLO(arg, "--fork-at", FL_(clo_fork_at))
+   else VG_STR_CLO(arg, "--input-shm", FL_(clo_input_shm))
+   else VG_STR_CLO(arg, "--emit-cmp-log", FL_(clo_emit_cmp_log))
+   else VG_STR_CLO(arg, "--heap-mode", FL_(clo_heap_mode))
+   else VG_BOOL_CLO(arg, "--alloc-sites", FL_(clo_alloc_sites))
+   else VG_BOOL_CLO(arg, "--shadow-stack", FL_(clo_shadow_stack))
+   else VG_STR_CLO(arg, "--output-format", FL_(clo_output_format))
+   else VG_STR_CLO(arg, "--output-file", FL_(clo_output_file))
+   else VG_STR_CLO(arg, "--symbolise", FL_(clo_symbolise))
+   else VG_STR_CLO(arg, "--coverage-shm", FL_(clo_coverage_shm))
    
    else VG_BNUM_CLO(arg, "--freelist-vol",  FL_(clo_freelist_vol), 0, 1000000000)
+   else VG_BNUM_CLO(arg, "--alloc-stack-sample",
+                    FL_(clo_alloc_stack_sample), 1, 1000000)
+   else VG_BNUM_CLO(arg, "--demote-branches-after",
+                    FL_(clo_demote_branches_after), 0, 1000000000)
    
    else if (VG_CLO_STREQN(16,arg,"--ignore-ranges=")) {
       Int    i;
@@ -4335,6 +4586,17 @@ static Bool fl_process_cmd_line_options(Char* arg)
    return True;
 }
 
+/* For VG_(needs_persistent_translations).  These options name files
+   or shared memory objects, which drivers such as libflayer change from
+   run to run; only whether they are given can change the code. */
+static Bool fl_option_value_affects_code(Char* arg)
+{
+   return !VG_CLO_STREQN(14, arg, "--output-file=")
+          && !VG_CLO_STREQN(15, arg, "--coverage-shm=")
+          && !VG_CLO_STREQN(15, arg, "--emit-cmp-log=")
+          && !VG_CLO_STREQN(12, arg, "--input-shm=");
+}
+
 static void fl_print_usage(void)
 {  
    VG_(printf)(
@@ -4349,7 +4611,39 @@ static void fl_print_usage(void)
 "    --taint-network=no|yes           enables network tainting [no]\n"
 "    --file-filter=/path/prefix       enforces tainting on any files under\n"
 "                                     the given prefix. []\n"
+"    --network-filter=host:port,...   only taint sockets whose peer or local\n"
+"                                     address matches; host and port may be\n"
+"                                     '*' or empty to match anything. []\n"
 "    --verbose-instrumentation=no|yes enables verbose translation logging [no]\n"
+"    --fork-server=no|yes             fork a fresh child per test case from a\n"
+"                                     snapshot taken at --fork-at [no]\n"
+"    --fork-at=first-read|client-request|0xADDR\n"
+"                                     where to take the snapshot [first-read]\n"
+"    --input-shm=<name>:<fd>          serve read()s on fd from /dev/shm/<name>,\n"
+"                                     tainted, instead of the kernel []\n"
+"    --emit-cmp-log=<file>            log compares of tainted against untainted\n"
+"                                     values to <file> for input patching []\n"
+"    --heap-mode=full|fast            fast drops redzones and the freed blocks\n"
+"                                     queue, for allocation-heavy clients [full]\n"
+"    --alloc-sites=no|yes             record allocation sites in fast mode [no]\n"
+"    --shadow-stack=no|yes            take stack traces from a shadow call stack\n"
+"                                     rather than by unwinding; turns off\n"
+"                                     chasing into calls (--vex-guest-chase-\n"
+"                                     thresh=0) so every call is seen [yes]\n"
+"    --alloc-stack-sample=<n>         record the full allocation stack for only\n"
+"                                     1 in <n> allocations from a site [1]\n"
+"    --demote-branches-after=<n>      once a tainted branch has been reported\n"
+"                                     <n> times, just count it [0=never]\n"
+"    --output-format=jsonl|binary     also stream errors and count updates to\n"
+"                                     --output-file as they happen []\n"
+"    --output-file=<file>             where --output-format writes to []\n"
+"    --symbolise=eager|exit|offline   name --output-format frames as errors\n"
+"                                     occur, once per ip at exit, or not at\n"
+"                                     all, leaving it to the reader; unless\n"
+"                                     eager, errors are only counted in the\n"
+"                                     log, not printed [eager]\n"
+"    --coverage-shm=<name>            keep edge and tainted branch outcome\n"
+"                                     bitmaps in /dev/shm/<name> []\n"
 "    --partial-loads-ok=no|yes        too hard to explain here; see manual [no]\n"
 "    --freelist-vol=<number>          volume of freed blocks queue [5000000]\n"
 "    --workaround-gcc296-bugs=no|yes  self explanatory [no]\n"
@@ -4498,6 +4792,397 @@ static Bool client_perm_maybe_describe( Addr a, AddrInfo* ai )
    return False;
 }
 
+/*------------------------------------------------------------*/
+/*--- Persistent mode                                      ---*/
+/*------------------------------------------------------------*/
+
+/* A harness which runs many inputs in one process brackets each with
+   VALGRIND_FLAYER_ITERATION_BEGIN/END.  Beginning an iteration puts
+   the shadow state back to "nothing tainted" and forgets all errors,
+   so each input is judged on its own; ending one prints a summary. */
+
+static UInt iter_number    = 0;
+static Bool iter_running   = False;
+static UInt iter_start_ms  = 0;
+static Word iter_reset_SMs = 0;
+
+static void begin_iteration ( void )
+{
+   iter_reset_SMs = reset_all_taint();
+   FL_(untaint_guest_state)();
+   VG_(clear_errors)();
+   FL_(branch_sites_new_run)();
+   FL_(n_input_bytes_tainted) = 0;
+   FL_(coverage_new_run)();
+
+   iter_number++;
+   iter_running  = True;
+   iter_start_ms = VG_(read_millisecond_timer)();
+}
+
+static void end_iteration ( void )
+{
+   UInt ms;
+
+   if (!iter_running)
+      return;
+   iter_running = False;
+   ms = VG_(read_millisecond_timer)() - iter_start_ms;
+
+   if (VG_(clo_xml)) {
+      VG_(message)(Vg_UserMsg, "<iteration>");
+      VG_(message)(Vg_UserMsg, "  <number>%u</number>", iter_number);
+      VG_(message)(Vg_UserMsg, "  <errors>%u</errors>",
+                   VG_(get_n_errs_found)());
+      VG_(message)(Vg_UserMsg, "  <tainted_bytes>%llu</tainted_bytes>",
+                   FL_(n_input_bytes_tainted));
+      VG_(message)(Vg_UserMsg, "  <reset_secmaps>%ld</reset_secmaps>",
+                   iter_reset_SMs);
+      VG_(message)(Vg_UserMsg, "  <time_ms>%u</time_ms>", ms);
+      VG_(message)(Vg_UserMsg, "</iteration>");
+   } else {
+      VG_(message)(Vg_UserMsg,
+                   "iteration %u: %u errors, %llu tainted input bytes, "
+                   "%ld secmaps reset, %u ms",
+                   iter_number, VG_(get_n_errs_found)(),
+                   FL_(n_input_bytes_tainted), iter_reset_SMs, ms);
+   }
+}
+
+/* Native memmove()/memset() for the fl_replace_strmem.c replacements,
+   so that bulk copies don't pay for instrumentation on every byte.
+   They return False, leaving the replacement to do the work on the
+   simulated CPU, whenever that would behave differently: if the client
+   can't access the memory (so it faults where it should) or any of it
+   is noaccess in the shadow (so the right errors get reported). */
+
+static Bool is_mem_all_accessible ( Addr a, SizeT len )
+{
+   while (len > 0) {
+      if (VG_IS_4_ALIGNED(a) && len >= 4) {
+         UChar vabits8 = get_vabits8_for_aligned_word32(a);
+         if (EXPECTED_TAKEN(VA_BITS8_TAINTED == vabits8
+                            || VA_BITS8_UNTAINTED == vabits8)) {
+            a += 4;
+            len -= 4;
+            continue;
+         }
+      }
+      if (VA_BITS2_NOACCESS == get_vabits2(a))
+         return False;
+      a++;
+      len--;
+   }
+   return True;
+}
+
+static Bool fl_client_memmove ( Addr dst, Addr src, SizeT len )
+{
+   SizeT i;
+
+   if (!VG_(am_is_valid_for_client)(src, len, VKI_PROT_READ)
+       || !VG_(am_is_valid_for_client)(dst, len, VKI_PROT_WRITE)
+       || !is_mem_all_accessible(src, len)
+       || !is_mem_all_accessible(dst, len))
+      return False;
+
+   if (dst + len <= src || src + len <= dst || dst < src) {
+      VG_(memcpy)((void*)dst, (void*)src, len);
+   } else {
+      for (i = len; i > 0; i--)
+         ((UChar*)dst)[i-1] = ((UChar*)src)[i-1];
+   }
+   FL_(copy_address_range_state)(src, dst, len);
+   return True;
+}
+
+/* 'cp' points at the fill byte in client memory, so its taint can be
+   looked up too. */
+static Bool fl_client_memset ( Addr dst, Addr cp, SizeT len )
+{
+   UChar vabits2;
+
+   if (!VG_(am_is_valid_for_client)(cp, 1, VKI_PROT_READ)
+       || !VG_(am_is_valid_for_client)(dst, len, VKI_PROT_WRITE)
+       || !is_mem_all_accessible(dst, len))
+      return False;
+
+   vabits2 = get_vabits2(cp);
+   if (VA_BITS2_TAINTED != vabits2 && VA_BITS2_UNTAINTED != vabits2)
+      return False;
+
+   VG_(memset)((void*)dst, *(UChar*)cp, len);
+   if (VA_BITS2_TAINTED == vabits2)
+      FL_(make_mem_undefined)(dst, len);
+   else
+      FL_(make_mem_defined)(dst, len);
+   return True;
+}
+
+/* Native string functions for the fl_replace_strmem.c replacements.
+   Each computes its result natively, looks at the shadow of the bytes
+   involved once, and stores the result, tainted or not, through 'resp'
+   in client memory.  The errors are those the replacement's loop and
+   its VALGRIND_CHECK_MEM_IS_UNTAINTED used to produce: a user error at
+   the first tainted byte checked, and a conditional-jump error if any
+   byte the loop looked at was tainted.  Like the memmove above they
+   return False, leaving the work to the replacement, if the client
+   could fault or touch noaccess memory. */
+
+#define HAS_ZERO_BYTE(w)   (((w) - 0x01010101U) & ~(w) & 0x80808080U)
+
+/* Looks at the shadow of [a,a+len) once.  Returns False if any of it is
+   noaccess, else sets *tainted to the first byte that isn't wholly
+   untainted, or 0 if there is none. */
+static Bool scan_shadow ( Addr a, SizeT len, Addr* tainted )
+{
+   UChar vabits2;
+
+   *tainted = 0;
+   while (len > 0) {
+      if (VG_IS_4_ALIGNED(a) && len >= 4) {
+         UChar vabits8 = get_vabits8_for_aligned_word32(a);
+         if (EXPECTED_TAKEN(VA_BITS8_UNTAINTED == vabits8)) {
+            a += 4;
+            len -= 4;
+            continue;
+         }
+         if (VA_BITS8_TAINTED == vabits8) {
+            if (*tainted == 0)
+               *tainted = a;
+            a += 4;
+            len -= 4;
+            continue;
+         }
+      }
+      vabits2 = get_vabits2(a);
+      if (VA_BITS2_NOACCESS == vabits2)
+         return False;
+      if (VA_BITS2_UNTAINTED != vabits2 && *tainted == 0)
+         *tainted = a;
+      a++;
+      len--;
+   }
+   return True;
+}
+
+/* How many bytes from a, up to max, lie in the page containing a, or
+   0 if the client can't read that page. */
+static SizeT readable_in_page ( Addr a, SizeT max )
+{
+   Addr  page = VG_PGROUNDDN(a);
+   SizeT n    = page + VKI_PAGE_SIZE - a;
+
+   if (!VG_(am_is_valid_for_client)(page, VKI_PAGE_SIZE, VKI_PROT_READ))
+      return 0;
+   return n < max ? n : max;
+}
+
+/* Finds the first of the max bytes from a that is c, or also 0 if
+   'nul' is set.  *pos is where it is, or max if there's none.  Returns
+   False if it would have to read memory the client can't. */
+static Bool native_find ( Addr a, SizeT max, UChar c, Bool nul, SizeT* pos )
+{
+   UInt  cccc = c * 0x01010101U, w;
+   SizeT n = 0, i, chunk;
+   UChar* p;
+
+   while (n < max) {
+      chunk = readable_in_page(a + n, max - n);
+      if (chunk == 0)
+         return False;
+      p = (UChar*)(a + n);
+      i = 0;
+      while (i < chunk) {
+         if (VG_IS_4_ALIGNED(p + i) && chunk - i >= 4) {
+            w = *(UInt*)(p + i);
+            if (!HAS_ZERO_BYTE(w ^ cccc) && !(nul && HAS_ZERO_BYTE(w))) {
+               i += 4;
+               continue;
+            }
+         }
+         if (p[i] == c || (nul && p[i] == 0)) {
+            *pos = n + i;
+            return True;
+         }
+         i++;
+      }
+      n += chunk;
+   }
+   *pos = max;
+   return True;
+}
+
+/* Compares up to max bytes at s1 and s2, stopping after a 0 if 'nul'
+   is set.  *pos is the index of the byte that decided it, or max if
+   they were equal all the way; *diff is the difference there. */
+static Bool native_compare ( Addr s1, Addr s2, SizeT max, Bool nul,
+                             SizeT* pos, Int* diff )
+{
+   SizeT n = 0, i, chunk, chunk2;
+   UChar *p1, *p2;
+
+   while (n < max) {
+      chunk  = readable_in_page(s1 + n, max - n);
+      chunk2 = readable_in_page(s2 + n, max - n);
+      if (chunk2 < chunk)
+         chunk = chunk2;
+      if (chunk == 0)
+         return False;
+      p1 = (UChar*)(s1 + n);
+      p2 = (UChar*)(s2 + n);
+      i = 0;
+      while (i < chunk) {
+         if (VG_IS_4_ALIGNED(p1 + i) && VG_IS_4_ALIGNED(p2 + i)
+             && chunk - i >= 4) {
+            UInt w = *(UInt*)(p1 + i);
+            if (w == *(UInt*)(p2 + i) && !(nul && HAS_ZERO_BYTE(w))) {
+               i += 4;
+               continue;
+            }
+         }
+         if (p1[i] != p2[i] || (nul && p1[i] == 0)) {
+            *pos  = n + i;
+            *diff = (Int)p1[i] - (Int)p2[i];
+            return True;
+         }
+         i++;
+      }
+      n += chunk;
+   }
+   *pos  = max;
+   *diff = 0;
+   return True;
+}
+
+static Bool set_client_result ( Addr resp, UWord res, SizeT szB,
+                                Bool tainted )
+{
+   if (!VG_(am_is_valid_for_client)(resp, szB, VKI_PROT_WRITE)
+       || !is_mem_all_accessible(resp, szB))
+      return False;
+   if (szB == sizeof(Int))
+      *(Int*)resp = (Int)res;
+   else
+      *(UWord*)resp = res;
+   if (tainted)
+      FL_(make_mem_undefined)(resp, szB);
+   else
+      FL_(make_mem_defined)(resp, szB);
+   return True;
+}
+
+/* strlen() and strnlen(); the result is a SizeT. */
+static Bool fl_client_strlen ( ThreadId tid, Addr s, SizeT max, Addr resp )
+{
+   SizeT len;
+   Addr  t;
+   Bool  tainted;
+
+   if (!native_find(s, max, 0, True, &len))
+      return False;
+   if (!scan_shadow(s, len < max ? len + 1 : len, &t))
+      return False;
+   tainted = t != 0 && t < s + len;
+   if (!set_client_result(resp, len, sizeof(SizeT), tainted))
+      return False;
+
+   if (tainted)
+      fl_record_user_error(tid, t, /*isAddrErr*/False);
+   if (t != 0)
+      fl_record_cond_error(tid, 0);
+   return True;
+}
+
+/* --emit-cmp-log: record a string compare of tainted against untainted
+   bytes.  For strings, the untainted one up to its terminator is what
+   the input should have held. */
+static void cmp_log_compare ( ThreadId tid, Addr tainted, Addr untainted,
+                              SizeT max, Bool nul )
+{
+   UChar mask[FL_CMPLOG_MAX_LEN];
+   SizeT len = max < FL_CMPLOG_MAX_LEN ? max : FL_CMPLOG_MAX_LEN;
+   SizeT i;
+
+   if (nul) {
+      if (!native_find(untainted, len, 0, True, &i))
+         return;
+      if (i < len)
+         len = i + 1;
+   }
+   if (len == 0
+       || !VG_(am_is_valid_for_client)(tainted, len, VKI_PROT_READ)
+       || !VG_(am_is_valid_for_client)(untainted, len, VKI_PROT_READ))
+      return;
+   for (i = 0; i < len; i++)
+      mask[i] = VA_BITS2_UNTAINTED == get_vabits2(tainted + i) ? 0 : 0xFF;
+   FL_(cmp_log)(nul ? FL_CmpLog_Str : FL_CmpLog_Mem,
+                FL_(cmp_log_caller)(tid),
+                (UChar*)tainted, (UChar*)untainted, mask, len);
+}
+
+/* strcmp() and strncmp() if 'nul', else memcmp(); the result is an Int.
+   memcmp() checked all max bytes for taint, the others only the equal
+   ones. */
+static Bool fl_client_compare ( ThreadId tid, Addr s1, Addr s2, SizeT max,
+                                Bool nul, Addr resp )
+{
+   SizeT pos, consulted, checked;
+   Int   diff;
+   Addr  t1, t2;
+   Bool  tainted1, tainted2, cond1, cond2;
+
+   if (!native_compare(s1, s2, max, nul, &pos, &diff))
+      return False;
+   if (nul && diff != 0)
+      diff = diff < 0 ? -1 : 1;
+   consulted = pos < max ? pos + 1 : pos;
+   checked   = nul ? pos : max;
+
+   if (!scan_shadow(s1, consulted > checked ? consulted : checked, &t1)
+       || !scan_shadow(s2, consulted > checked ? consulted : checked, &t2))
+      return False;
+   tainted1 = t1 != 0 && t1 < s1 + checked;
+   tainted2 = t2 != 0 && t2 < s2 + checked;
+   cond1    = t1 != 0 && t1 < s1 + consulted;
+   cond2    = t2 != 0 && t2 < s2 + consulted;
+   if (!set_client_result(resp, (UWord)diff, sizeof(Int),
+                          tainted1 || tainted2))
+      return False;
+
+   if (tainted1)
+      fl_record_user_error(tid, t1, /*isAddrErr*/False);
+   else if (tainted2)
+      fl_record_user_error(tid, t2, /*isAddrErr*/False);
+   if (cond1 || cond2)
+      fl_record_cond_error(tid, 0);
+   if (FL_(clo_emit_cmp_log) != NULL && cond1 != cond2)
+      cmp_log_compare(tid, cond1 ? s1 : s2, cond1 ? s2 : s1, max, nul);
+   return True;
+}
+
+/* strchr() if 'nul', else memchr(); the result is a pointer, and as
+   before is never tainted. */
+static Bool fl_client_find ( ThreadId tid, Addr s, UChar c, SizeT max,
+                             Bool nul, Addr resp )
+{
+   SizeT pos;
+   Addr  found = 0, t;
+
+   if (!native_find(s, max, c, nul, &pos))
+      return False;
+   if (pos < max && ((UChar*)s)[pos] == c)
+      found = s + pos;
+   if (!scan_shadow(s, pos < max ? pos + 1 : pos, &t))
+      return False;
+   if (!set_client_result(resp, found, sizeof(Addr), False))
+      return False;
+
+   if (t != 0)
+      fl_record_cond_error(tid, 0);
+   return True;
+}
+
 static Bool fl_handle_client_request ( ThreadId tid, UWord* arg, UWord* ret )
 {
    Int   i;
@@ -4601,7 +5286,7 @@ static Bool fl_handle_client_request ( ThreadId tid, UWord* arg, UWord* ret )
          Bool is_zeroed = (Bool)arg[4];
 
          FL_(new_block) ( tid, p, sizeB, /*ignored*/0, rzB, is_zeroed, 
-                          FL_AllocCustom, FL_(malloc_list) );
+                          FL_AllocCustom, NULL );
          return True;
       }
       case VG_USERREQ__FREELIKE_BLOCK: {
@@ -4612,6 +5297,21 @@ static Bool fl_handle_client_request ( ThreadId tid, UWord* arg, UWord* ret )
          return True;
       }
 
+      case VG_USERREQ__FORK_SERVER:
+         FL_(fork_server_client_request) ( tid );
+         *ret = 0;
+         break;
+
+      case VG_USERREQ__ITERATION_BEGIN:
+         begin_iteration();
+         *ret = iter_number;
+         break;
+
+      case VG_USERREQ__ITERATION_END:
+         end_iteration();
+         *ret = iter_number;
+         break;
+
       case _VG_USERREQ__FLAYER_RECORD_OVERLAP_ERROR: {
          Char* s   = (Char*)arg[1];
          Addr  dst = (Addr) arg[2];
@@ -4621,6 +5321,38 @@ static Bool fl_handle_client_request ( ThreadId tid, UWord* arg, UWord* ret )
          return True;
       }
 
+      case _VG_USERREQ__FLAYER_MEMMOVE:
+         *ret = fl_client_memmove ( arg[1], arg[2], arg[3] );
+         break;
+
+      case _VG_USERREQ__FLAYER_MEMSET:
+         *ret = fl_client_memset ( arg[1], arg[2], arg[3] );
+         break;
+
+      case _VG_USERREQ__FLAYER_STRLEN:
+         *ret = fl_client_strlen ( tid, arg[1], arg[2], arg[3] );
+         break;
+
+      case _VG_USERREQ__FLAYER_STRCMP:
+         *ret = fl_client_compare ( tid, arg[1], arg[2], arg[3],
+                                    True, arg[4] );
+         break;
+
+      case _VG_USERREQ__FLAYER_MEMCMP:
+         *ret = fl_client_compare ( tid, arg[1], arg[2], arg[3],
+                                    False, arg[4] );
+         break;
+
+      case _VG_USERREQ__FLAYER_STRCHR:
+         *ret = fl_client_find ( tid, arg[1], (UChar)arg[2], ~(SizeT)0,
+                                 True, arg[3] );
+         break;
+
+      case _VG_USERREQ__FLAYER_MEMCHR:
+         *ret = fl_client_find ( tid, arg[1], (UChar)arg[2], arg[3],
+                                 False, arg[4] );
+         break;
+
       case VG_USERREQ__CREATE_MEMPOOL: {
          Addr pool      = (Addr)arg[1];
          UInt rzB       =       arg[2];
@@ -4751,6 +5483,27 @@ static void done_prof_mem ( void ) { }
 
 static void fl_post_clo_init ( void )
 {
+   if (!FL_(setup_network_filter)())
+      VG_(err_bad_option)("--network-filter");
+   if (!FL_(setup_fork_server)())
+      VG_(err_bad_option)("--fork-at");
+   if (!FL_(setup_input_shm)())
+      VG_(err_bad_option)("--input-shm");
+   if (!FL_(setup_cmp_log)())
+      VG_(err_bad_option)("--emit-cmp-log");
+   if (!FL_(setup_heap_mode)())
+      VG_(err_bad_option)("--heap-mode");
+   if (!FL_(setup_output)())
+      VG_(err_bad_option)("--output-format");
+   if (!FL_(setup_coverage_shm)())
+      VG_(err_bad_option)("--coverage-shm");
+   if (FL_(clo_demote_branches_after) > 0)
+      VG_(needs_final_error_counts)( fl_more_occurrences );
+   /* A call chased into sits in the middle of a superblock, where the
+      shadow stack never sees it; only block-ending calls and returns
+      push and pop frames. */
+   if (FL_(clo_shadow_stack))
+      VG_(clo_vex_control).guest_chase_thresh = 0;
 }
 
 static void print_SM_info(char* type, int n_SMs)
@@ -4766,6 +5519,9 @@ static void print_SM_info(char* type, int n_SMs)
 static void fl_fini ( Int exitcode )
 {
    FL_(print_malloc_stats)();
+   FL_(cmp_log_fini)();
+   FL_(branch_sites_fini)();
+   FL_(output_fini)();
 
    if (VG_(clo_verbosity) == 1 && !VG_(clo_xml)) {
       VG_(message)(Vg_UserMsg, 
@@ -4872,11 +5628,15 @@ static void fl_pre_clo_init(void)
                                    FL_(realloc),
                                    FL_MALLOC_REDZONE_SZB );
    VG_(needs_xml_output)          ();
+   VG_(needs_stack_traces)        (FL_(shadow_stack_trace));
+   VG_(needs_persistent_translations)(fl_option_value_affects_code);
 
    // when using undef as taint, nothing new should be undefined
    VG_(track_new_mem_stack_signal)( FL_(make_mem_defined) );
    VG_(track_new_mem_brk)         ( FL_(make_mem_defined) );
 
+   VG_(track_post_thread_create)  ( FL_(shadow_stack_thread_create) );
+
    VG_(track_new_mem_startup)     ( fl_new_mem_startup );
    VG_(track_new_mem_stack_signal)( FL_(make_mem_defined) );
    VG_(track_new_mem_brk)         ( FL_(make_mem_defined) );
@@ -4946,7 +5706,7 @@ static void fl_pre_clo_init(void)
 
 
    init_shadow_memory();
-   FL_(malloc_list)  = VG_(HT_construct)( 80021 );   // prime, big
+   FL_(malloc_list)  = FL_(chunk_index_create)();
    FL_(mempool_list) = VG_(HT_construct)( 1009  );   // prime, not so big
    FL_(setup_tainted_map)();
    /* XXX: this will go away when ThreadState is fully used */
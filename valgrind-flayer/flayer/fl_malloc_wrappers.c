@@ -60,13 +60,53 @@ static SizeT cmalloc_bs_mallocd = 0;
    depth to show. */
 #define MEMPOOL_DEBUG_STACKTRACE_DEPTH 16
 
+/* A block that realloc() had to move is given this much room beyond
+   its new size -- half as much again, up to a limit -- so that a
+   buffer grown a little at a time is mostly grown in place. */
+#define REALLOC_SLACK_SZB(szB) \
+   ((szB) / 2 < (4 << 20) ? (szB) / 2 : (4 << 20))
+
+/* --heap-mode=fast: no redzones, no freed block queue, FL_Chunks from
+   a slab pool, and allocation sites only with --alloc-sites=yes.  None
+   of those help in tracking taint, and together they dominate
+   allocation-heavy clients.  The cost is that heap block overruns and
+   uses after free are no longer described as such. */
+static Bool heap_fast = False;
+
+/* Redzone around malloc'd blocks; 0 in fast mode. */
+SizeT FL_(malloc_redzone_szB) = FL_MALLOC_REDZONE_SZB;
+
+Bool FL_(setup_heap_mode) ( void )
+{
+   if (VG_STREQ(FL_(clo_heap_mode), "full"))
+      return True;
+   if (!VG_STREQ(FL_(clo_heap_mode), "fast"))
+      return False;
+
+   heap_fast = True;
+   FL_(malloc_redzone_szB) = 0;
+   /* The client arena is set up on its first allocation, so it is not
+      too late to change its redzone. */
+   VG_(needs_malloc_replacement)  (FL_(malloc),
+                                   FL_(__builtin_new),
+                                   FL_(__builtin_vec_new),
+                                   FL_(memalign),
+                                   FL_(calloc),
+                                   FL_(free),
+                                   FL_(__builtin_delete),
+                                   FL_(__builtin_vec_delete),
+                                   FL_(realloc),
+                                   0 );
+   return True;
+}
+
 
 /*------------------------------------------------------------*/
 /*--- Tracking malloc'd and free'd blocks                  ---*/
 /*------------------------------------------------------------*/
 
 /* Record malloc'd blocks. */
-VgHashTable FL_(malloc_list) = NULL;
+FL_ChunkIndex* FL_(malloc_list) = NULL;
 
 /* Memory pools. */
 VgHashTable FL_(mempool_list) = NULL;
@@ -120,6 +160,103 @@ static void add_to_freed_queue ( FL_Chunk* mc )
    }
 }
 
+/* Slab pool of FL_Chunks for malloc'd blocks in fast mode.  Custom
+   blocks' FL_Chunks always come from VG_(malloc), as VG_(HT_destruct)
+   frees them that way in FL_(destroy_mempool). */
+#define FL_CHUNKS_PER_SLAB 1024
+static FL_Chunk* free_chunks = NULL;
+
+static FL_Chunk* alloc_FL_Chunk ( FL_AllocKind kind )
+{
+   FL_Chunk* mc;
+   Int       i;
+
+   if (!heap_fast || FL_AllocCustom == kind)
+      return VG_(malloc)(sizeof(FL_Chunk));
+
+   if (free_chunks == NULL) {
+      FL_Chunk* slab = VG_(malloc)(FL_CHUNKS_PER_SLAB * sizeof(FL_Chunk));
+      /* Paranoia, once per slab; see create_FL_Chunk. */
+      if (!FL_(check_mem_is_noaccess)( (Addr)slab,
+                                       FL_CHUNKS_PER_SLAB * sizeof(FL_Chunk),
+                                       NULL )) {
+         VG_(tool_panic)("alloc_FL_Chunk: shadow area is accessible");
+      }
+      for (i = FL_CHUNKS_PER_SLAB-1; i >= 0; i--) {
+         slab[i].next = free_chunks;
+         free_chunks  = &slab[i];
+      }
+   }
+   mc = free_chunks;
+   free_chunks = mc->next;
+   return mc;
+}
+
+static void release_FL_Chunk ( FL_Chunk* mc )
+{
+   if (!heap_fast || FL_AllocCustom == mc->allockind) {
+      VG_(free) ( mc );
+   } else {
+      mc->next    = free_chunks;
+      free_chunks = mc;
+   }
+}
+
+/* --alloc-stack-sample=N: allocation sites are cached by the innermost
+   few return addresses, which are cheap to get, and the full stack is
+   only recorded for one allocation in N from each.  Direct mapped;
+   a collision just means an extra full stack. */
+#define SITE_KEY_IPS  3
+#define N_SITES       4096
+
+typedef
+   struct {
+      Addr        ips[SITE_KEY_IPS];
+      ExeContext* where;
+      UInt        uses;
+   }
+   AllocSite;
+
+static AllocSite alloc_sites[N_SITES];
+
+static ExeContext* sampled_where ( ThreadId tid )
+{
+   Addr       ips[SITE_KEY_IPS];
+   UInt       n_ips, i;
+   UWord      h = 0;
+   AllocSite* site;
+
+   n_ips = FL_(shadow_stack_trace)(tid, ips, SITE_KEY_IPS);
+   if (n_ips == 0)
+      n_ips = VG_(get_StackTrace)(tid, ips, SITE_KEY_IPS);
+   for (i = n_ips; i < SITE_KEY_IPS; i++)
+      ips[i] = 0;
+   for (i = 0; i < SITE_KEY_IPS; i++)
+      h = (h ^ ips[i]) * 2654435761U;
+   site = &alloc_sites[(h >> 8) % N_SITES];
+
+   if (site->where != NULL
+       && VG_(memcmp)(site->ips, ips, sizeof(ips)) == 0
+       && ++site->uses < (UInt)FL_(clo_alloc_stack_sample)) {
+      return site->where;
+   }
+   VG_(memcpy)(site->ips, ips, sizeof(ips));
+   site->where = VG_(record_ExeContext)(tid);
+   site->uses  = 0;
+   return site->where;
+}
+
+/* Where a block was allocated or freed, unless fast mode was asked not
+   to bother. */
+static ExeContext* block_where ( ThreadId tid )
+{
+   if (heap_fast && !FL_(clo_alloc_sites))
+      return NULL;
+   if (FL_(clo_alloc_stack_sample) > 1)
+      return sampled_where(tid);
+   return VG_(record_ExeContext)(tid);
+}
+
 FL_Chunk* FL_(get_freed_list_head)(void)
 {
    return freed_list_start;
@@ -130,17 +267,19 @@ static
 FL_Chunk* create_FL_Chunk ( ThreadId tid, Addr p, SizeT szB,
                             FL_AllocKind kind)
 {
-   FL_Chunk* mc  = VG_(malloc)(sizeof(FL_Chunk));
+   FL_Chunk* mc  = alloc_FL_Chunk(kind);
    mc->data      = p;
    mc->szB       = szB;
    mc->allockind = kind;
-   mc->where     = VG_(record_ExeContext)(tid);
+   mc->where     = block_where(tid);
 
    /* Paranoia ... ensure the FL_Chunk is off-limits to the client, so
       the mc->data field isn't visible to the leak checker.  If memory
       management is working correctly, any pointer returned by VG_(malloc)
-      should be noaccess as far as the client is concerned. */
-   if (!FL_(check_mem_is_noaccess)( (Addr)mc, sizeof(FL_Chunk), NULL )) {
+      should be noaccess as far as the client is concerned.  Slab chunks
+      were checked when the slab was made. */
+   if (!(heap_fast && FL_AllocCustom != kind)
+       && !FL_(check_mem_is_noaccess)( (Addr)mc, sizeof(FL_Chunk), NULL )) {
       VG_(tool_panic)("create_FL_Chunk: shadow area is accessible");
    } 
    return mc;
@@ -196,7 +335,11 @@ void* FL_(new_block) ( ThreadId tid,
    // Only update this stat if allocation succeeded.
    cmalloc_bs_mallocd += szB;
 
-   VG_(HT_add_node)( table, create_FL_Chunk(tid, p, szB, kind) );
+   if (table)
+      VG_(HT_add_node)( table, create_FL_Chunk(tid, p, szB, kind) );
+   else
+      FL_(chunk_index_add)( FL_(malloc_list),
+                            create_FL_Chunk(tid, p, szB, kind) );
 
    FL_(make_mem_defined)( p, szB );
 
@@ -209,8 +352,8 @@ void* FL_(malloc) ( ThreadId tid, SizeT n )
       return NULL;
    } else {
       return FL_(new_block) ( tid, 0, n, VG_(clo_alignment), 
-         FL_MALLOC_REDZONE_SZB, /*is_zeroed*/False, FL_AllocMalloc,
-         FL_(malloc_list));
+         FL_(malloc_redzone_szB), /*is_zeroed*/False, FL_AllocMalloc,
+         NULL);
    }
 }
 
@@ -220,8 +363,8 @@ void* FL_(__builtin_new) ( ThreadId tid, SizeT n )
       return NULL;
    } else {
       return FL_(new_block) ( tid, 0, n, VG_(clo_alignment), 
-         FL_MALLOC_REDZONE_SZB, /*is_zeroed*/False, FL_AllocNew,
-         FL_(malloc_list));
+         FL_(malloc_redzone_szB), /*is_zeroed*/False, FL_AllocNew,
+         NULL);
    }
 }
 
@@ -231,8 +374,8 @@ void* FL_(__builtin_vec_new) ( ThreadId tid, SizeT n )
       return NULL;
    } else {
       return FL_(new_block) ( tid, 0, n, VG_(clo_alignment), 
-         FL_MALLOC_REDZONE_SZB, /*is_zeroed*/False, FL_AllocNewVec,
-         FL_(malloc_list));
+         FL_(malloc_redzone_szB), /*is_zeroed*/False, FL_AllocNewVec,
+         NULL);
    }
 }
 
@@ -242,8 +385,8 @@ void* FL_(memalign) ( ThreadId tid, SizeT alignB, SizeT n )
       return NULL;
    } else {
       return FL_(new_block) ( tid, 0, n, alignB, 
-         FL_MALLOC_REDZONE_SZB, /*is_zeroed*/False, FL_AllocMalloc,
-         FL_(malloc_list));
+         FL_(malloc_redzone_szB), /*is_zeroed*/False, FL_AllocMalloc,
+         NULL);
    }
 }
 
@@ -253,14 +396,23 @@ void* FL_(calloc) ( ThreadId tid, SizeT nmemb, SizeT size1 )
       return NULL;
    } else {
       return FL_(new_block) ( tid, 0, nmemb*size1, VG_(clo_alignment),
-         FL_MALLOC_REDZONE_SZB, /*is_zeroed*/True, FL_AllocMalloc,
-         FL_(malloc_list));
+         FL_(malloc_redzone_szB), /*is_zeroed*/True, FL_AllocMalloc,
+         NULL);
    }
 }
 
 static
 void die_and_free_mem ( ThreadId tid, FL_Chunk* mc, SizeT rzB )
 {
+   if (heap_fast) {
+      /* Untaint this data and hand it straight back. */
+      FL_(make_mem_defined)( mc->data-rzB, mc->szB + 2*rzB );
+      if (FL_AllocCustom != mc->allockind)
+         VG_(cli_free) ( (void*)(mc->data) );
+      release_FL_Chunk ( mc );
+      return;
+   }
+
    /* Note: make redzones noaccess again -- just in case user made them
       accessible with a client request... */
    FL_(make_mem_noaccess)( mc->data-rzB, mc->szB + 2*rzB );
@@ -284,7 +436,7 @@ void FL_(handle_free) ( ThreadId tid, Addr p, UInt rzB, FL_AllocKind kind )
 
    cmalloc_n_frees++;
 
-   mc = VG_(HT_remove) ( FL_(malloc_list), (UWord)p );
+   mc = FL_(chunk_index_remove) ( FL_(malloc_list), p );
    if (mc == NULL) {
       FL_(record_free_error) ( tid, p );
    } else {
@@ -300,19 +452,19 @@ void FL_(handle_free) ( ThreadId tid, Addr p, UInt rzB, FL_AllocKind kind )
 void FL_(free) ( ThreadId tid, void* p )
 {
    FL_(handle_free)( 
-      tid, (Addr)p, FL_MALLOC_REDZONE_SZB, FL_AllocMalloc );
+      tid, (Addr)p, FL_(malloc_redzone_szB), FL_AllocMalloc );
 }
 
 void FL_(__builtin_delete) ( ThreadId tid, void* p )
 {
    FL_(handle_free)(
-      tid, (Addr)p, FL_MALLOC_REDZONE_SZB, FL_AllocNew);
+      tid, (Addr)p, FL_(malloc_redzone_szB), FL_AllocNew);
 }
 
 void FL_(__builtin_vec_delete) ( ThreadId tid, void* p )
 {
    FL_(handle_free)(
-      tid, (Addr)p, FL_MALLOC_REDZONE_SZB, FL_AllocNewVec);
+      tid, (Addr)p, FL_(malloc_redzone_szB), FL_AllocNewVec);
 }
 
 void* FL_(realloc) ( ThreadId tid, void* p_old, SizeT new_szB )
@@ -328,8 +480,8 @@ void* FL_(realloc) ( ThreadId tid, void* p_old, SizeT new_szB )
    if (complain_about_silly_args(new_szB, "realloc")) 
       return NULL;
 
-   /* Remove the old block */
-   mc = VG_(HT_remove) ( FL_(malloc_list), (UWord)p_old );
+   /* Find the old block; it stays in malloc_list unless it moves */
+   mc = FL_(chunk_index_lookup) ( FL_(malloc_list), (Addr)p_old );
    if (mc == NULL) {
       FL_(record_free_error) ( tid, (Addr)p_old );
       /* We return to the program regardless. */
@@ -348,27 +500,41 @@ void* FL_(realloc) ( ThreadId tid, void* p_old, SizeT new_szB )
 
    if (old_szB == new_szB) {
       /* size unchanged */
-      mc->where = VG_(record_ExeContext)(tid);
+      mc->where = block_where(tid);
       p_new = p_old;
       
    } else if (old_szB > new_szB) {
       /* new size is smaller */
       FL_(make_mem_noaccess)( mc->data+new_szB, mc->szB-new_szB );
       mc->szB = new_szB;
-      mc->where = VG_(record_ExeContext)(tid);
+      mc->where = block_where(tid);
+      p_new = p_old;
+
+   } else if (VG_(cli_grow_in_place)(p_old, new_szB)) {
+      /* new size is bigger, but there was room after the block: only
+         the new tail needs its shadow set */
+      FL_(make_mem_defined)( mc->data+old_szB, new_szB-old_szB );
+      FL_(make_mem_noaccess)( mc->data+new_szB, FL_(malloc_redzone_szB) );
+      mc->szB = new_szB;
+      mc->where = block_where(tid);
       p_new = p_old;
 
    } else {
       /* new size is bigger */
-      /* Get new memory */
-      Addr a_new = (Addr)VG_(cli_malloc)(VG_(clo_alignment), new_szB);
+      /* Get new memory, with room to grow */
+      Addr a_new = (Addr)VG_(cli_malloc)(VG_(clo_alignment),
+                                         new_szB + REALLOC_SLACK_SZB(new_szB));
+      /* The room to grow is only a nicety: don't fail for want of it */
+      if (!a_new)
+         a_new = (Addr)VG_(cli_malloc)(VG_(clo_alignment), new_szB);
 
       if (a_new) {
          /* First half kept and copied, second half new, red zones as normal */
-         FL_(make_mem_noaccess)( a_new-FL_MALLOC_REDZONE_SZB, FL_MALLOC_REDZONE_SZB );
+         FL_(make_mem_noaccess)( a_new-FL_(malloc_redzone_szB),
+                                 FL_(malloc_redzone_szB) );
          FL_(copy_address_range_state)( (Addr)p_old, a_new, mc->szB );
          FL_(make_mem_defined)( a_new+mc->szB, new_szB-mc->szB );
-         FL_(make_mem_noaccess) ( a_new+new_szB, FL_MALLOC_REDZONE_SZB );
+         FL_(make_mem_noaccess) ( a_new+new_szB, FL_(malloc_redzone_szB) );
 
          /* Copy from old to new */
          VG_(memcpy)((void*)a_new, p_old, mc->szB);
@@ -377,22 +543,17 @@ void* FL_(realloc) ( ThreadId tid, void* p_old, SizeT new_szB )
          /* Nb: we have to allocate a new FL_Chunk for the new memory rather
             than recycling the old one, so that any erroneous accesses to the
             old memory are reported. */
-         die_and_free_mem ( tid, mc, FL_MALLOC_REDZONE_SZB );
+         FL_(chunk_index_remove) ( FL_(malloc_list), (Addr)p_old );
+         die_and_free_mem ( tid, mc, FL_(malloc_redzone_szB) );
 
          // Allocate a new chunk.
          mc = create_FL_Chunk( tid, a_new, new_szB, FL_AllocMalloc );
+         FL_(chunk_index_add) ( FL_(malloc_list), mc );
       }
 
       p_new = (void*)a_new;
    }  
 
-   // Now insert the new mc (with a possibly new 'data' field) into
-   // malloc_list.  If this realloc() did not increase the memory size, we
-   // will have removed and then re-added mc unnecessarily.  But that's ok
-   // because shrinking a block with realloc() is (presumably) much rarer
-   // than growing it, and this way simplifies the growing case.
-   VG_(HT_add_node)( FL_(malloc_list), mc );
-
    return p_new;
 }
 
@@ -541,7 +702,8 @@ check_mempool_sane(FL_Mempool* mp)
                          chunks[i]->data, 
                          chunks[i]->data + chunks[i]->szB);
 
-            VG_(pp_ExeContext)(chunks[i]->where);
+            if (chunks[i]->where)
+               VG_(pp_ExeContext)(chunks[i]->where);
          }
    }
    VG_(free)(chunks);
@@ -798,8 +960,8 @@ void FL_(print_malloc_stats) ( void )
       return;
 
    /* Count memory still in use. */
-   VG_(HT_ResetIter)(FL_(malloc_list));
-   while ( (mc = VG_(HT_Next)(FL_(malloc_list))) ) {
+   FL_(chunk_index_reset_iter)(FL_(malloc_list));
+   while ( (mc = FL_(chunk_index_next)(FL_(malloc_list))) ) {
       nblocks++;
       nbytes += mc->szB;
    }
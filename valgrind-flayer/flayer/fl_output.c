@@ -0,0 +1,582 @@
+/*--------------------------------------------------------------------*/
+/*--- Streaming errors out as JSON Lines or binary records.        ---*/
+/*---                                                  fl_output.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Flayer, a heavyweight Valgrind tool for
+   tracking marked/tainted data through memory.
+
+   Copyright (C) 2006-2007 Google Inc. (Will Drewry)
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+/* The XML output goes out a line at a time through VG_(message), and
+ * drivers can only parse it once the run is over.  With
+ * --output-format=jsonl|binary each error is also written to
+ * --output-file as one self-contained record when it is first seen,
+ * and then again, as a short count record, whenever its count has
+ * gone up.  Records are gathered in a large buffer which is written
+ * out when it fills, when a new error comes along and the last write
+ * was more than FLUSH_MS ago, and at exit, so a driver can tail the
+ * file while the client runs.  libflayer's valgrind.error_parser reads
+ * both formats.
+ *
+ * jsonl: one JSON object per line, either
+ *
+ *   {"type":"error","unique":N,"tid":N,"kind":"...","what":"...",
+ *    "count":N,"frames":[{"ip":"0x...","obj":"...","fn":"...",
+ *    "dir":"...","file":"...","line":N},...]}
+ *   {"type":"count","unique":N,"count":N}
+ *
+ * binary: FL_OUTPUT_MAGIC, then records, little-endian, strings being
+ * a UShort length and that many bytes:
+ *
+ *   UChar FL_Output_Error, UInt unique, UInt tid, UInt count,
+ *      string kind, string what, UShort n_frames, and per frame
+ *      ULong ip, string obj, fn, dir, file, UInt line
+ *   UChar FL_Output_Count, UInt unique, UInt count
+ *
+ * Looking up the names of every frame of every new error is slow, so
+ * with --symbolise=exit frames are written as bare ips (the names
+ * empty in binary records), and each distinct ip is looked up once at
+ * exit, in a record of its own:
+ *
+ *   {"type":"symbol","ip":"0x...","obj":"...","fn":"...","dir":"...",
+ *    "file":"...","line":N}
+ *   UChar FL_Output_Symbol, ULong ip, string obj, fn, dir, file,
+ *      UInt line
+ *
+ * With --symbolise=offline even that is left to the reader.  In both
+ * modes the core is also told not to print each new error in the text
+ * or XML log, which would name its frames there and then; the log
+ * keeps the counts and the summary.  The first ip seen in each loaded
+ * object also writes out where the object is, so that ips can be
+ * symbolised after the object has been unmapped, or offline:
+ *
+ *   {"type":"object","start":"0x...","size":N,"bias":"0x...",
+ *    "file":"..."}
+ *   UChar FL_Output_Object, ULong start, ULong size, ULong bias,
+ *      string file
+ *
+ * In fork server children the output goes to <file>.<pid>.
+ */
+
+#include "pub_tool_basics.h"
+#include "pub_tool_vki.h"
+#include "pub_tool_debuginfo.h"
+#include "pub_tool_errormgr.h"
+#include "pub_tool_execontext.h"
+#include "pub_tool_libcbase.h"
+#include "pub_tool_libcassert.h"
+#include "pub_tool_libcfile.h"
+#include "pub_tool_libcprint.h"
+#include "pub_tool_libcproc.h"
+#include "pub_tool_machine.h"
+#include "pub_tool_hashtable.h"
+#include "pub_tool_mallocfree.h"
+#include "pub_tool_tooliface.h"     // Needed for fl_include.h
+
+#include "fl_include.h"
+
+#define FL_OUTPUT_MAGIC "FLERRS01"
+
+#define FLUSH_MS       500
+#define CHECK_EVERY    1024       // count updates between timer reads
+#define N_NAME         256
+#define MAX_FRAMES     50
+
+enum {
+   FL_Output_Error  = 0,
+   FL_Output_Count  = 1,
+   FL_Output_Symbol = 2,
+   FL_Output_Object = 3
+};
+
+static Bool  out_binary = False;
+static Bool  out_defer_symbols = False;
+static Int   out_fd = -1;
+static UChar out_buf[1 << 20];
+static Int   out_used = 0;
+static UInt  out_last_flush_ms = 0;
+static UInt  out_updates = 0;
+
+/* Errors whose count has gone up since the last flush. */
+typedef
+   struct _ErrorNode {
+      struct _ErrorNode* next;
+      UWord              unique;    // key
+      Int                count;
+      Bool               written;   // full record in the current file?
+      Bool               dirty;
+      struct _ErrorNode* dirty_next;
+   }
+   ErrorNode;
+
+static VgHashTable error_nodes = NULL;
+static ErrorNode*  dirty_list  = NULL;
+
+/* With --symbolise=exit|offline: the ips written so far, and the
+   start addresses of the objects described so far. */
+typedef
+   struct _IpNode {
+      struct _IpNode* next;
+      UWord           ip;       // key
+   }
+   IpNode;
+
+static VgHashTable seen_ips     = NULL;
+static VgHashTable seen_objects = NULL;
+
+/*------------------------------------------------------------*/
+/*--- Buffering                                            ---*/
+/*------------------------------------------------------------*/
+
+static void write_out ( void )
+{
+   if (out_fd >= 0 && out_used > 0)
+      VG_(write)(out_fd, out_buf, out_used);
+   out_used = 0;
+}
+
+static void put_bytes ( const void* p, Int n )
+{
+   const UChar* b = p;
+   while (n > 0) {
+      Int k = sizeof(out_buf) - out_used;
+      if (k == 0) {
+         write_out();
+         k = sizeof(out_buf);
+      }
+      if (k > n)
+         k = n;
+      VG_(memcpy)(out_buf + out_used, b, k);
+      out_used += k;
+      b += k;
+      n -= k;
+   }
+}
+
+static void put_byte ( UChar c )
+{
+   if (out_used == sizeof(out_buf))
+      write_out();
+   out_buf[out_used++] = c;
+}
+
+static void put_str ( const Char* s )
+{
+   put_bytes(s, VG_(strlen)(s));
+}
+
+static void put_fmt ( const Char* format, ... )
+{
+   Char    buf[64];
+   va_list vargs;
+
+   va_start(vargs, format);
+   VG_(vsnprintf)(buf, sizeof(buf), format, vargs);
+   va_end(vargs);
+   put_str(buf);
+}
+
+static void put_le ( ULong v, Int n )
+{
+   Int i;
+   for (i = 0; i < n; i++)
+      put_byte((UChar)(v >> (8 * i)));
+}
+
+/* A string, as a JSON string literal or as a binary string. */
+static void put_string ( const Char* s )
+{
+   static const Char hex[] = "0123456789abcdef";
+   const UChar* p;
+
+   if (out_binary) {
+      Int n = VG_(strlen)(s);
+      if (n > 0xFFFF)
+         n = 0xFFFF;
+      put_le(n, 2);
+      put_bytes(s, n);
+      return;
+   }
+
+   put_byte('"');
+   for (p = (const UChar*)s; *p != 0; p++) {
+      if (*p == '"' || *p == '\\') {
+         put_byte('\\');
+         put_byte(*p);
+      } else if (*p < 0x20) {
+         put_str("\\u00");
+         put_byte(hex[*p >> 4]);
+         put_byte(hex[*p & 15]);
+      } else {
+         put_byte(*p);
+      }
+   }
+   put_byte('"');
+}
+
+static void put_count_record ( UInt unique, Int count )
+{
+   if (out_binary) {
+      put_byte(FL_Output_Count);
+      put_le(unique, 4);
+      put_le(count, 4);
+   } else {
+      put_fmt("{\"type\":\"count\",\"unique\":%u,\"count\":%d}\n",
+              unique, count);
+   }
+}
+
+void FL_(output_flush) ( void )
+{
+   ErrorNode* en;
+
+   if (out_fd < 0)
+      return;
+   for (en = dirty_list; en != NULL; en = en->dirty_next) {
+      put_count_record(en->unique, en->count);
+      en->dirty = False;
+   }
+   dirty_list = NULL;
+   write_out();
+   out_last_flush_ms = VG_(read_millisecond_timer)();
+}
+
+/*------------------------------------------------------------*/
+/*--- Error records                                        ---*/
+/*------------------------------------------------------------*/
+
+/* The names of ip, as the fields of a frame or symbol record. */
+static void put_names ( Addr ip )
+{
+   Char obj[N_NAME], fn[N_NAME], dir[N_NAME], file[N_NAME];
+   Bool dir_ok = False;
+   UInt line = 0;
+
+   if (!VG_(get_objname)(ip, obj, N_NAME))
+      obj[0] = 0;
+   if (!VG_(get_fnname)(ip, fn, N_NAME))
+      fn[0] = 0;
+   if (!VG_(get_filename_linenum)(ip, file, N_NAME, dir, N_NAME,
+                                  &dir_ok, &line)) {
+      file[0] = 0;
+      line = 0;
+   }
+   if (!dir_ok)
+      dir[0] = 0;
+
+   if (out_binary) {
+      put_string(obj);
+      put_string(fn);
+      put_string(dir);
+      put_string(file);
+      put_le(line, 4);
+   } else {
+      put_str(",\"obj\":");
+      put_string(obj);
+      put_str(",\"fn\":");
+      put_string(fn);
+      put_str(",\"dir\":");
+      put_string(dir);
+      put_str(",\"file\":");
+      put_string(file);
+      put_fmt(",\"line\":%u", line);
+   }
+}
+
+static void put_object_record ( const SegInfo* si )
+{
+   const UChar* file = VG_(seginfo_filename)(si);
+
+   if (file == NULL)
+      file = "";
+   if (out_binary) {
+      put_byte(FL_Output_Object);
+      put_le(VG_(seginfo_start)(si), 8);
+      put_le(VG_(seginfo_size)(si), 8);
+      put_le(VG_(seginfo_sym_offset)(si), 8);
+      put_string(file);
+   } else {
+      put_fmt("{\"type\":\"object\",\"start\":\"0x%llX\"",
+              (ULong)VG_(seginfo_start)(si));
+      put_fmt(",\"size\":%llu", (ULong)VG_(seginfo_size)(si));
+      put_fmt(",\"bias\":\"0x%llX\",\"file\":", VG_(seginfo_sym_offset)(si));
+      put_string(file);
+      put_str("}\n");
+   }
+}
+
+/* Remember ip for symbolising later; the first time an object turns
+   up, say where it is. */
+static void note_ip ( Addr ip )
+{
+   IpNode*        n;
+   const SegInfo* si;
+
+   if (VG_(HT_lookup)(seen_ips, ip) != NULL)
+      return;
+   n = VG_(malloc)(sizeof(IpNode));
+   n->ip = ip;
+   VG_(HT_add_node)(seen_ips, n);
+
+   si = VG_(find_seginfo)(ip);
+   if (si == NULL || VG_(HT_lookup)(seen_objects, VG_(seginfo_start)(si)))
+      return;
+   n = VG_(malloc)(sizeof(IpNode));
+   n->ip = VG_(seginfo_start)(si);
+   VG_(HT_add_node)(seen_objects, n);
+   put_object_record(si);
+}
+
+static void put_frame ( Addr ip )
+{
+   if (out_binary) {
+      put_le(ip, 8);
+      if (out_defer_symbols) {
+         put_le(0, 2);
+         put_le(0, 2);
+         put_le(0, 2);
+         put_le(0, 2);
+         put_le(0, 4);
+      } else {
+         put_names(ip);
+      }
+   } else {
+      put_fmt("{\"ip\":\"0x%llX\"", (ULong)ip);
+      if (!out_defer_symbols)
+         put_names(ip);
+      put_byte('}');
+   }
+}
+
+/* --symbolise=exit: the names of every ip written. */
+static void put_symbol_records ( void )
+{
+   IpNode* n;
+
+   VG_(HT_ResetIter)(seen_ips);
+   while ((n = VG_(HT_Next)(seen_ips)) != NULL) {
+      if (out_binary) {
+         put_byte(FL_Output_Symbol);
+         put_le(n->ip, 8);
+      } else {
+         put_fmt("{\"type\":\"symbol\",\"ip\":\"0x%llX\"", (ULong)n->ip);
+      }
+      put_names(n->ip);
+      if (!out_binary)
+         put_str("}\n");
+   }
+}
+
+static Addr frame_ips[MAX_FRAMES];
+static UInt n_frame_ips;
+
+static void collect_ip ( UInt n, Addr ip )
+{
+   if (n_frame_ips < MAX_FRAMES)
+      frame_ips[n_frame_ips++] = ip;
+}
+
+/* The frames of where, without any symbol lookups.  Like
+   VG_(apply_StackTrace), but without stopping at main(), which would
+   need the function names. */
+static void collect_raw_ips ( ExeContext* where )
+{
+   Addr* ips = VG_(get_ExeContext_StackTrace)(where);
+   UInt  n   = VG_(get_ExeContext_n_ips)(where);
+   UInt  i;
+
+   for (i = 0; i < n && n_frame_ips < MAX_FRAMES; i++) {
+      if (i > 0 && ips[i] == 0)
+         break;
+      frame_ips[n_frame_ips] = i > 0 ? ips[i] - VG_MIN_INSTR_SZB : ips[i];
+      note_ip(frame_ips[n_frame_ips]);
+      n_frame_ips++;
+   }
+}
+
+static void put_error_record ( Error* err )
+{
+   Char  what[256];
+   Char* kind = FL_(describe_Error)(err, what, sizeof(what));
+   UInt  i;
+
+   n_frame_ips = 0;
+   if (out_defer_symbols)
+      collect_raw_ips(VG_(get_error_where)(err));
+   else
+      VG_(apply_ExeContext)(collect_ip, VG_(get_error_where)(err),
+                            MAX_FRAMES);
+
+   if (out_binary) {
+      put_byte(FL_Output_Error);
+      put_le(VG_(get_error_unique)(err), 4);
+      put_le(VG_(get_error_tid)(err), 4);
+      put_le(VG_(get_error_count)(err), 4);
+      put_string(kind);
+      put_string(what);
+      put_le(n_frame_ips, 2);
+      for (i = 0; i < n_frame_ips; i++)
+         put_frame(frame_ips[i]);
+   } else {
+      put_fmt("{\"type\":\"error\",\"unique\":%u,\"tid\":%d,\"kind\":",
+              VG_(get_error_unique)(err), (Int)VG_(get_error_tid)(err));
+      put_string(kind);
+      put_str(",\"what\":");
+      put_string(what);
+      put_fmt(",\"count\":%d,\"frames\":[", VG_(get_error_count)(err));
+      for (i = 0; i < n_frame_ips; i++) {
+         if (i > 0)
+            put_byte(',');
+         put_frame(frame_ips[i]);
+      }
+      put_str("]}\n");
+   }
+}
+
+/* For VG_(needs_error_stream). */
+void FL_(output_error) ( Error* err, Bool is_new )
+{
+   UWord      unique = VG_(get_error_unique)(err);
+   ErrorNode* en;
+
+   if (out_fd < 0)
+      return;
+
+   en = VG_(HT_lookup)(error_nodes, unique);
+   if (en == NULL) {
+      en = VG_(malloc)(sizeof(ErrorNode));
+      en->unique  = unique;
+      en->written = False;
+      en->dirty   = False;
+      VG_(HT_add_node)(error_nodes, en);
+   }
+
+   /* A fork server child's file starts empty, so the first repeat
+      there of an error seen in the parent is written out in full. */
+   if (is_new || !en->written) {
+      put_error_record(err);
+      en->written = True;
+      if (VG_(read_millisecond_timer)() - out_last_flush_ms >= FLUSH_MS)
+         FL_(output_flush)();
+      return;
+   }
+
+   en->count = VG_(get_error_count)(err);
+   if (!en->dirty) {
+      en->dirty      = True;
+      en->dirty_next = dirty_list;
+      dirty_list     = en;
+   }
+   if (++out_updates % CHECK_EVERY == 0
+       && VG_(read_millisecond_timer)() - out_last_flush_ms >= FLUSH_MS)
+      FL_(output_flush)();
+}
+
+/*------------------------------------------------------------*/
+/*--- Setup                                                ---*/
+/*------------------------------------------------------------*/
+
+static Bool open_output ( Char* path )
+{
+   SysRes sres = VG_(open)(path, VKI_O_CREAT|VKI_O_TRUNC|VKI_O_WRONLY,
+                           VKI_S_IRUSR|VKI_S_IWUSR);
+   if (sres.isError) {
+      VG_(message)(Vg_UserMsg, "can't create output file '%s'", path);
+      return False;
+   }
+   out_fd = sres.res;
+   out_used = 0;
+   if (out_binary)
+      put_bytes(FL_OUTPUT_MAGIC, 8);
+   out_last_flush_ms = VG_(read_millisecond_timer)();
+   return True;
+}
+
+Bool FL_(setup_output) ( void )
+{
+   if (FL_(clo_output_format) == NULL)
+      return True;
+   if (VG_STREQ(FL_(clo_output_format), "binary"))
+      out_binary = True;
+   else if (!VG_STREQ(FL_(clo_output_format), "jsonl"))
+      return False;
+   if (FL_(clo_output_file) == NULL) {
+      VG_(message)(Vg_UserMsg, "--output-format needs --output-file");
+      return False;
+   }
+   if (VG_STREQ(FL_(clo_symbolise), "exit")
+       || VG_STREQ(FL_(clo_symbolise), "offline"))
+      out_defer_symbols = True;
+   else if (!VG_STREQ(FL_(clo_symbolise), "eager")) {
+      VG_(message)(Vg_UserMsg, "bad --symbolise=%s", FL_(clo_symbolise));
+      return False;
+   }
+   error_nodes  = VG_(HT_construct)( 4099 );
+   seen_ips     = VG_(HT_construct)( 4099 );
+   seen_objects = VG_(HT_construct)( 211 );
+   VG_(needs_error_stream)( FL_(output_error),
+                            /*log_errors*/!out_defer_symbols );
+   return open_output(FL_(clo_output_file));
+}
+
+/* In a fork server child: start an output file of its own.  Errors
+   already streamed by the parent are not repeated, but as the new file
+   must be readable on its own, one the child sees again is written out
+   in full. */
+void FL_(output_reopen_for_child) ( void )
+{
+   Char       path[VKI_PATH_MAX];
+   ErrorNode* en;
+
+   if (out_fd < 0)
+      return;
+   VG_(close)(out_fd);
+   out_fd = -1;
+   for (; dirty_list != NULL; dirty_list = dirty_list->dirty_next)
+      dirty_list->dirty = False;
+   VG_(HT_ResetIter)(error_nodes);
+   while ((en = VG_(HT_Next)(error_nodes)) != NULL)
+      en->written = False;
+   if (out_defer_symbols) {
+      /* The parent's ips and objects aren't in the new file. */
+      seen_ips     = VG_(HT_construct)( 4099 );
+      seen_objects = VG_(HT_construct)( 211 );
+   }
+   VG_(snprintf)(path, sizeof(path), "%s.%d",
+                 FL_(clo_output_file), VG_(getpid)());
+   open_output(path);
+}
+
+void FL_(output_fini) ( void )
+{
+   if (out_fd >= 0 && VG_STREQ(FL_(clo_symbolise), "exit"))
+      put_symbol_records();
+   FL_(output_flush)();
+   if (out_fd >= 0)
+      VG_(close)(out_fd);
+   out_fd = -1;
+}
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
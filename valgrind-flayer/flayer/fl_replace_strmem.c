@@ -101,6 +101,38 @@ Bool is_overlap ( void* dst, const void* src, SizeT dstlen, SizeT srclen )
 			      s, src, dst, len, 0); \
 }
 
+/* Have the tool do the copy (or fill) natively, moving the taint in one
+   go.  Evaluates to zero if it declined, in which case the caller falls
+   back to doing it here, a byte at a time. */
+#define NATIVE_MEMMOVE(dst, src, len) \
+   (__extension__({ \
+      Word _res; \
+      VALGRIND_DO_CLIENT_REQUEST(_res, 0, \
+                                 _VG_USERREQ__FLAYER_MEMMOVE, \
+                                 dst, src, len, 0, 0); \
+      _res; \
+   }))
+
+#define NATIVE_MEMSET(dst, cp, len) \
+   (__extension__({ \
+      Word _res; \
+      VALGRIND_DO_CLIENT_REQUEST(_res, 0, \
+                                 _VG_USERREQ__FLAYER_MEMSET, \
+                                 dst, cp, len, 0, 0); \
+      _res; \
+   }))
+
+/* Have the tool compute a string function natively, storing the result
+   (and its taint) through the given pointer.  Evaluates to zero if it
+   declined, in which case the caller does it here instead. */
+#define NATIVE_STRING_OP(req, a1, a2, a3, a4) \
+   (__extension__({ \
+      Word _res; \
+      VALGRIND_DO_CLIENT_REQUEST(_res, 0, \
+                                 req, a1, a2, a3, a4, 0); \
+      _res; \
+   }))
+
 /* --------- Some handy Z-encoded names. --------- */
 
 /* --- Soname of the standard C library. --- */
@@ -150,6 +182,9 @@ STRRCHR(m_ld_linux_so_2, rindex)
    { \
       UChar  ch = (UChar)((UInt)c); \
       UChar* p  = (UChar*)s; \
+      UChar* found; \
+      if (NATIVE_STRING_OP(_VG_USERREQ__FLAYER_STRCHR, s, ch, &found, 0)) \
+         return found; \
       while (True) { \
          if (*p == ch) return p; \
          if (*p == 0) return NULL; \
@@ -223,6 +258,8 @@ STRNCAT(m_libc_soname, strncat)
    SizeT VG_REPLACE_FUNCTION_ZU(soname,fnname) ( const char* str, SizeT n ) \
    { \
       SizeT i = 0; \
+      if (NATIVE_STRING_OP(_VG_USERREQ__FLAYER_STRLEN, str, n, &i, 0)) \
+         return i; \
       while (i < n && str[i] != 0) i++; \
       if (VALGRIND_CHECK_MEM_IS_UNTAINTED(str, i)) \
         VALGRIND_MAKE_MEM_TAINTED(&i, sizeof(i)); \
@@ -243,6 +280,9 @@ STRNLEN(m_libc_soname, strnlen)
    SizeT VG_REPLACE_FUNCTION_ZU(soname,fnname)( const char* str ) \
    { \
       SizeT i = 0; \
+      if (NATIVE_STRING_OP(_VG_USERREQ__FLAYER_STRLEN, \
+                           str, ~(SizeT)0, &i, 0)) \
+         return i; \
       while (str[i] != 0) i++; \
       if (VALGRIND_CHECK_MEM_IS_UNTAINTED(str, i)) \
         VALGRIND_MAKE_MEM_TAINTED(&i, sizeof(i)); \
@@ -313,6 +353,8 @@ STRNCPY(m_libc_soname, strncpy)
       int r = 0; \
       const char *orig_s1 = s1, *orig_s2 = s2; \
       \
+      if (NATIVE_STRING_OP(_VG_USERREQ__FLAYER_STRCMP, s1, s2, nmax, &r)) \
+         return r; \
       while (True) { \
          if (n >= nmax) break; \
          if (*s1 == 0 && *s2 == 0) break; \
@@ -345,6 +387,9 @@ STRNCMP(m_libc_soname, strncmp)
       const char *orig_s1 = s1, *orig_s2 = s2; \
       SizeT len = 0; \
       int r = 0; \
+      if (NATIVE_STRING_OP(_VG_USERREQ__FLAYER_STRCMP, \
+                           s1, s2, ~(SizeT)0, &r)) \
+         return r; \
       while (True) { \
          c1 = *(unsigned char *)s1; \
          c2 = *(unsigned char *)s2; \
@@ -375,6 +420,9 @@ STRCMP(m_ld64_so_1,            strcmp)
       SizeT i; \
       UChar c0 = (UChar)c; \
       UChar* p = (UChar*)s; \
+      void* found; \
+      if (NATIVE_STRING_OP(_VG_USERREQ__FLAYER_MEMCHR, s, c0, n, &found)) \
+         return found; \
       for (i = 0; i < n; i++) \
          if (p[i] == c0) return (void*)(&p[i]); \
       return NULL; \
@@ -397,6 +445,9 @@ MEMCHR(m_libc_soname, memchr)
  \
       if (is_overlap(dst, src, len, len)) \
          RECORD_OVERLAP_ERROR("memcpy", dst, src, len); \
+ \
+      if (NATIVE_MEMMOVE(dst, src, len)) \
+         return dst; \
  \
       if ( dst > src ) { \
          d = (char *)dst + len - 1; \
@@ -454,6 +505,8 @@ MEMCPY(NONE, _intel_fast_memcpy)
       unsigned char* s1 = (unsigned char*)s1V; \
       unsigned char* s2 = (unsigned char*)s2V; \
  \
+      if (NATIVE_STRING_OP(_VG_USERREQ__FLAYER_MEMCMP, s1V, s2V, n, &res)) \
+         return res; \
       while (n != 0) { \
          a0 = s1[0]; \
          b0 = s2[0]; \
@@ -509,6 +562,11 @@ STPCPY(m_ld_linux_x86_64_so_2, stpcpy)
    void* VG_REPLACE_FUNCTION_ZU(soname,fnname)(void *s, Int c, SizeT n) \
    { \
       unsigned char *cp = s; \
+      /* In memory, so the tool can see the taint of c. */ \
+      volatile unsigned char fill = c; \
+ \
+      if (n > 0 && NATIVE_MEMSET(s, &fill, n)) \
+         return s; \
  \
       while(n--) \
          *cp++ = c; \
@@ -528,6 +586,8 @@ MEMSET(m_libc_soname, memset)
       SizeT i; \
       Char* dst = (Char*)dstV; \
       Char* src = (Char*)srcV; \
+      if (n > 0 && NATIVE_MEMMOVE(dstV, srcV, n)) \
+         return dst; \
       if (dst < src) { \
          for (i = 0; i < n; i++) \
             dst[i] = src[i]; \
@@ -646,6 +706,9 @@ GLIBC25___STPCPY_CHK(m_libc_soname, __stpcpy_chk)
       if (is_overlap(dst, src, len, len)) \
          RECORD_OVERLAP_ERROR("mempcpy", dst, src, len); \
       \
+      if (NATIVE_MEMMOVE(dst, src, len)) \
+         return (void*)( ((char*)dst) + len_saved ); \
+      \
       if ( dst > src ) { \
          d = (char *)dst + len - 1; \
          s = (char *)src + len - 1; \
@@ -98,6 +98,29 @@ void FL_(setup_guest_args)( void ) {
   VG_(memset)(&guest_args, 0, sizeof(guest_args));
 }
 
+/* Clear the shadow register state of every thread, ie. untaint all
+ * registers.  Used between persistent-mode iterations. */
+void FL_(untaint_guest_state)( void ) {
+  ThreadId tid;
+  for (tid = 1; tid < VG_N_THREADS; tid++) {
+    if (!VG_(is_valid_tid)(tid))
+      continue;
+    VG_(memset)(&VG_(get_ThreadState)(tid)->arch.vex_shadow,
+                V_BITS8_UNTAINTED, sizeof(VexGuestArchState));
+  }
+}
+
+/* Bytes of input tainted since startup or the last persistent-mode
+ * iteration began. */
+ULong FL_(n_input_bytes_tainted) = 0;
+
+static
+void taint_input(Addr a, SizeT len)
+{
+  FL_(n_input_bytes_tainted) += len;
+  FL_(make_mem_undefined)(a, len);
+}
+
 #define MAX_PATH 256
 static
 void resolve_fd(UWord fd, Char *path, Int max) 
@@ -116,19 +139,301 @@ void resolve_fd(UWord fd, Char *path, Int max)
 // TODO: copy linked list setup for allocated_fds in clo_track_fds.
 //       or see if they will patch it to allow tools to access it.
 /* enforce an arbitrary maximum */
-#define MAXIMUM_FDS 256
+#define MAXIMUM_FDS FL_MAXIMUM_FDS
 static Bool tainted_fds[VG_N_THREADS][MAXIMUM_FDS];
 
 
+/* One end of an AF_INET socket.  addr is kept in network byte order,
+ * exactly as it sits in a struct sockaddr_in; port in host order. */
+typedef
+       struct {
+         Bool   valid;
+         UInt   addr;
+         UShort port;
+       }
+SockEnd;
+
+/* Per-fd socket endpoints, filled in once when the connection is set
+ * up (bind/connect/accept) so --network-filter is only evaluated there
+ * and never on the read path.  fds are process-wide, so unlike
+ * tainted_fds this is not per-thread.
+ */
+typedef
+       struct {
+         SockEnd local;
+         SockEnd remote;
+       }
+FdSockInfo;
+
+static FdSockInfo fd_sockinfo[MAXIMUM_FDS];
+
+/* --network-filter=host:port,...  Either half may be empty or '*'
+ * to match anything.  Hosts must be dotted quads; we have no resolver.
+ */
+#define MAXIMUM_NETWORK_FILTERS 32
+typedef
+       struct {
+         Bool   any_addr;
+         UInt   addr;
+         Bool   any_port;
+         UShort port;
+       }
+NetworkFilter;
+
+static NetworkFilter network_filters[MAXIMUM_NETWORK_FILTERS];
+static Int n_network_filters = 0;
+
+static
+Bool parse_dotted_quad(Char *str, Char *end, UInt *result)
+{
+  UChar *bytes = (UChar *)result;
+  Int i;
+  for (i = 0; i < 4; i++) {
+    UInt octet = 0;
+    Int digits = 0;
+    while (str < end && VG_(isdigit)(*str) && digits < 3) {
+      octet = octet * 10 + (*str - '0');
+      str++;
+      digits++;
+    }
+    if (digits == 0 || octet > 255)
+      return False;
+    bytes[i] = (UChar)octet;
+    if (i < 3) {
+      if (str >= end || *str != '.')
+        return False;
+      str++;
+    }
+  }
+  return str == end;
+}
+
+static
+Bool parse_network_filter_entry(Char *str, Char *end, NetworkFilter *nf)
+{
+  Char *colon = str;
+  while (colon < end && *colon != ':')
+    colon++;
+
+  /* host */
+  if (colon == str || (colon - str == 1 && *str == '*')) {
+    nf->any_addr = True;
+    nf->addr = 0;
+  } else {
+    nf->any_addr = False;
+    if (!parse_dotted_quad(str, colon, &nf->addr))
+      return False;
+  }
+
+  /* port */
+  nf->any_port = True;
+  nf->port = 0;
+  if (colon < end) {
+    Char *p = colon + 1;
+    UInt port = 0;
+    if (p == end || (end - p == 1 && *p == '*'))
+      return True;
+    for (; p < end; p++) {
+      if (!VG_(isdigit)(*p))
+        return False;
+      port = port * 10 + (*p - '0');
+      if (port > 65535)
+        return False;
+    }
+    nf->any_port = False;
+    nf->port = (UShort)port;
+  }
+  return True;
+}
+
+Bool FL_(setup_network_filter)( void ) {
+  Char *cursor = FL_(clo_network_filter);
+  n_network_filters = 0;
+  if (cursor == NULL)
+    return True;
+
+  while (*cursor != '\0') {
+    Char *end = cursor;
+    while (*end != '\0' && *end != ',')
+      end++;
+    if (end > cursor) {
+      if (n_network_filters >= MAXIMUM_NETWORK_FILTERS) {
+        VG_(message)(Vg_UserMsg,
+                     "--network-filter: more than %d entries given",
+                     MAXIMUM_NETWORK_FILTERS);
+        return False;
+      }
+      if (!parse_network_filter_entry(cursor, end,
+                                      &network_filters[n_network_filters])) {
+        VG_(message)(Vg_UserMsg,
+                     "--network-filter: bad entry '%s'", cursor);
+        return False;
+      }
+      n_network_filters++;
+    }
+    cursor = (*end == ',') ? end + 1 : end;
+  }
+  return True;
+}
+
+static
+Bool network_filter_matches_end(SockEnd *se)
+{
+  Int i;
+  if (!se->valid)
+    return False;
+  for (i = 0; i < n_network_filters; i++) {
+    NetworkFilter *nf = &network_filters[i];
+    if ((nf->any_addr || nf->addr == se->addr) &&
+        (nf->any_port || nf->port == se->port))
+      return True;
+  }
+  return False;
+}
+
+/* With no filter every socket is a taint source, as before.  With one,
+ * a connection is tainted if either its peer or the local address it
+ * was accepted on matches an entry.
+ */
+static
+Bool network_fd_wanted(Int fd)
+{
+  if (n_network_filters == 0)
+    return True;
+  return network_filter_matches_end(&fd_sockinfo[fd].remote) ||
+         network_filter_matches_end(&fd_sockinfo[fd].local);
+}
+
+/* Read an AF_INET sockaddr out of client memory.  Other families leave
+ * the end invalid, which no filter entry matches. */
+static
+void read_sockaddr(Addr sa, UInt salen, SockEnd *se)
+{
+  struct vki_sockaddr_in *sin = (struct vki_sockaddr_in *)sa;
+  UChar *port;
+
+  se->valid = False;
+  if (sa == 0 || salen < sizeof(struct vki_sockaddr_in))
+    return;
+  if (!VG_(am_is_valid_for_client)(sa, sizeof(struct vki_sockaddr_in),
+                                   VKI_PROT_READ))
+    return;
+  if (sin->sin_family != VKI_AF_INET)
+    return;
+  port = (UChar *)&sin->sin_port;
+  se->addr  = sin->sin_addr.s_addr;
+  se->port  = (port[0] << 8) | port[1];
+  se->valid = True;
+}
+
 void FL_(setup_tainted_map)( void ) {
   ThreadId t = 0;
   VG_(memset)(tainted_fds, False, sizeof(tainted_fds));
+  VG_(memset)(fd_sockinfo, 0, sizeof(fd_sockinfo));
   /* Taint stdin if specified */
   if (FL_(clo_taint_stdin))
     for(t=0; t < VG_N_THREADS; ++t)
       tainted_fds[t][0] = True;
 }
 
+/* --input-shm=<name>:<fd>: read()s on <fd> never reach the kernel but
+ * are served, tainted, from the shared memory object /dev/shm/<name>.
+ * The driver lays it out as an InputShmHeader followed by the data.  To
+ * publish an input it writes the data and len, then bumps seq; reading
+ * then restarts from the beginning of the data.  Once an input has been
+ * read to its end read() returns 0 until the next one is published.
+ */
+typedef
+       struct {
+         UInt seq;
+         UInt len;
+       }
+InputShmHeader;
+
+static Int             input_shm_fd  = -1;
+static InputShmHeader* input_shm     = NULL;
+static SizeT           input_shm_max = 0;  // room for data in the mapping
+static UInt            input_shm_seq = 0;
+static SizeT           input_shm_off = 0;
+
+Bool FL_(setup_input_shm)( void ) {
+  Char path[MAX_PATH];
+  Char *name = FL_(clo_input_shm), *colon, *p;
+  struct vki_stat st;
+  SysRes sres;
+  Int shm_fd;
+
+  if (name == NULL)
+    return True;
+
+  colon = VG_(strrchr)(name, ':');
+  if (colon == NULL || colon == name || colon[1] == '\0')
+    return False;
+  for (p = colon + 1; *p; p++)
+    if (*p < '0' || *p > '9')
+      return False;
+  input_shm_fd = VG_(atoll)(colon + 1);
+
+  while (*name == '/')
+    name++;
+  if (colon - name + VG_(strlen)("/dev/shm/") >= MAX_PATH)
+    return False;
+  VG_(strcpy)(path, "/dev/shm/");
+  VG_(strncat)(path, name, colon - name);
+
+  sres = VG_(open)(path, VKI_O_RDONLY, 0);
+  if (sres.isError) {
+    VG_(message)(Vg_UserMsg, "can't open input shm '%s'", path);
+    return False;
+  }
+  shm_fd = sres.res;
+  if (VG_(fstat)(shm_fd, &st) != 0 || st.st_size < sizeof(InputShmHeader)) {
+    VG_(message)(Vg_UserMsg, "input shm '%s' is too small", path);
+    VG_(close)(shm_fd);
+    return False;
+  }
+  sres = VG_(am_shared_mmap_file_float_valgrind)(st.st_size, VKI_PROT_READ,
+                                                 shm_fd, 0);
+  VG_(close)(shm_fd);
+  if (sres.isError) {
+    VG_(message)(Vg_UserMsg, "can't map input shm '%s'", path);
+    return False;
+  }
+
+  input_shm     = (InputShmHeader *)sres.res;
+  input_shm_max = st.st_size - sizeof(InputShmHeader);
+  input_shm_seq = input_shm->seq;
+  input_shm_off = 0;
+  return True;
+}
+
+/* Completes a read() on the --input-shm fd from the shared buffer. */
+static
+void input_shm_read(ThreadId tid) {
+  Addr  buf   = guest_args[tid].args[1];
+  SizeT count = guest_args[tid].args[2];
+  SizeT len   = input_shm->len;
+
+  if (input_shm->seq != input_shm_seq) {
+    input_shm_seq = input_shm->seq;
+    input_shm_off = 0;
+  }
+  if (len > input_shm_max)
+    len = input_shm_max;
+  if (input_shm_off > len)
+    input_shm_off = len;
+  if (count > len - input_shm_off)
+    count = len - input_shm_off;
+
+  if (count > 0 &&
+      !VG_(am_is_valid_for_client)(buf, count, VKI_PROT_WRITE)) {
+    VG_(tool_complete_syscall)(tid, VG_(mk_SysRes_Error)(VKI_EFAULT));
+    return;
+  }
+  VG_(memcpy)((void *)buf, (UChar *)(input_shm + 1) + input_shm_off, count);
+  input_shm_off += count;
+  VG_(tool_complete_syscall)(tid, VG_(mk_SysRes_Success)(count));
+}
 
 /* Dup of strstr for arbitrary bytes */
 static
@@ -152,21 +457,37 @@ Char* memmem(Char *haystack, Char *needle, SizeT h_len, SizeT n_len) {
 void FL_(syscall_read)(ThreadId tid, SysRes res) {
   Int fd = -1;
   Char *data = NULL;
+  SizeT len, queued;
   populate_guest_args(tid);
 
   fd = guest_args[tid].args[3];
   data = (Char *)(guest_args[tid].args[1]);
 
-  if (fd < 0 || res.res <= 0)
+  if (fd < 0 || res.isError || res.res <= 0)
     return;
 
+  if (fd == input_shm_fd) {
+    taint_input((UWord)data, res.res);
+    return;
+  }
+
+  /* Bytes written by this process to the other end of a pipe or local
+   * socket carry their own taint; only the rest is up to the policy
+   * below. */
+  len = res.res;
+  queued = FL_(channel_read)(fd, (Addr)data, len, False);
+  if (queued == len)
+    return;
+  data += queued;
+  len -= queued;
+
   // for (;guest_args[tid].used > 0; guest_args[tid].used--)
   //   VG_(printf)("[%d]syscall_read: arg%d: %lx\n", tid, guest_args[tid].used, guest_args[tid].args[guest_args[tid].used]);
 
    // VG_(printf)("[%d]syscall_read: fd:%d p:%p res:%ul\n", tid, fd, data, res.res);
 
   if (fd < MAXIMUM_FDS && tainted_fds[tid][fd] == True) {
-      FL_(make_mem_undefined)((UWord)data, res.res);
+      taint_input((UWord)data, len);
       return;
   }
 
@@ -174,7 +495,8 @@ void FL_(syscall_read)(ThreadId tid, SysRes res) {
    * XXX: add better arguments
    */
   if (FL_(clo_taint_string) != NULL) {
-    SizeT remaining = res.res;
+    Char *start = data;
+    SizeT remaining = len;
     SizeT taint_len = VG_(strlen)(FL_(clo_taint_string));
     while (data != NULL && remaining > taint_len) {
       /* XXX: this is tricky - should tainting above still be done? */
@@ -184,20 +506,71 @@ void FL_(syscall_read)(ThreadId tid, SysRes res) {
 
       data = memmem(data, FL_(clo_taint_string), remaining, taint_len);
       if (data != NULL) {
-        remaining = res.res - (data - ((Char *)guest_args[tid].args[1]));
-        FL_(make_mem_undefined)((UWord)data, taint_len);
+        remaining = len - (data - start);
+        taint_input((UWord)data, taint_len);
         data += taint_len;
       }
     }
   }
 }
 
+/* Called before read() is issued; the fork server may want to take its
+ * snapshot here so that every child does the read itself. */
+void FL_(syscall_pre_read)(ThreadId tid) {
+  Int fd;
+  populate_guest_args(tid);
+  fd = guest_args[tid].args[3];
+  if (fd < 0)
+    return;
+  if (FL_(clo_fork_server) &&
+      (fd == input_shm_fd ||
+       (fd < MAXIMUM_FDS && tainted_fds[tid][fd] == True)))
+    FL_(fork_server_pre_read)(tid, fd);
+  if (fd == input_shm_fd)
+    input_shm_read(tid);
+}
+
 void FL_(syscall_close)(ThreadId tid, SysRes res) {
   Int fd = -1;
   populate_guest_args(tid);
   fd = guest_args[tid].args[1];
-  if (fd > -1 && fd < MAXIMUM_FDS)
+  if (fd > -1 && fd < MAXIMUM_FDS) {
     tainted_fds[tid][fd] = False;
+    VG_(memset)(&fd_sockinfo[fd], 0, sizeof(fd_sockinfo[fd]));
+  }
+  if (!res.isError)
+    FL_(channel_close)(fd);
+}
+
+void FL_(syscall_write)(ThreadId tid, SysRes res) {
+  populate_guest_args(tid);
+  if (res.isError || res.res <= 0)
+    return;
+  FL_(channel_write)(guest_args[tid].args[3], guest_args[tid].args[1],
+                     res.res);
+}
+
+void FL_(syscall_pipe)(ThreadId tid, SysRes res) {
+  Int *fds;
+  populate_guest_args(tid);
+  fds = (Int *)guest_args[tid].args[3];
+  if (res.isError ||
+      !VG_(am_is_valid_for_client)((Addr)fds, 2 * sizeof(Int), VKI_PROT_READ))
+    return;
+  FL_(channel_pipe)(fds[0], fds[1]);
+}
+
+/* dup() and dup2(): the new fd shares the old one's channel and taint. */
+void FL_(syscall_dup)(ThreadId tid, SysRes res) {
+  Int oldfd, newfd = res.res;
+  populate_guest_args(tid);
+  oldfd = guest_args[tid].args[3];
+  if (res.isError || oldfd < 0 || oldfd >= MAXIMUM_FDS ||
+      newfd < 0 || newfd >= MAXIMUM_FDS || oldfd == newfd)
+    return;
+  tainted_fds[tid][newfd] = tainted_fds[tid][oldfd];
+  fd_sockinfo[newfd] = fd_sockinfo[oldfd];
+  FL_(channel_dup)(oldfd, newfd);
 }
 
 void FL_(syscall_open)(ThreadId tid, SysRes res) {
@@ -247,6 +620,9 @@ void FL_(syscall_socketcall)(ThreadId tid, SysRes res) {
       //VG_(printf)("syscall_socketcall: SOCKET\n");
       FL_(syscall_socket)(tid, res);
       break;
+    case VKI_SYS_BIND:
+      FL_(syscall_bind)(tid, res);
+      break;
     case VKI_SYS_LISTEN:
       //FL_(syscall_listen)(tid, res);
       break;
@@ -273,6 +649,11 @@ void FL_(syscall_socketcall)(ThreadId tid, SysRes res) {
       break;
     case VKI_SYS_RECV:
      // VG_(printf)("syscall_socketcall: RECV\n");
+      FL_(syscall_recvfrom)(tid, res);
+      break;
+    case VKI_SYS_SEND:
+    case VKI_SYS_SENDTO:
+      FL_(syscall_send)(tid, res);
       break;
     case VKI_SYS_RECVMSG:
       //VG_(printf)("syscall_socketcall: RECVMSG\n");
@@ -302,34 +683,61 @@ void FL_(syscall_socket)(ThreadId tid, SysRes res) {
     return;
 
   if (fd > -1 && fd < MAXIMUM_FDS) {
-    tainted_fds[tid][fd] = True;
+    VG_(memset)(&fd_sockinfo[fd], 0, sizeof(fd_sockinfo[fd]));
+    // With a filter, wait for connect()/accept() to decide.
+    tainted_fds[tid][fd] = (n_network_filters == 0);
     //VG_(printf)("syscall_socket: tainting %d\n", fd);
   }
 }
 
+void FL_(syscall_bind)(ThreadId tid, SysRes res) {
+  // Assume this is called directly after arguments have been populated.
+  Int fd = SC_ARG0;
+
+  if (!FL_(clo_taint_network) || n_network_filters == 0)
+    return;
+  if (res.isError)
+    return;
+  if (fd > -1 && fd < MAXIMUM_FDS)
+    read_sockaddr(SC_ARG1, SC_ARG2, &fd_sockinfo[fd].local);
+}
+
 
 
 void FL_(syscall_connect)(ThreadId tid, SysRes res) {
   // Assume this is called directly after arguments have been populated.
   Int fd = SC_ARG0;
 
+  // Non-blocking connects fail with EINPROGRESS, so ignore res here.
+  FL_(channel_connect)(fd, SC_ARG1, SC_ARG2);
+
   // Nothing to do if no network tainting
   if (!FL_(clo_taint_network))
     return;
   if (fd > -1 && fd < MAXIMUM_FDS) {
-    tainted_fds[tid][fd] = True;
+    // Non-blocking connects fail with EINPROGRESS, so ignore res here.
+    read_sockaddr(SC_ARG1, SC_ARG2, &fd_sockinfo[fd].remote);
+    tainted_fds[tid][fd] = network_fd_wanted(fd);
     // VG_(printf)("syscall_connect: tainting %d\n", fd);
   }
 }
 
 void FL_(syscall_socketpair)(ThreadId tid, SysRes res) {
   // Assume this is called directly after arguments have been populated.
-  Int fd = ((Int *)SC_ARG3)[0];
+  Int *fds = (Int *)SC_ARG3;
+  Int fd;
+
+  if (res.isError ||
+      !VG_(am_is_valid_for_client)((Addr)fds, 2 * sizeof(Int), VKI_PROT_READ))
+    return;
+  fd = fds[0];
+  FL_(channel_socketpair)(fds[0], fds[1]);
 
   // Nothing to do if no network tainting
   if (!FL_(clo_taint_network))
     return;
   if (fd > -1 && fd < MAXIMUM_FDS) {
+    // Only what the other end didn't write from this process.
     tainted_fds[tid][fd] = True;
     // VG_(printf)("syscall_socketpair: tainting fd %d\n", fd);
   }
@@ -340,24 +748,54 @@ void FL_(syscall_socketpair)(ThreadId tid, SysRes res) {
 
 void FL_(syscall_accept)(ThreadId tid, SysRes res) {
   Int fd = res.res;
+  if (res.isError)
+    return;
+  // Assume this is called directly after arguments have been populated.
+  FL_(channel_accept)(SC_ARG0, fd);
+
   // Nothing to do if no network tainting
   if (!FL_(clo_taint_network))
     return;
   if (fd > -1 && fd < MAXIMUM_FDS) {
-    tainted_fds[tid][fd] = True;
+    VG_(memset)(&fd_sockinfo[fd], 0, sizeof(fd_sockinfo[fd]));
+    if (n_network_filters > 0) {
+      // Assume this is called directly after arguments have been populated.
+      Int lfd = SC_ARG0;
+      Int *lenp = (Int *)SC_ARG2;
+      if (lfd > -1 && lfd < MAXIMUM_FDS)
+        fd_sockinfo[fd].local = fd_sockinfo[lfd].local;
+      if (lenp != NULL &&
+          VG_(am_is_valid_for_client)((Addr)lenp, sizeof(Int), VKI_PROT_READ))
+        read_sockaddr(SC_ARG1, *lenp, &fd_sockinfo[fd].remote);
+    }
+    tainted_fds[tid][fd] = network_fd_wanted(fd);
     // VG_(printf)("syscall_connect: tainting %d\n", fd);
   }
 }
 
+/* recv() and recvfrom() share their first four arguments. */
 void FL_(syscall_recvfrom)(ThreadId tid, SysRes res) {
   Int fd = SC_ARG0;
+  Addr buf = SC_ARG1;
+  SizeT len, queued;
 
-
-  if (fd > -1 && fd < MAXIMUM_FDS && tainted_fds[tid][fd] == True && res.res > 0) {
-    FL_(make_mem_undefined)(SC_ARG1, res.res);
+  if (res.isError || res.res <= 0)
+    return;
+  len = res.res;
+  queued = FL_(channel_read)(fd, buf, len, (SC_ARG3 & VKI_MSG_PEEK) != 0);
+  if (queued < len &&
+      fd > -1 && fd < MAXIMUM_FDS && tainted_fds[tid][fd] == True) {
+    taint_input(buf + queued, len - queued);
   }
 }
 
+/* send() and sendto() share their first four arguments. */
+void FL_(syscall_send)(ThreadId tid, SysRes res) {
+  if (res.isError || res.res <= 0)
+    return;
+  FL_(channel_write)(SC_ARG0, SC_ARG1, res.res);
+}
+
 
 /* Annoyingly uses the struct msghdr from sys/socket.h
  * XXX: scatter gather array and readv() not yet supported.d 
@@ -368,7 +806,7 @@ void FL_(syscall_recvmsg)(ThreadId tid, SysRes res) {
 
   if (fd > -1 && fd < MAXIMUM_FDS && tainted_fds[tid][fd] == True && res.res > 0) {
     // XXX: if MSG_TRUNC, this will taint more memory than it should.
-    FL_(make_mem_undefined)((UWord)msg->msg_control, res.res);
+    taint_input((UWord)msg->msg_control, res.res);
   }
 }
 
@@ -39,6 +39,7 @@
 #include "pub_tool_libcprint.h"
 #include "pub_tool_tooliface.h"
 #include "pub_tool_machine.h"     // VG_(fnptr_to_fnentry)
+#include "pub_tool_transtab.h"    // VG_(mark_translation_transient)
 #include "fl_include.h"
 
 
@@ -915,6 +916,160 @@ static void complainIfUndefined ( MCEnv* mce, IRAtom* atom )
 }
 
 
+/* As complainIfUndefined, for the guard of the Ist_Exit at pc.  With
+   --demote-branches-after, the report goes through a helper which
+   counts reports per site, and once a site is demoted the guard just
+   adds to the site's counter, inline. */
+static void complainIfUndefinedBranch ( MCEnv* mce, IRAtom* guard,
+                                        Addr64 pc )
+{
+   IRAtom*   vatom;
+   IRAtom*   cond;
+   IRDirty*  di;
+   UWord*    counter;
+   IRType    ty;
+   IREndness end;
+
+   if (FL_(clo_demote_branches_after) == 0) {
+      complainIfUndefined(mce, guard);
+      return;
+   }
+
+#  if defined(VG_BIGENDIAN)
+   end = Iend_BE;
+#  elif defined(VG_LITTLEENDIAN)
+   end = Iend_LE;
+#  else
+#    error "Unknown endianness"
+#  endif
+
+   tl_assert(isOriginalAtom(mce, guard));
+   vatom = expr2vbits( mce, guard );
+   tl_assert(isShadowAtom(mce, vatom));
+   tl_assert(typeOfIRExpr(mce->bb->tyenv, vatom) == Ity_I1);
+
+   cond = mkPCastTo( mce, Ity_I1, vatom );
+   counter = FL_(branch_site_counter)( (Addr)pc );
+
+   if (counter == NULL) {
+      di = unsafeIRDirty_0_N(
+              1/*regparms*/,
+              "FL_(helperc_branch_check_fail)",
+              VG_(fnptr_to_fnentry)( &FL_(helperc_branch_check_fail) ),
+              mkIRExprVec_1( mkIRExpr_HWord( (HWord)pc ) )
+           );
+      di->guard = cond;
+      setHelperAnns( mce, di );
+      stmt( mce->bb, IRStmt_Dirty(di) );
+   } else {
+      /* *counter += cond.  The counter is in the heap, so the next
+         run can't have this translation. */
+      IRAtom* addr = mkIRExpr_HWord( (HWord)counter );
+      IRAtom* old;
+      IRAtom* inc;
+      ty  = mce->hWordTy;
+      old = assignNew(mce, ty, IRExpr_Load(end, ty, addr));
+      inc = assignNew(mce, ty, unop(ty == Ity_I32 ? Iop_1Uto32 : Iop_1Uto64,
+                                    cond));
+      stmt( mce->bb, IRStmt_Store(end, addr,
+               assignNew(mce, ty, binop(ty == Ity_I32 ? Iop_Add32 : Iop_Add64,
+                                        old, inc))) );
+      VG_(mark_translation_transient)();
+   }
+
+   /* The guard is defined from here on; see complainIfUndefined. */
+   if (vatom->tag == Iex_RdTmp) {
+      tl_assert(guard->tag == Iex_RdTmp);
+      newShadowTmp(mce, guard->Iex.RdTmp.tmp);
+      assign(mce->bb, findShadowTmp(mce, guard->Iex.RdTmp.tmp),
+                      definedOfType(Ity_I1));
+   }
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Coverage bitmaps (--coverage-shm)                    ---*/
+/*------------------------------------------------------------*/
+
+/* On entry to the superblock at a:
+      edges[prev ^ cur]++;  prev = cur >> 1;
+   all inline.  See fl_coverage.c.  The maps' address is loaded rather
+   than baked in, since it differs from run to run and the code may be
+   kept for later runs by --translation-cache. */
+static void coverageEdge ( MCEnv* mce, Addr64 a )
+{
+   IRType    ty = mce->hWordTy;
+   UWord     cur = FL_(coverage_block_id)( a );
+   IRAtom*   prev_addr = mkIRExpr_HWord( (HWord)&FL_(coverage_prev) );
+   IRAtom*   map;
+   IRAtom*   prev;
+   IRAtom*   slot;
+   IRAtom*   old;
+   IREndness end;
+
+#  if defined(VG_BIGENDIAN)
+   end = Iend_BE;
+#  elif defined(VG_LITTLEENDIAN)
+   end = Iend_LE;
+#  else
+#    error "Unknown endianness"
+#  endif
+
+   map  = assignNew(mce, ty, IRExpr_Load(end, ty,
+                        mkIRExpr_HWord( (HWord)&FL_(coverage_map) )));
+   prev = assignNew(mce, ty, IRExpr_Load(end, ty, prev_addr));
+   slot = assignNew(mce, ty, binop(ty == Ity_I32 ? Iop_Xor32 : Iop_Xor64,
+                                   prev, mkIRExpr_HWord( (HWord)cur )));
+   slot = assignNew(mce, ty, binop(ty == Ity_I32 ? Iop_Add32 : Iop_Add64,
+                                   slot, map));
+   old  = assignNew(mce, Ity_I8, IRExpr_Load(end, Ity_I8, slot));
+   stmt( mce->bb, IRStmt_Store(end, slot,
+            assignNew(mce, Ity_I8, binop(Iop_Add8, old, mkU8(1)))) );
+   stmt( mce->bb, IRStmt_Store(end, prev_addr,
+                               mkIRExpr_HWord( (HWord)(cur >> 1) )) );
+}
+
+/* For the Ist_Exit at pc, whose guard is now guard and whose
+   original guard was tainted if tainted is 1:
+      branches[id(pc) << 1 | guard] |= tainted;
+   inline. */
+static void coverageBranch ( MCEnv* mce, IRAtom* tainted, IRAtom* guard,
+                             Addr64 pc )
+{
+   IRType    ty = mce->hWordTy;
+   UWord     off = FL_COVERAGE_MAP_SIZE
+                   + ((FL_(coverage_block_id)( pc ) << 1)
+                      & (FL_COVERAGE_MAP_SIZE - 1));
+   IRAtom*   map;
+   IRAtom*   slot;
+   IRAtom*   old;
+   IREndness end;
+
+#  if defined(VG_BIGENDIAN)
+   end = Iend_BE;
+#  elif defined(VG_LITTLEENDIAN)
+   end = Iend_LE;
+#  else
+#    error "Unknown endianness"
+#  endif
+
+   map  = assignNew(mce, ty, IRExpr_Load(end, ty,
+                        mkIRExpr_HWord( (HWord)&FL_(coverage_map) )));
+   slot = assignNew(mce, ty, unop(ty == Ity_I32 ? Iop_1Uto32 : Iop_1Uto64,
+                                  guard));
+   slot = assignNew(mce, ty, binop(ty == Ity_I32 ? Iop_Add32 : Iop_Add64,
+                                   slot, mkIRExpr_HWord( (HWord)off )));
+   slot = assignNew(mce, ty, binop(ty == Ity_I32 ? Iop_Add32 : Iop_Add64,
+                                   slot, map));
+   old  = assignNew(mce, Ity_I8, IRExpr_Load(end, Ity_I8, slot));
+   stmt( mce->bb, IRStmt_Store(end, slot,
+            assignNew(mce, Ity_I8,
+                      binop(Iop_Or8, old,
+                            assignNew(mce, Ity_I8,
+                                      unop(Iop_1Uto8, tainted))))) );
+}
+
+
 /*------------------------------------------------------------*/
 /*--- Shadowing PUTs/GETs, and indexed variants thereof    ---*/
 /*------------------------------------------------------------*/
@@ -1817,6 +1972,93 @@ IRAtom* expr2vbits_Triop ( MCEnv* mce,
 }
 
 
+/* --------- Logging of tainted CmpEQ/CmpNE. --------- */
+
+/* For --emit-cmp-log: call a helper with both operands and their V
+   bits whenever either operand is tainted, so it can log a compare of
+   tainted input against a constant.  The helper takes 64-bit args on
+   all hosts. */
+static void logCmpIfTainted ( MCEnv*  mce,
+                              IRType  ty,
+                              IRAtom* vxx, IRAtom* vyy,
+                              IRAtom* xx,  IRAtom* yy )
+{
+   IRDirty* di;
+   IRAtom*  cond;
+
+   if (FL_(clo_emit_cmp_log) == NULL)
+      return;
+
+   tl_assert(isShadowAtom(mce,vxx));
+   tl_assert(isShadowAtom(mce,vyy));
+   tl_assert(isOriginalAtom(mce,xx));
+   tl_assert(isOriginalAtom(mce,yy));
+
+   switch (ty) {
+      case Ity_I32:
+         cond = mkPCastTo(mce, Ity_I1, mkUifU32(mce, vxx, vyy));
+         xx  = assignNew(mce, Ity_I64, unop(Iop_32Uto64, xx));
+         yy  = assignNew(mce, Ity_I64, unop(Iop_32Uto64, yy));
+         vxx = assignNew(mce, Ity_I64, unop(Iop_32Uto64, vxx));
+         vyy = assignNew(mce, Ity_I64, unop(Iop_32Uto64, vyy));
+         di = unsafeIRDirty_0_N(
+                 0/*regparms*/,
+                 "FL_(helperc_log_cmp4)",
+                 VG_(fnptr_to_fnentry)( &FL_(helperc_log_cmp4) ),
+                 mkIRExprVec_4( xx, yy, vxx, vyy )
+              );
+         break;
+      case Ity_I64:
+         cond = mkPCastTo(mce, Ity_I1, mkUifU64(mce, vxx, vyy));
+         di = unsafeIRDirty_0_N(
+                 0/*regparms*/,
+                 "FL_(helperc_log_cmp8)",
+                 VG_(fnptr_to_fnentry)( &FL_(helperc_log_cmp8) ),
+                 mkIRExprVec_4( xx, yy, vxx, vyy )
+              );
+         break;
+      default:
+         VG_(tool_panic)("logCmpIfTainted");
+   }
+
+   di->guard = cond;
+   setHelperAnns( mce, di );
+   stmt( mce->bb, IRStmt_Dirty(di) );
+}
+
+
+/* For --shadow-stack: at the end of a superblock which calls, push the
+   return address, which is just after its last instruction; at the end
+   of one which returns, pop.  Both go with the final stack pointer. */
+static void shadowCallStack ( MCEnv* mce, IRJumpKind jk, Addr64 next_addr )
+{
+   IRDirty* di;
+   IRAtom*  sp;
+
+   if (jk != Ijk_Call && jk != Ijk_Ret)
+      return;
+
+   sp = assignNew(mce, mce->hWordTy,
+                  IRExpr_Get(mce->layout->offset_SP, mce->hWordTy));
+   if (jk == Ijk_Call) {
+      di = unsafeIRDirty_0_N(
+              2/*regparms*/,
+              "FL_(helperc_shadow_call)",
+              VG_(fnptr_to_fnentry)( &FL_(helperc_shadow_call) ),
+              mkIRExprVec_2( mkIRExpr_HWord( (HWord)next_addr ), sp )
+           );
+   } else {
+      di = unsafeIRDirty_0_N(
+              1/*regparms*/,
+              "FL_(helperc_shadow_ret)",
+              VG_(fnptr_to_fnentry)( &FL_(helperc_shadow_ret) ),
+              mkIRExprVec_1( sp )
+           );
+   }
+   stmt( mce->bb, IRStmt_Dirty(di) );
+}
+
+
 static 
 IRAtom* expr2vbits_Binop ( MCEnv* mce,
                            IROp op,
@@ -2260,6 +2502,7 @@ IRAtom* expr2vbits_Binop ( MCEnv* mce,
 
       case Iop_CmpEQ64: 
       case Iop_CmpNE64:
+         logCmpIfTainted(mce,Ity_I64, vatom1,vatom2, atom1,atom2 );
          if (mce->bogusLiterals)
             return expensiveCmpEQorNE(mce,Ity_I64, vatom1,vatom2, atom1,atom2 );
          else
@@ -2271,6 +2514,7 @@ IRAtom* expr2vbits_Binop ( MCEnv* mce,
 
       case Iop_CmpEQ32: 
       case Iop_CmpNE32:
+         logCmpIfTainted(mce,Ity_I32, vatom1,vatom2, atom1,atom2 );
          if (mce->bogusLiterals)
             return expensiveCmpEQorNE(mce,Ity_I32, vatom1,vatom2, atom1,atom2 );
          else
@@ -3261,6 +3505,7 @@ IRSB* FL_(instrument) ( VgCallbackClosure* closure,
    Int  imark_len = 0;
    Char *instr_addr_p = NULL;
    Long skip_ret;
+   IRAtom* guard_tainted = NULL;
    // Used by alter-branch to track address of a Ist_Exit IMark.
    // TODO(redpig@dataspill.org): make this a define
    Char instr_addr[21];
@@ -3375,6 +3620,9 @@ IRSB* FL_(instrument) ( VgCallbackClosure* closure,
    tl_assert(i < bb_in->stmts_used);
    tl_assert(bb_in->stmts[i]->tag == Ist_IMark);
 
+   if (FL_(coverage_map) != NULL)
+      coverageEdge( &mce, bb_in->stmts[i]->Ist.IMark.addr );
+
    for (/* use current i*/; i <  bb_in->stmts_used; i++) {
 
       st = bb_in->stmts[i];
@@ -3460,8 +3708,15 @@ IRSB* FL_(instrument) ( VgCallbackClosure* closure,
             break;
 
           case Ist_Exit:
+            // Note whether the guard is tainted before the complaint
+            // below marks it defined.
+            if (FL_(coverage_map) != NULL)
+              guard_tainted = mkPCastTo( &mce, Ity_I1,
+                                         expr2vbits( &mce,
+                                                     st->Ist.Exit.guard ) );
             // Always complain about tainted guards - even when we replace them.
-            complainIfUndefined( &mce, st->Ist.Exit.guard );
+            complainIfUndefinedBranch( &mce, st->Ist.Exit.guard,
+                                       imark_addr );
             // The guard is the expression used to determine if
             // an Ist_Exit will be followed. By passing in
             // pointer:value pairs to change-branch, this will
@@ -3491,6 +3746,9 @@ IRSB* FL_(instrument) ( VgCallbackClosure* closure,
                 }
               }
             }
+            if (FL_(coverage_map) != NULL)
+              coverageBranch( &mce, guard_tainted, st->Ist.Exit.guard,
+                              imark_addr );
            break;
 
          case Ist_NoOp:
@@ -3501,6 +3759,19 @@ IRSB* FL_(instrument) ( VgCallbackClosure* closure,
             /* Store these for function skipping */
            imark_addr = st->Ist.IMark.addr;
            imark_len = st->Ist.IMark.len;
+           /* --fork-server --fork-at=0xADDR: hand over to the fork
+              server before this instruction runs. */
+           if (st->tag == Ist_IMark && FL_(fork_server_at)(imark_addr)) {
+              IRDirty* di = unsafeIRDirty_0_N(
+                               0/*regparms*/,
+                               "FL_(helperc_fork_server)",
+                               VG_(fnptr_to_fnentry)( &FL_(helperc_fork_server) ),
+                               mkIRExprVec_0()
+                            );
+              addStmtToIRSB( bb, st );
+              stmt( bb, IRStmt_Dirty(di) );
+              st = IRStmt_NoOp();
+           }
          case Ist_MFence:
             break;
 
@@ -3575,6 +3846,10 @@ IRSB* FL_(instrument) ( VgCallbackClosure* closure,
 
    complainIfUndefined( &mce, bb->next );
 
+   /* Keep the shadow call stack up to date. */
+   if (FL_(clo_shadow_stack))
+      shadowCallStack( &mce, bb->jumpkind, imark_addr + imark_len );
+
    if (verboze) {
       for (j = first_stmt; j < bb->stmts_used; j++) {
          VG_(printf)("=>");
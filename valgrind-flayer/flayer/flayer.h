@@ -99,9 +99,21 @@ typedef
 
       VG_USERREQ__MAKE_MEM_UNTAINTED_IF_ADDRESSABLE,
 
-      /* This is just for flayer's internal use - don't use it */
+      VG_USERREQ__FORK_SERVER,
+
+      VG_USERREQ__ITERATION_BEGIN,
+      VG_USERREQ__ITERATION_END,
+
+      /* These are just for flayer's internal use - don't use them */
       _VG_USERREQ__FLAYER_RECORD_OVERLAP_ERROR 
-         = VG_USERREQ_TOOL_BASE('M','C') + 256
+         = VG_USERREQ_TOOL_BASE('F','L') + 256,
+      _VG_USERREQ__FLAYER_MEMMOVE,
+      _VG_USERREQ__FLAYER_MEMSET,
+      _VG_USERREQ__FLAYER_STRLEN,
+      _VG_USERREQ__FLAYER_STRCMP,
+      _VG_USERREQ__FLAYER_MEMCMP,
+      _VG_USERREQ__FLAYER_STRCHR,
+      _VG_USERREQ__FLAYER_MEMCHR
    } Vg_MemCheckClientRequest;
 
 
@@ -160,6 +172,38 @@ typedef
     _qzz_res;                                                    \
    }))
 
+/* With --fork-server=yes --fork-at=client-request, turn this process
+   into a fork server here: each test case the driver asks for is run
+   in a child which returns from this request.  Does nothing otherwise
+   (or if no driver is listening). */
+#define VALGRIND_FLAYER_FORK_SERVER                              \
+   {unsigned int _qzz_res;                                       \
+    VALGRIND_DO_CLIENT_REQUEST(_qzz_res, 0,                      \
+                            VG_USERREQ__FORK_SERVER,             \
+                            0, 0, 0, 0, 0);                      \
+   }
+
+/* Persistent mode: bracket each input a harness runs in-process.
+   VALGRIND_FLAYER_ITERATION_BEGIN untaints all memory and registers
+   and forgets the errors seen so far; VALGRIND_FLAYER_ITERATION_END
+   prints a summary of the iteration.  Both return the iteration
+   number. */
+#define VALGRIND_FLAYER_ITERATION_BEGIN                          \
+   (__extension__({unsigned int _qzz_res;                        \
+    VALGRIND_DO_CLIENT_REQUEST(_qzz_res, 0 /* default return */, \
+                            VG_USERREQ__ITERATION_BEGIN,         \
+                            0, 0, 0, 0, 0);                      \
+    _qzz_res;                                                    \
+   }))
+
+#define VALGRIND_FLAYER_ITERATION_END                            \
+   (__extension__({unsigned int _qzz_res;                        \
+    VALGRIND_DO_CLIENT_REQUEST(_qzz_res, 0 /* default return */, \
+                            VG_USERREQ__ITERATION_END,           \
+                            0, 0, 0, 0, 0);                      \
+    _qzz_res;                                                    \
+   }))
+
 /* Create a block-description handle.  The description is an ascii
    string which is included in any messages pertaining to addresses
    within the specified memory range.  Has no other effect on the
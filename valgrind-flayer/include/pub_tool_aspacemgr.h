@@ -151,6 +151,11 @@ extern void* VG_(am_shadow_alloc)(SizeT size);
    accordingly.  This fails if the range isn't valid for valgrind. */
 extern SysRes VG_(am_munmap_valgrind)( Addr start, SizeT length );
 
+/* Map a file shared, at an unconstrained address, for valgrind (not
+   the client), eg. a buffer a tool shares with another process. */
+extern SysRes VG_(am_shared_mmap_file_float_valgrind)
+   ( SizeT length, UInt prot, Int fd, Off64T offset );
+
 #endif   // __PUB_TOOL_ASPACEMGR_H
 
 /*--------------------------------------------------------------------*/
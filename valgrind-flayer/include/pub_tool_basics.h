@@ -120,6 +120,11 @@ typedef
    }
    SysRes;
 
+/* Platform-independent SysRes constructors, eg. for
+   VG_(tool_complete_syscall). */
+extern SysRes VG_(mk_SysRes_Error)   ( UWord val );
+extern SysRes VG_(mk_SysRes_Success) ( UWord val );
+
 
 /* ---------------------------------------------------------------------
    Miscellaneous (word size, endianness, regparmness, stringification)
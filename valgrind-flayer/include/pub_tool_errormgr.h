@@ -61,6 +61,9 @@ ErrorKind   VG_(get_error_kind)    ( Error* err );
 Addr        VG_(get_error_address) ( Error* err );
 Char*       VG_(get_error_string)  ( Error* err );
 void*       VG_(get_error_extra)   ( Error* err );
+UInt        VG_(get_error_unique)  ( Error* err );
+Int         VG_(get_error_count)   ( Error* err );
+ThreadId    VG_(get_error_tid)     ( Error* err );
 
 /* Call this when an error occurs.  It will be recorded if it hasn't been
    seen before.  If it has, the existing error record will have its count
@@ -87,6 +90,14 @@ extern Bool VG_(unique_error) ( ThreadId tid, ErrorKind ekind,
                                 ExeContext* where, Bool print_error,
                                 Bool allow_GDB_attach, Bool count_error );
 
+/* Number of unsuppressed errors seen so far. */
+extern UInt VG_(get_n_errs_found) ( void );
+
+/* Forget all errors recorded so far and reset the counts, so that
+   errors seen again afterwards are reported again.  For tools which
+   run many inputs through one process. */
+extern void VG_(clear_errors) ( void );
+
 /* Gets a non-blank, non-comment line of at most nBuf chars from fd.
    Skips leading spaces on the line.  Returns True if EOF was hit instead.
    Useful for reading in extra tool-specific suppression lines.  */
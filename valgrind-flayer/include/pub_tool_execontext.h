@@ -60,6 +60,12 @@ extern ExeContext* VG_(record_ExeContext) ( ThreadId tid );
 extern void VG_(apply_ExeContext)( void(*action)(UInt n, Addr ip),
                                    ExeContext* ec, UInt n_ips );
 
+// The raw ips of an ExeContext, without the symbol lookups that
+// VG_(apply_ExeContext) does to stop at main(), and how many there are.
+// Entries after the first are return addresses, not call sites.
+extern Addr* VG_(get_ExeContext_StackTrace) ( ExeContext* e );
+extern UInt  VG_(get_ExeContext_n_ips)      ( ExeContext* e );
+
 // Compare two ExeContexts.  Number of callers considered depends on `res':
 //   Vg_LowRes:  2
 //   Vg_MedRes:  4
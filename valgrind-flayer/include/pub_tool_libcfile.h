@@ -56,6 +56,9 @@ extern Bool   VG_(getcwd) ( Char* buf, SizeT size );
 extern Int    VG_(readlink)( Char* path, Char* buf, UInt bufsize );
 extern Int    VG_(getdents)( UInt fd, struct vki_dirent *dirp, UInt count );
 
+extern Int VG_(getsockname) ( Int sd, struct vki_sockaddr *name, Int *namelen );
+extern Int VG_(getpeername) ( Int sd, struct vki_sockaddr *name, Int *namelen );
+
 #endif   // __PUB_TOOL_LIBCFILE_H
 
 /*--------------------------------------------------------------------*/
@@ -53,6 +53,14 @@ extern const Char *VG_(libdir);
 extern Int VG_(waitpid)( Int pid, Int *status, Int options );
 extern Int VG_(system) ( Char* cmd );
 
+/* Fork the entire Valgrind process, client and all.  Only 'tid'
+   survives in the child.  Returns as fork() does, but -1 on error. */
+extern Int VG_(fork_process) ( ThreadId tid );
+
+/* For use in the child after VG_(fork_process): with --log-file, move
+   this process's output to a log file named after its own pid. */
+extern void VG_(reopen_log_file_for_child) ( void );
+
 /* ---------------------------------------------------------------------
    Resource limits
    ------------------------------------------------------------------ */
@@ -41,6 +41,11 @@
 extern void* VG_(cli_malloc) ( SizeT align, SizeT nbytes );
 extern void  VG_(cli_free)   ( void* p );
 
+/* Make the block at p, from VG_(cli_malloc), at least nbytes long
+ * without moving it.  Returns False, leaving it be, if there isn't room
+ * after it. */
+extern Bool  VG_(cli_grow_in_place) ( void* p, SizeT nbytes );
+
 /* Check if an address is within a range, allowing for redzones at edges */
 extern Bool VG_(addr_is_in_block)( Addr a, Addr start,
                                    SizeT size, SizeT rz_szB );
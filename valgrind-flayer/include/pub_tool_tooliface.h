@@ -404,6 +404,11 @@ extern void VG_(needs_syscall_wrapper) (
    void (*post_syscall)(ThreadId tid, UInt syscallno, SysRes res)
 );
 
+/* May be called from the pre_syscall function to make the syscall
+   complete with the given result instead of going to the kernel.  The
+   core's and the tool's post-syscall actions are still done. */
+extern void VG_(tool_complete_syscall) ( ThreadId tid, SysRes res );
+
 /* Are tool-state sanity checks performed? */
 // Can be useful for ensuring a tool's correctness.  cheap_sanity_check()
 // is called very frequently;  expensive_sanity_check() is called less
@@ -436,6 +441,49 @@ extern void VG_(needs_malloc_replacement)(
    SizeT client_malloc_redzone_szB
 );
 
+/* Can the tool take stack traces more cheaply than the core's unwinder,
+   eg. from a shadow call stack it maintains itself?  If so,
+   get_StackTrace() is used by VG_(record_ExeContext) in place of
+   VG_(get_StackTrace)().  It returns the number of ips filled in, or 0
+   to fall back on the unwinder for this one. */
+extern void VG_(needs_stack_traces)(
+   UInt (*get_StackTrace)(ThreadId tid, Addr* ips, UInt n_ips)
+);
+
+/* Does the tool want to hear about every unsuppressed error as it is
+   counted, eg. to stream them out in a format of its own?  recorded()
+   is called with is_new True the first time an error is seen, and with
+   is_new False each time the count of an error already seen goes up.
+   If log_errors is False, the core doesn't print each new error in the
+   text or XML log as well, which saves naming every frame of its stack
+   there and then; errors are still counted, and shown at exit with -v. */
+extern void VG_(needs_error_stream)(
+   void (*recorded)(Error* err, Bool is_new),
+   Bool log_errors
+);
+
+/* Does the tool count some occurrences of its errors itself, eg. with
+   inline counters, instead of reporting each one?  Before the final
+   error counts are shown, more_occurrences() is asked how many times
+   each unsuppressed error happened without being reported, and that
+   many are added to the error's count. */
+extern void VG_(needs_final_error_counts)(
+   UInt (*more_occurrences)(Error* err)
+);
+
+/* Can the code the tool's instrumentation produces be saved to disk
+   and reused by a later run with the same command line (see
+   --translation-cache)?  Only if it depends on nothing but the guest
+   code and the options: no pointers to memory allocated at run time
+   baked into it.  Translations which break that rule can be left out
+   with VG_(mark_translation_transient).  The saved code is found again
+   by a hash of the options, so value_affects_code() is asked about each
+   option given: returning False, eg. for an output path, means
+   only whether the option was given is hashed, not its value. */
+extern void VG_(needs_persistent_translations)(
+   Bool (*value_affects_code)(Char* arg)
+);
+
 /* Can the tool do XML output?  This is a slight misnomer, because the tool
  * is not requesting the core to do anything, rather saying "I can handle
  * it". */
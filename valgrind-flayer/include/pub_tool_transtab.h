@@ -0,0 +1,53 @@
+
+/*--------------------------------------------------------------------*/
+/*--- The translation table and cache.                             ---*/
+/*---                                          pub_tool_transtab.h ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   Copyright (C) 2000-2007 Julian Seward
+      jseward@acm.org
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#ifndef __PUB_TOOL_TRANSTAB_H
+#define __PUB_TOOL_TRANSTAB_H
+
+// Discard any translations of guest code in [start, start+range), so
+// that the code is instrumented afresh the next time it runs.  Safe to
+// call from a helper called from generated code, as long as it is the
+// last thing the translation being run relies on: its code stays
+// where it is until the sector holding it is recycled, which can't
+// happen before the next translation is made.
+extern void VG_(discard_translations_safely) ( Addr64 start, ULong range,
+                                               HChar* who );
+
+// Called from the tool's instrument function: the translation being
+// made must not be saved by --translation-cache, eg. because it has a
+// pointer to memory allocated at run time baked into it.
+extern void VG_(mark_translation_transient) ( void );
+
+#endif   // __PUB_TOOL_TRANSTAB_H
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
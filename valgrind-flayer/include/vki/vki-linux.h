@@ -601,6 +601,7 @@ __KINLINE struct vki_cmsghdr * vki_cmsg_nxthdr (struct vki_msghdr *__msg, struct
 #define VKI_AF_INET	2	/* Internet IP Protocol		*/
 #define VKI_AF_INET6	10	/* IP version 6			*/
 
+#define VKI_MSG_PEEK		2
 #define VKI_MSG_NOSIGNAL	0x4000	/* Do not generate SIGPIPE */
 
 #define VKI_SOL_SCTP	132